@@ -0,0 +1,1578 @@
+#ifndef UTIL_BTREE_H
+#define UTIL_BTREE_H
+
+#include <functional>
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <limits>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "RedBlackTree.h"
+
+#if defined( __AVX2__ ) || defined( __SSE2__ )
+#include <immintrin.h>
+#elif defined( __aarch64__ ) && defined( __ARM_NEON )
+#include <arm_neon.h>
+#endif
+
+namespace util
+{
+	namespace detail
+	{
+		// Plain arithmetic keys ordered by std::less can be searched by
+		// comparing whole vectors of keys at once.
+		template< class _KeyT, class _LessT, class _K >
+		struct IsSimdSearchable: std::integral_constant< bool,
+			std::is_arithmetic< _KeyT >::value &&
+			!std::is_same< _KeyT, bool >::value &&
+			std::is_same< _KeyT, _K >::value &&
+			( std::is_same< _LessT, std::less< _KeyT > >::value ||
+			  std::is_same< _LessT, std::less<> >::value ) >
+		{};
+
+		// Number of keys less than key. Branch free, as keys are sorted
+		// the count is also the lower bound index.
+		template< class _T >
+		std::size_t countLess( _T const * keys, std::size_t count, _T key )
+		{
+			std::size_t result = 0;
+			std::size_t i = 0;
+
+			// Comparisons yield all ones per lane, so subtracting them
+			// counts matches without a horizontal step per block.
+#if defined( __AVX2__ )
+			if constexpr( std::is_integral< _T >::value && sizeof( _T ) == 4 )
+			{
+				__m256i bias = _mm256_set1_epi32(
+					std::is_signed< _T >::value ? 0 : INT32_MIN );
+				__m256i probe = _mm256_xor_si256(
+					_mm256_set1_epi32( std::int32_t( key ) ), bias );
+				__m256i sum = _mm256_setzero_si256();
+
+				for( ; i + 8 <= count; i += 8 )
+				{
+					__m256i block = _mm256_xor_si256( _mm256_loadu_si256(
+						reinterpret_cast< __m256i const * >( keys + i ) ),
+						bias );
+					sum = _mm256_sub_epi32( sum,
+						_mm256_cmpgt_epi32( probe, block ) );
+				}
+				alignas( 32 ) std::int32_t lanes[ 8 ];
+				_mm256_store_si256( reinterpret_cast< __m256i * >( lanes ),
+				                    sum );
+
+				for( std::int32_t lane: lanes )
+				{
+					result += std::size_t( lane );
+				}
+			}
+			else if constexpr( std::is_integral< _T >::value &&
+			                   sizeof( _T ) == 8 )
+			{
+				__m256i bias = _mm256_set1_epi64x(
+					std::is_signed< _T >::value ? 0 : INT64_MIN );
+				__m256i probe = _mm256_xor_si256(
+					_mm256_set1_epi64x( std::int64_t( key ) ), bias );
+				__m256i sum = _mm256_setzero_si256();
+
+				for( ; i + 4 <= count; i += 4 )
+				{
+					__m256i block = _mm256_xor_si256( _mm256_loadu_si256(
+						reinterpret_cast< __m256i const * >( keys + i ) ),
+						bias );
+					sum = _mm256_sub_epi64( sum,
+						_mm256_cmpgt_epi64( probe, block ) );
+				}
+				alignas( 32 ) std::int64_t lanes[ 4 ];
+				_mm256_store_si256( reinterpret_cast< __m256i * >( lanes ),
+				                    sum );
+
+				for( std::int64_t lane: lanes )
+				{
+					result += std::size_t( lane );
+				}
+			}
+			else if constexpr( std::is_same< _T, float >::value )
+			{
+				__m256 probe = _mm256_set1_ps( key );
+				__m256i sum = _mm256_setzero_si256();
+
+				for( ; i + 8 <= count; i += 8 )
+				{
+					__m256 block = _mm256_loadu_ps( keys + i );
+					sum = _mm256_sub_epi32( sum, _mm256_castps_si256(
+						_mm256_cmp_ps( block, probe, _CMP_LT_OQ ) ) );
+				}
+				alignas( 32 ) std::int32_t lanes[ 8 ];
+				_mm256_store_si256( reinterpret_cast< __m256i * >( lanes ),
+				                    sum );
+
+				for( std::int32_t lane: lanes )
+				{
+					result += std::size_t( lane );
+				}
+			}
+			else if constexpr( std::is_same< _T, double >::value )
+			{
+				__m256d probe = _mm256_set1_pd( key );
+				__m256i sum = _mm256_setzero_si256();
+
+				for( ; i + 4 <= count; i += 4 )
+				{
+					__m256d block = _mm256_loadu_pd( keys + i );
+					sum = _mm256_sub_epi64( sum, _mm256_castpd_si256(
+						_mm256_cmp_pd( block, probe, _CMP_LT_OQ ) ) );
+				}
+				alignas( 32 ) std::int64_t lanes[ 4 ];
+				_mm256_store_si256( reinterpret_cast< __m256i * >( lanes ),
+				                    sum );
+
+				for( std::int64_t lane: lanes )
+				{
+					result += std::size_t( lane );
+				}
+			}
+#elif defined( __SSE2__ )
+			if constexpr( std::is_integral< _T >::value && sizeof( _T ) == 4 )
+			{
+				__m128i bias = _mm_set1_epi32(
+					std::is_signed< _T >::value ? 0 : INT32_MIN );
+				__m128i probe = _mm_xor_si128(
+					_mm_set1_epi32( std::int32_t( key ) ), bias );
+				__m128i sum = _mm_setzero_si128();
+
+				for( ; i + 4 <= count; i += 4 )
+				{
+					__m128i block = _mm_xor_si128( _mm_loadu_si128(
+						reinterpret_cast< __m128i const * >( keys + i ) ),
+						bias );
+					sum = _mm_sub_epi32( sum, _mm_cmpgt_epi32( probe, block ) );
+				}
+				alignas( 16 ) std::int32_t lanes[ 4 ];
+				_mm_store_si128( reinterpret_cast< __m128i * >( lanes ), sum );
+
+				for( std::int32_t lane: lanes )
+				{
+					result += std::size_t( lane );
+				}
+			}
+			else if constexpr( std::is_same< _T, float >::value )
+			{
+				__m128 probe = _mm_set1_ps( key );
+				__m128i sum = _mm_setzero_si128();
+
+				for( ; i + 4 <= count; i += 4 )
+				{
+					__m128 block = _mm_loadu_ps( keys + i );
+					sum = _mm_sub_epi32( sum, _mm_castps_si128(
+						_mm_cmplt_ps( block, probe ) ) );
+				}
+				alignas( 16 ) std::int32_t lanes[ 4 ];
+				_mm_store_si128( reinterpret_cast< __m128i * >( lanes ), sum );
+
+				for( std::int32_t lane: lanes )
+				{
+					result += std::size_t( lane );
+				}
+			}
+#elif defined( __aarch64__ ) && defined( __ARM_NEON )
+			if constexpr( std::is_integral< _T >::value && sizeof( _T ) == 4 )
+			{
+				uint32x4_t sum = vdupq_n_u32( 0 );
+
+				for( ; i + 4 <= count; i += 4 )
+				{
+					uint32x4_t mask;
+
+					if constexpr( std::is_signed< _T >::value )
+					{
+						mask = vcltq_s32( vld1q_s32(
+							reinterpret_cast< std::int32_t const * >( keys + i ) ),
+							vdupq_n_s32( std::int32_t( key ) ) );
+					}
+					else
+					{
+						mask = vcltq_u32( vld1q_u32(
+							reinterpret_cast< std::uint32_t const * >( keys + i ) ),
+							vdupq_n_u32( std::uint32_t( key ) ) );
+					}
+					sum = vsubq_u32( sum, mask );
+				}
+				result += vaddvq_u32( sum );
+			}
+			else if constexpr( std::is_integral< _T >::value &&
+			                   sizeof( _T ) == 8 )
+			{
+				uint64x2_t sum = vdupq_n_u64( 0 );
+
+				for( ; i + 2 <= count; i += 2 )
+				{
+					uint64x2_t mask;
+
+					if constexpr( std::is_signed< _T >::value )
+					{
+						mask = vcltq_s64( vld1q_s64(
+							reinterpret_cast< std::int64_t const * >( keys + i ) ),
+							vdupq_n_s64( std::int64_t( key ) ) );
+					}
+					else
+					{
+						mask = vcltq_u64( vld1q_u64(
+							reinterpret_cast< std::uint64_t const * >( keys + i ) ),
+							vdupq_n_u64( std::uint64_t( key ) ) );
+					}
+					sum = vsubq_u64( sum, mask );
+				}
+				result += std::size_t( vaddvq_u64( sum ) );
+			}
+			else if constexpr( std::is_same< _T, float >::value )
+			{
+				uint32x4_t sum = vdupq_n_u32( 0 );
+
+				for( ; i + 4 <= count; i += 4 )
+				{
+					sum = vsubq_u32( sum, vcltq_f32( vld1q_f32( keys + i ),
+					                                 vdupq_n_f32( key ) ) );
+				}
+				result += vaddvq_u32( sum );
+			}
+			else if constexpr( std::is_same< _T, double >::value )
+			{
+				uint64x2_t sum = vdupq_n_u64( 0 );
+
+				for( ; i + 2 <= count; i += 2 )
+				{
+					sum = vsubq_u64( sum, vcltq_f64( vld1q_f64( keys + i ),
+					                                 vdupq_n_f64( key ) ) );
+				}
+				result += std::size_t( vaddvq_u64( sum ) );
+			}
+#endif
+			for( ; i < count; ++i )
+			{
+				result += std::size_t( keys[ i ] < key );
+			}
+			return result;
+		}
+	}
+
+	// Compile-time options of BTree. Derive from BTreeTraits and shadow the
+	// members to be changed.
+	struct BTreeTraits
+	{
+		// Target size of a node in bytes, which sets the number of keys
+		// per node.
+		static std::size_t constexpr NODE_BYTES = 256;
+
+		// Alignment of nodes, a cache line by default.
+		static std::size_t constexpr NODE_ALIGNMENT = 64;
+	};
+
+	// Ordered set of unique keys with many keys per node. Offers the key
+	// based interface of RedBlackTree, so that read-heavy users can switch
+	// containers with a typedef. Keys move between nodes as the tree
+	// changes, so lookups hand out iterators rather than stable nodes, and
+	// any modification invalidates them.
+	template< class _KeyT,
+	          class _LessT = std::less< _KeyT >,
+	          class _AllocT = std::allocator< _KeyT >,
+	          class _TraitsT = BTreeTraits >
+	class BTree: private detail::Compressed< _LessT >
+	{
+		using LessBase = detail::Compressed< _LessT >;
+
+		public:
+
+		using KeyT = _KeyT;
+		using LessT = _LessT;
+		using AllocT = _AllocT;
+		using TraitsT = _TraitsT;
+		using SizeT = std::size_t;
+		using ByteT = std::uint8_t;
+
+		static SizeT constexpr NODE_ALIGNMENT = TraitsT::NODE_ALIGNMENT;
+
+		// One slot beyond the maximum holds a key while a node splits.
+		static SizeT constexpr HEADER_BYTES = 2 * sizeof( void * );
+		static SizeT constexpr MAX_KEYS = std::max< SizeT >( 4,
+			( std::max( TraitsT::NODE_BYTES, HEADER_BYTES ) - HEADER_BYTES ) /
+			sizeof( KeyT ) ) - 1;
+		static SizeT constexpr MIN_KEYS = MAX_KEYS / 2;
+
+		static_assert( MAX_KEYS < std::numeric_limits< std::uint16_t >::max(),
+		               "Too many keys per node" );
+
+		private:
+
+		// Nodes below the root have at least three children, so a tree of
+		// fewer than 2^digits keys is less high than this.
+		static SizeT constexpr MAX_HEIGHT =
+			std::numeric_limits< SizeT >::digits;
+
+		struct InnerNode;
+
+		struct alignas( NODE_ALIGNMENT ) LeafNode
+		{
+			explicit LeafNode( bool leaf ):
+				m_parent{ nullptr },
+				m_index{ 0 },
+				m_count{ 0 },
+				m_leaf{ leaf }
+			{}
+
+			KeyT * getKeys()
+			{
+				return std::launder( reinterpret_cast< KeyT * >( m_keys ) );
+			}
+
+			KeyT const * getKeys() const
+			{
+				return std::launder(
+					reinterpret_cast< KeyT const * >( m_keys ) );
+			}
+
+			InnerNode *		m_parent;
+			std::uint16_t	m_index;
+			std::uint16_t	m_count;
+			bool			m_leaf;
+			alignas( KeyT ) ByteT m_keys[ sizeof( KeyT ) * ( MAX_KEYS + 1 ) ];
+		};
+
+		struct InnerNode: LeafNode
+		{
+			InnerNode():
+				LeafNode( false )
+			{}
+
+			LeafNode * m_children[ MAX_KEYS + 2 ];
+		};
+
+		public:
+
+		class const_iterator
+		{
+			public:
+
+			friend BTree;
+
+			using iterator_category = std::bidirectional_iterator_tag;
+			using value_type = KeyT;
+			using difference_type = std::ptrdiff_t;
+			using reference = KeyT const &;
+			using pointer = KeyT const *;
+
+			const_iterator():
+				m_node{ nullptr },
+				m_index{ 0 },
+				m_tree{ nullptr }
+			{}
+
+			reference operator*() const
+			{
+				return m_node->getKeys()[ m_index ];
+			}
+
+			pointer operator->() const
+			{
+				return m_node->getKeys() + m_index;
+			}
+
+			const_iterator & operator++()
+			{
+				assert( m_node != nullptr );
+
+				// Step down to the leftmost key right of this one.
+				if( !m_node->m_leaf )
+				{
+					m_node = asInner( m_node )->m_children[ m_index + 1 ];
+					m_node = getLeftmost( m_node );
+					m_index = 0;
+					return *this;
+				}
+
+				if( ++m_index < m_node->m_count )
+				{
+					return *this;
+				}
+
+				// Leaf exhausted so climb to the first unvisited separator.
+				while( m_node->m_parent != nullptr )
+				{
+					m_index = m_node->m_index;
+					m_node = m_node->m_parent;
+
+					if( m_index < m_node->m_count )
+					{
+						return *this;
+					}
+				}
+				m_node = nullptr;
+				m_index = 0;
+				return *this;
+			}
+
+			const_iterator operator++( int )
+			{
+				const_iterator result = *this;
+				++( *this );
+				return result;
+			}
+
+			const_iterator & operator--()
+			{
+				if( m_node == nullptr )
+				{
+					// Step back from end.
+					m_node = getRightmost( m_tree->m_root );
+					m_index = m_node->m_count - 1;
+					return *this;
+				}
+
+				if( !m_node->m_leaf )
+				{
+					m_node = asInner( m_node )->m_children[ m_index ];
+					m_node = getRightmost( m_node );
+					m_index = m_node->m_count - 1;
+					return *this;
+				}
+
+				if( m_index > 0 )
+				{
+					--m_index;
+					return *this;
+				}
+
+				while( true )
+				{
+					assert( m_node->m_parent != nullptr );
+
+					SizeT index = m_node->m_index;
+					m_node = m_node->m_parent;
+
+					if( index > 0 )
+					{
+						m_index = index - 1;
+						return *this;
+					}
+				}
+			}
+
+			const_iterator operator--( int )
+			{
+				const_iterator result = *this;
+				--( *this );
+				return result;
+			}
+
+			bool operator==( const_iterator const & other ) const
+			{
+				return ( m_node == other.m_node && m_index == other.m_index );
+			}
+
+			bool operator!=( const_iterator const & other ) const
+			{
+				return !( *this == other );
+			}
+
+			private:
+
+			const_iterator( LeafNode const * node, SizeT index,
+			                BTree const * tree ):
+				m_node{ node },
+				m_index{ index },
+				m_tree{ tree }
+			{}
+
+			LeafNode const *	m_node;
+			SizeT				m_index;
+			BTree const *		m_tree;
+		};
+
+		// Keys are immutable in place, so both iterators are read-only.
+		using iterator = const_iterator;
+		using reverse_iterator = std::reverse_iterator< iterator >;
+		using const_reverse_iterator = std::reverse_iterator< const_iterator >;
+
+		template< class _K >
+		using IfTransparentT = typename std::enable_if<
+			detail::IsTransparent< LessT >::value, _K >::type;
+
+		using LeafAllocT = typename std::allocator_traits< AllocT >::
+			template rebind_alloc< LeafNode >;
+		using LeafAllocTraits = std::allocator_traits< LeafAllocT >;
+		using InnerAllocT = typename std::allocator_traits< AllocT >::
+			template rebind_alloc< InnerNode >;
+		using InnerAllocTraits = std::allocator_traits< InnerAllocT >;
+
+		BTree():
+			BTree( LessT{} )
+		{}
+
+		explicit BTree( LessT const & lessFunc,
+		                AllocT const & allocator = AllocT{} ):
+			LessBase( lessFunc ),
+			m_root{ nullptr },
+			m_size{ 0 },
+			m_allocator{ allocator }
+		{}
+
+		explicit BTree( AllocT const & allocator ):
+			BTree( LessT{}, allocator )
+		{}
+
+		BTree( std::initializer_list< KeyT > keys,
+		       LessT const & lessFunc = LessT{},
+		       AllocT const & allocator = AllocT{} ):
+			BTree( lessFunc, allocator )
+		{
+			for( auto & key: keys )
+			{
+				add( key );
+			}
+		}
+
+		BTree( std::initializer_list< KeyT > keys, AllocT const & allocator ):
+			BTree( keys, LessT{}, allocator )
+		{}
+
+		template< class _FirstIter, class _LastIter >
+		BTree( _FirstIter first, _LastIter last,
+		       LessT const & lessFunc = LessT{},
+		       AllocT const & allocator = AllocT{} ):
+			BTree( lessFunc, allocator )
+		{
+			while( first != last )
+			{
+				add( *first );
+				++first;
+			}
+		}
+
+		template< class _FirstIter, class _LastIter >
+		BTree( _FirstIter first, _LastIter last, AllocT const & allocator ):
+			BTree( first, last, LessT{}, allocator )
+		{}
+
+		// Builds the tree from strictly increasing keys, appending each at
+		// the rightmost leaf without searching.
+		template< class _FirstIter, class _LastIter >
+		BTree( SortedUniqueT, _FirstIter first, _LastIter last,
+		       LessT const & lessFunc = LessT{},
+		       AllocT const & allocator = AllocT{} ):
+			BTree( lessFunc, allocator )
+		{
+			LeafNode * leaf = nullptr;
+
+			try
+			{
+				while( first != last )
+				{
+					if( leaf == nullptr )
+					{
+						leaf = createLeaf();
+						m_root = leaf;
+					}
+					else
+					{
+						assert( less( leaf->getKeys()[ leaf->m_count - 1 ],
+						              *first ) );
+					}
+					KeyT key( *first );
+					LeafNode * spares[ MAX_HEIGHT ];
+					reserveSplit( leaf, spares );
+					insertKey( leaf, leaf->m_count, std::move( key ) );
+					++first;
+					m_size += 1;
+					split( leaf, spares );
+					leaf = getRightmost( m_root );
+				}
+			}
+			catch( ... )
+			{
+				clear();
+				throw;
+			}
+		}
+
+		template< class _FirstIter, class _LastIter >
+		BTree( SortedUniqueT, _FirstIter first, _LastIter last,
+		       AllocT const & allocator ):
+			BTree( SORTED_UNIQUE, first, last, LessT{}, allocator )
+		{}
+
+		template< class _FirstIter, class _LastIter >
+		static BTree fromSorted( _FirstIter first, _LastIter last,
+		                         LessT const & lessFunc = LessT{},
+		                         AllocT const & allocator = AllocT{} )
+		{
+			return BTree( SORTED_UNIQUE, first, last, lessFunc, allocator );
+		}
+
+		BTree( BTree const & ) = delete;
+		BTree & operator=( BTree const & ) = delete;
+
+		BTree( BTree && other ) noexcept:
+			LessBase( other.LessBase::get() ),
+			m_root{ other.m_root },
+			m_size{ other.m_size },
+			m_allocator{ std::move( other.m_allocator ) }
+		{
+			other.m_root = nullptr;
+			other.m_size = 0;
+		}
+
+		BTree & operator=( BTree && other )
+		{
+			if( this == &other )
+			{
+				return *this;
+			}
+			clear();
+			LessBase::get() = other.LessBase::get();
+
+			if constexpr( LeafAllocTraits::
+			              propagate_on_container_move_assignment::value )
+			{
+				m_allocator = std::move( other.m_allocator );
+			}
+			else if( !( m_allocator == other.m_allocator ) )
+			{
+				// Nodes cannot change allocator, move keys instead.
+				moveKeys( other );
+				return *this;
+			}
+			m_root = other.m_root;
+			m_size = other.m_size;
+			other.m_root = nullptr;
+			other.m_size = 0;
+			return *this;
+		}
+
+		~BTree()
+		{
+			clear();
+		}
+
+		bool add( KeyT const & key )
+		{
+			return insert( key, key );
+		}
+
+		bool add( KeyT && key )
+		{
+			return insert( key, std::move( key ) );
+		}
+
+		// Constructs a key and adds it unless already present.
+		template< class... _Args >
+		bool emplace( _Args && ... args )
+		{
+			KeyT key( std::forward< _Args >( args )... );
+			return insert( key, std::move( key ) );
+		}
+
+		bool remove( KeyT const & key )
+		{
+			return removeKey( key );
+		}
+
+		template< class _K, class = IfTransparentT< _K > >
+		bool remove( _K const & key )
+		{
+			return removeKey( key );
+		}
+
+		const_iterator find( KeyT const & key ) const
+		{
+			return findKey( key );
+		}
+
+		template< class _K, class = IfTransparentT< _K > >
+		const_iterator find( _K const & key ) const
+		{
+			return findKey( key );
+		}
+
+		bool contains( KeyT const & key ) const
+		{
+			return findKey( key ) != end();
+		}
+
+		template< class _K, class = IfTransparentT< _K > >
+		bool contains( _K const & key ) const
+		{
+			return findKey( key ) != end();
+		}
+
+		// Returns the position of the smallest key not less than key.
+		const_iterator lowerBound( KeyT const & key ) const
+		{
+			return findBound( key, false );
+		}
+
+		template< class _K, class = IfTransparentT< _K > >
+		const_iterator lowerBound( _K const & key ) const
+		{
+			return findBound( key, false );
+		}
+
+		// Returns the position of the smallest key greater than key.
+		const_iterator upperBound( KeyT const & key ) const
+		{
+			return findBound( key, true );
+		}
+
+		template< class _K, class = IfTransparentT< _K > >
+		const_iterator upperBound( _K const & key ) const
+		{
+			return findBound( key, true );
+		}
+
+		std::pair< const_iterator, const_iterator >
+		equalRange( KeyT const & key ) const
+		{
+			return getEqualRange( key );
+		}
+
+		template< class _K, class = IfTransparentT< _K > >
+		std::pair< const_iterator, const_iterator >
+		equalRange( _K const & key ) const
+		{
+			return getEqualRange( key );
+		}
+
+		// Looks up every key of a forward range, writing an iterator to
+		// the match or end() for each to results. Descents run interleaved
+		// so that their cache misses overlap.
+		template< class _FirstIter, class _LastIter, class _OutIter >
+		_OutIter findMany( _FirstIter first, _LastIter last,
+		                   _OutIter results ) const
+		{
+			findEach( first, last, [ & ]( LeafNode const * node, SizeT index )
+			{
+				*results = const_iterator( node, index, this );
+				++results;
+			} );
+			return results;
+		}
+
+		template< class _FirstIter, class _LastIter, class _OutIter >
+		_OutIter containsMany( _FirstIter first, _LastIter last,
+		                       _OutIter results ) const
+		{
+			findEach( first, last, [ & ]( LeafNode const * node, SizeT )
+			{
+				*results = ( node != nullptr );
+				++results;
+			} );
+			return results;
+		}
+
+		SizeT getSize() const
+		{
+			return m_size;
+		}
+
+		const_iterator begin() const
+		{
+			if( m_root == nullptr )
+			{
+				return end();
+			}
+			return const_iterator( getLeftmost( m_root ), 0, this );
+		}
+
+		const_iterator cbegin() const
+		{
+			return begin();
+		}
+
+		const_iterator end() const
+		{
+			return const_iterator( nullptr, 0, this );
+		}
+
+		const_iterator cend() const
+		{
+			return end();
+		}
+
+		const_reverse_iterator rbegin() const
+		{
+			return const_reverse_iterator( end() );
+		}
+
+		const_reverse_iterator rend() const
+		{
+			return const_reverse_iterator( begin() );
+		}
+
+		AllocT getAllocator() const
+		{
+			return AllocT( m_allocator );
+		}
+
+		LessT getLess() const
+		{
+			return LessBase::get();
+		}
+
+		void clear()
+		{
+			if( m_root != nullptr )
+			{
+				destroySubtree( m_root );
+			}
+			m_root = nullptr;
+			m_size = 0;
+		}
+
+		bool validate() const
+		{
+			if( m_root == nullptr )
+			{
+				return ( m_size == 0 );
+			}
+
+			if( m_root->m_parent != nullptr || m_root->m_count == 0 )
+			{
+				return false;
+			}
+			SizeT count = 0;
+			SizeT leafDepth = 0;
+
+			if( !validateNode( m_root, nullptr, nullptr, 0, leafDepth,
+			                   count ) )
+			{
+				return false;
+			}
+			return ( count == m_size );
+		}
+
+		template< class _K1, class _K2 >
+		bool less( _K1 const & k1, _K2 const & k2 ) const
+		{
+			return LessBase::get()( k1, k2 );
+		}
+
+		private:
+
+		static InnerNode * asInner( LeafNode * node )
+		{
+			assert( !node->m_leaf );
+
+			return static_cast< InnerNode * >( node );
+		}
+
+		static InnerNode const * asInner( LeafNode const * node )
+		{
+			assert( !node->m_leaf );
+
+			return static_cast< InnerNode const * >( node );
+		}
+
+		template< class _NodeT >
+		static _NodeT * getLeftmost( _NodeT * node )
+		{
+			while( !node->m_leaf )
+			{
+				node = asInner( node )->m_children[ 0 ];
+			}
+			return node;
+		}
+
+		template< class _NodeT >
+		static _NodeT * getRightmost( _NodeT * node )
+		{
+			while( !node->m_leaf )
+			{
+				node = asInner( node )->m_children[ node->m_count ];
+			}
+			return node;
+		}
+
+		// Index of the first key in node not less than key.
+		template< class _K >
+		SizeT lowerBound( LeafNode const * node, _K const & key ) const
+		{
+			KeyT const * keys = node->getKeys();
+
+			if constexpr( detail::IsSimdSearchable< KeyT, LessT, _K >::value )
+			{
+				return detail::countLess( keys, node->m_count, key );
+			}
+			SizeT index = 0;
+
+			// Keys of a node share a few cache lines, so scan linearly.
+			while( index < node->m_count && less( keys[ index ], key ) )
+			{
+				++index;
+			}
+			return index;
+		}
+
+		// Descends towards key. Returns true with the matching position,
+		// otherwise the leaf position where key belongs.
+		template< class _K >
+		bool findPosition( _K const & key, LeafNode * & node,
+		                   SizeT & index ) const
+		{
+			node = m_root;
+
+			while( true )
+			{
+				index = lowerBound( node, key );
+
+				if( index < node->m_count &&
+				    !less( key, node->getKeys()[ index ] ) )
+				{
+					return true;
+				}
+
+				if( node->m_leaf )
+				{
+					return false;
+				}
+				node = asInner( node )->m_children[ index ];
+			}
+		}
+
+		// Number of descents findEach() keeps in flight.
+		static SizeT constexpr BATCH_SIZE = 16;
+		static SizeT constexpr CACHE_LINE = 64;
+
+		static void prefetchNode( LeafNode const * node )
+		{
+			auto address = reinterpret_cast< char const * >( node );
+
+			for( SizeT offset = 0; offset < sizeof( LeafNode );
+			     offset += CACHE_LINE )
+			{
+				detail::prefetch( address + offset );
+			}
+		}
+
+		// Steps a group of descents one level per round, prefetching each
+		// next node while the other searches of the group proceed.
+		template< class _FirstIter, class _LastIter, class _F >
+		void findEach( _FirstIter first, _LastIter last, _F report ) const
+		{
+			_FirstIter keys[ BATCH_SIZE ];
+			LeafNode const * nodes[ BATCH_SIZE ];
+			SizeT indices[ BATCH_SIZE ];
+			SizeT pending[ BATCH_SIZE ];
+
+			while( first != last )
+			{
+				SizeT count = 0;
+
+				for( ; count < BATCH_SIZE && first != last; ++count, ++first )
+				{
+					keys[ count ] = first;
+					nodes[ count ] = m_root;
+					indices[ count ] = 0;
+					pending[ count ] = count;
+				}
+				SizeT active = ( m_root != nullptr ? count : 0 );
+
+				while( active > 0 )
+				{
+					SizeT kept = 0;
+
+					for( SizeT i = 0; i < active; ++i )
+					{
+						SizeT lane = pending[ i ];
+						LeafNode const * node = nodes[ lane ];
+						auto const & key = *keys[ lane ];
+						SizeT index = lowerBound( node, key );
+
+						if( index < node->m_count &&
+						    !less( key, node->getKeys()[ index ] ) )
+						{
+							indices[ lane ] = index;
+							continue;
+						}
+
+						if( node->m_leaf )
+						{
+							nodes[ lane ] = nullptr;
+							continue;
+						}
+						node = asInner( node )->m_children[ index ];
+						nodes[ lane ] = node;
+						prefetchNode( node );
+						pending[ kept++ ] = lane;
+					}
+					active = kept;
+				}
+
+				for( SizeT i = 0; i < count; ++i )
+				{
+					report( nodes[ i ], indices[ i ] );
+				}
+			}
+		}
+
+		template< class _K >
+		const_iterator findBound( _K const & key, bool upper ) const
+		{
+			const_iterator bound = end();
+			LeafNode const * node = m_root;
+
+			while( node != nullptr )
+			{
+				KeyT const * keys = node->getKeys();
+				SizeT index = lowerBound( node, key );
+
+				if( index < node->m_count && !less( key, keys[ index ] ) )
+				{
+					if( !upper )
+					{
+						return const_iterator( node, index, this );
+					}
+					++index;
+				}
+
+				// The key at index bounds every key beneath its left child.
+				if( index < node->m_count )
+				{
+					bound = const_iterator( node, index, this );
+				}
+
+				if( node->m_leaf )
+				{
+					break;
+				}
+				node = asInner( node )->m_children[ index ];
+			}
+			return bound;
+		}
+
+		template< class _K >
+		std::pair< const_iterator, const_iterator >
+		getEqualRange( _K const & key ) const
+		{
+			const_iterator first = findBound( key, false );
+			const_iterator last = first;
+
+			if( first != end() && !less( key, *first ) )
+			{
+				++last;
+			}
+			return { first, last };
+		}
+
+		template< class _K >
+		const_iterator findKey( _K const & key ) const
+		{
+			if( m_root == nullptr )
+			{
+				return end();
+			}
+			LeafNode * node = nullptr;
+			SizeT index = 0;
+
+			if( findPosition( key, node, index ) )
+			{
+				return const_iterator( node, index, this );
+			}
+			return end();
+		}
+
+		template< class _K >
+		bool insert( KeyT const & probe, _K && key )
+		{
+			if( m_root == nullptr )
+			{
+				LeafNode * leaf = createLeaf();
+				m_root = leaf;
+
+				try
+				{
+					insertKey( leaf, 0, KeyT( std::forward< _K >( key ) ) );
+				}
+				catch( ... )
+				{
+					clear();
+					throw;
+				}
+				m_size = 1;
+				return true;
+			}
+			LeafNode * node = nullptr;
+			SizeT index = 0;
+
+			if( findPosition( probe, node, index ) )
+			{
+				return false;
+			}
+			// Everything that may throw happens before the tree changes.
+			KeyT added( std::forward< _K >( key ) );
+			LeafNode * spares[ MAX_HEIGHT ];
+			reserveSplit( node, spares );
+			insertKey( node, index, std::move( added ) );
+			m_size += 1;
+			split( node, spares );
+			return true;
+		}
+
+		template< class _K >
+		bool removeKey( _K const & key )
+		{
+			if( m_root == nullptr )
+			{
+				return false;
+			}
+			LeafNode * node = nullptr;
+			SizeT index = 0;
+
+			if( !findPosition( key, node, index ) )
+			{
+				return false;
+			}
+
+			// Replace a separator with its predecessor from a leaf.
+			if( !node->m_leaf )
+			{
+				LeafNode * leaf = asInner( node )->m_children[ index ];
+				leaf = getRightmost( leaf );
+				node->getKeys()[ index ] =
+					std::move( leaf->getKeys()[ leaf->m_count - 1 ] );
+				node = leaf;
+				index = leaf->m_count - 1;
+			}
+			eraseKey( node, index );
+			m_size -= 1;
+			rebalance( node );
+			return true;
+		}
+
+		// Moves key into node at index, shifting later keys right.
+		static void insertKey( LeafNode * node, SizeT index, KeyT && key )
+		{
+			assert( node->m_count <= MAX_KEYS && index <= node->m_count );
+
+			KeyT * keys = node->getKeys();
+			SizeT count = node->m_count;
+
+			if( index == count )
+			{
+				::new( static_cast< void * >( keys + count ) )
+					KeyT( std::move( key ) );
+			}
+			else
+			{
+				::new( static_cast< void * >( keys + count ) )
+					KeyT( std::move( keys[ count - 1 ] ) );
+				std::move_backward( keys + index, keys + count - 1,
+				                    keys + count );
+				keys[ index ] = std::move( key );
+			}
+			node->m_count += 1;
+		}
+
+		// Removes the key at index, shifting later keys left.
+		static void eraseKey( LeafNode * node, SizeT index )
+		{
+			assert( index < node->m_count );
+
+			KeyT * keys = node->getKeys();
+			SizeT count = node->m_count;
+
+			std::move( keys + index + 1, keys + count, keys + index );
+			keys[ count - 1 ].~KeyT();
+			node->m_count -= 1;
+		}
+
+		// Move constructs count keys of source into uninitialised slots of
+		// target, destroying the originals.
+		static void relocateKeys( LeafNode * target, SizeT targetIndex,
+		                          LeafNode * source, SizeT sourceIndex,
+		                          SizeT count )
+		{
+			KeyT * to = target->getKeys() + targetIndex;
+			KeyT * from = source->getKeys() + sourceIndex;
+
+			for( SizeT i = 0; i < count; ++i )
+			{
+				::new( static_cast< void * >( to + i ) )
+					KeyT( std::move( from[ i ] ) );
+				from[ i ].~KeyT();
+			}
+		}
+
+		static void setChild( InnerNode * parent, SizeT index,
+		                      LeafNode * child )
+		{
+			parent->m_children[ index ] = child;
+			child->m_parent = parent;
+			child->m_index = std::uint16_t( index );
+		}
+
+		// Allocates into spares the nodes that splitting node takes once it
+		// gains a key: a sibling for it and each full ancestor in a row,
+		// and a new root if they reach the root. A failed allocation frees
+		// the others and leaves the tree as it was.
+		void reserveSplit( LeafNode * node, LeafNode ** spares )
+		{
+			SizeT count = 0;
+
+			try
+			{
+				for( ; node != nullptr && node->m_count == MAX_KEYS;
+				     node = node->m_parent )
+				{
+					spares[ count ] = ( node->m_leaf ? createLeaf() :
+						static_cast< LeafNode * >( createInner() ) );
+					count += 1;
+				}
+
+				if( node == nullptr )
+				{
+					spares[ count ] = createInner();
+				}
+			}
+			catch( ... )
+			{
+				for( SizeT i = 0; i < count; ++i )
+				{
+					destroyNode( spares[ i ] );
+				}
+				throw;
+			}
+		}
+
+		// Splits node while it overflows, pushing medians upwards, taking
+		// new nodes in turn from the spares reserveSplit() allocated.
+		void split( LeafNode * node, LeafNode ** spares )
+		{
+			while( node->m_count > MAX_KEYS )
+			{
+				SizeT half = ( MAX_KEYS + 1 ) / 2;
+				SizeT moved = node->m_count - half - 1;
+				LeafNode * right = *spares++;
+				assert( right->m_leaf == node->m_leaf );
+
+				relocateKeys( right, 0, node, half + 1, moved );
+				right->m_count = std::uint16_t( moved );
+
+				if( !node->m_leaf )
+				{
+					InnerNode * from = asInner( node );
+					InnerNode * to = asInner( right );
+
+					for( SizeT i = 0; i <= moved; ++i )
+					{
+						setChild( to, i, from->m_children[ half + 1 + i ] );
+					}
+				}
+				KeyT median( std::move( node->getKeys()[ half ] ) );
+				node->getKeys()[ half ].~KeyT();
+				node->m_count = std::uint16_t( half );
+
+				InnerNode * parent = node->m_parent;
+
+				// Grow a new root above a split root.
+				if( parent == nullptr )
+				{
+					parent = asInner( *spares );
+					insertKey( parent, 0, std::move( median ) );
+					setChild( parent, 0, node );
+					setChild( parent, 1, right );
+					m_root = parent;
+					return;
+				}
+				SizeT index = node->m_index;
+				insertKey( parent, index, std::move( median ) );
+
+				for( SizeT i = parent->m_count; i > index + 1; --i )
+				{
+					setChild( parent, i, parent->m_children[ i - 1 ] );
+				}
+				setChild( parent, index + 1, right );
+				node = parent;
+			}
+		}
+
+		// Restores the minimum fill of node after a removal by borrowing
+		// from or merging with a sibling, cascading towards the root.
+		void rebalance( LeafNode * node )
+		{
+			while( node != m_root )
+			{
+				if( node->m_count >= MIN_KEYS )
+				{
+					return;
+				}
+				InnerNode * parent = node->m_parent;
+				SizeT index = node->m_index;
+
+				if( index > 0 &&
+				    parent->m_children[ index - 1 ]->m_count > MIN_KEYS )
+				{
+					borrowLeft( parent, index );
+					return;
+				}
+
+				if( index < parent->m_count &&
+				    parent->m_children[ index + 1 ]->m_count > MIN_KEYS )
+				{
+					borrowRight( parent, index );
+					return;
+				}
+				merge( parent, index > 0 ? index - 1 : index );
+				node = parent;
+			}
+
+			// Shrink the tree once the root runs empty.
+			if( m_root->m_count == 0 )
+			{
+				LeafNode * root = m_root;
+
+				if( root->m_leaf )
+				{
+					m_root = nullptr;
+				}
+				else
+				{
+					m_root = asInner( root )->m_children[ 0 ];
+					m_root->m_parent = nullptr;
+					m_root->m_index = 0;
+				}
+				destroyNode( root );
+			}
+		}
+
+		// Rotates the last key of the left sibling through the parent.
+		void borrowLeft( InnerNode * parent, SizeT index )
+		{
+			LeafNode * node = parent->m_children[ index ];
+			LeafNode * left = parent->m_children[ index - 1 ];
+			KeyT & separator = parent->getKeys()[ index - 1 ];
+
+			insertKey( node, 0, std::move( separator ) );
+			separator = std::move( left->getKeys()[ left->m_count - 1 ] );
+			eraseKey( left, left->m_count - 1 );
+
+			if( !node->m_leaf )
+			{
+				InnerNode * inner = asInner( node );
+
+				for( SizeT i = inner->m_count; i > 0; --i )
+				{
+					setChild( inner, i, inner->m_children[ i - 1 ] );
+				}
+				setChild( inner, 0,
+				          asInner( left )->m_children[ left->m_count + 1 ] );
+			}
+		}
+
+		// Rotates the first key of the right sibling through the parent.
+		void borrowRight( InnerNode * parent, SizeT index )
+		{
+			LeafNode * node = parent->m_children[ index ];
+			LeafNode * right = parent->m_children[ index + 1 ];
+			KeyT & separator = parent->getKeys()[ index ];
+
+			insertKey( node, node->m_count, std::move( separator ) );
+			separator = std::move( right->getKeys()[ 0 ] );
+			eraseKey( right, 0 );
+
+			if( !node->m_leaf )
+			{
+				InnerNode * inner = asInner( node );
+				InnerNode * from = asInner( right );
+
+				setChild( inner, inner->m_count, from->m_children[ 0 ] );
+
+				for( SizeT i = 0; i <= from->m_count; ++i )
+				{
+					setChild( from, i, from->m_children[ i + 1 ] );
+				}
+			}
+		}
+
+		// Joins the children either side of separator index into the left
+		// one and frees the right.
+		void merge( InnerNode * parent, SizeT index )
+		{
+			LeafNode * left = parent->m_children[ index ];
+			LeafNode * right = parent->m_children[ index + 1 ];
+			SizeT count = left->m_count;
+
+			assert( count + 1 + right->m_count <= MAX_KEYS );
+
+			insertKey( left, count, std::move( parent->getKeys()[ index ] ) );
+			relocateKeys( left, count + 1, right, 0, right->m_count );
+
+			if( !left->m_leaf )
+			{
+				InnerNode * to = asInner( left );
+				InnerNode * from = asInner( right );
+
+				for( SizeT i = 0; i <= right->m_count; ++i )
+				{
+					setChild( to, count + 1 + i, from->m_children[ i ] );
+				}
+			}
+			left->m_count = std::uint16_t( count + 1 + right->m_count );
+			right->m_count = 0;
+			destroyNode( right );
+
+			eraseKey( parent, index );
+
+			for( SizeT i = index + 1; i <= parent->m_count; ++i )
+			{
+				setChild( parent, i, parent->m_children[ i + 1 ] );
+			}
+		}
+
+		LeafNode * createLeaf()
+		{
+			LeafNode * node = LeafAllocTraits::allocate( m_allocator, 1 );
+			::new( static_cast< void * >( node ) ) LeafNode( true );
+			return node;
+		}
+
+		InnerNode * createInner()
+		{
+			InnerAllocT allocator( m_allocator );
+			InnerNode * node = InnerAllocTraits::allocate( allocator, 1 );
+			::new( static_cast< void * >( node ) ) InnerNode();
+			return node;
+		}
+
+		// Destroys the keys of node and frees it, leaving children alone.
+		void destroyNode( LeafNode * node )
+		{
+			KeyT * keys = node->getKeys();
+
+			for( SizeT i = 0; i < node->m_count; ++i )
+			{
+				keys[ i ].~KeyT();
+			}
+
+			if( node->m_leaf )
+			{
+				node->~LeafNode();
+				LeafAllocTraits::deallocate( m_allocator, node, 1 );
+			}
+			else
+			{
+				InnerAllocT allocator( m_allocator );
+				InnerNode * inner = asInner( node );
+				inner->~InnerNode();
+				InnerAllocTraits::deallocate( allocator, inner, 1 );
+			}
+		}
+
+		void destroySubtree( LeafNode * node )
+		{
+			if( !node->m_leaf )
+			{
+				InnerNode * inner = asInner( node );
+
+				for( SizeT i = 0; i <= inner->m_count; ++i )
+				{
+					destroySubtree( inner->m_children[ i ] );
+				}
+			}
+			destroyNode( node );
+		}
+
+		// Rebuilds other's keys in nodes of this tree's allocator.
+		void moveKeys( BTree & other )
+		{
+			assert( m_root == nullptr );
+
+			try
+			{
+				for( auto i = other.begin(); i != other.end(); ++i )
+				{
+					// Other is cleared below, so its keys may be taken.
+					add( std::move( const_cast< KeyT & >( *i ) ) );
+				}
+			}
+			catch( ... )
+			{
+				other.clear();
+				throw;
+			}
+			other.clear();
+		}
+
+		bool validateNode( LeafNode const * node, KeyT const * low,
+		                   KeyT const * high, SizeT depth, SizeT & leafDepth,
+		                   SizeT & count ) const
+		{
+			SizeT keyCount = node->m_count;
+			KeyT const * keys = node->getKeys();
+
+			if( keyCount > MAX_KEYS ||
+			    ( node != m_root && keyCount < MIN_KEYS ) )
+			{
+				return false;
+			}
+
+			// Keys increase strictly and stay within the parent's range.
+			for( SizeT i = 0; i < keyCount; ++i )
+			{
+				if( i > 0 && !less( keys[ i - 1 ], keys[ i ] ) )
+				{
+					return false;
+				}
+			}
+
+			if( keyCount > 0 &&
+			    ( ( low != nullptr && !less( *low, keys[ 0 ] ) ) ||
+			      ( high != nullptr && !less( keys[ keyCount - 1 ], *high ) ) ) )
+			{
+				return false;
+			}
+			count += keyCount;
+
+			// Every leaf sits at the same depth.
+			if( node->m_leaf )
+			{
+				if( leafDepth == 0 )
+				{
+					leafDepth = depth + 1;
+				}
+				return ( leafDepth == depth + 1 );
+			}
+			InnerNode const * inner = asInner( node );
+
+			for( SizeT i = 0; i <= keyCount; ++i )
+			{
+				LeafNode const * child = inner->m_children[ i ];
+
+				if( child == nullptr || child->m_parent != inner ||
+				    child->m_index != i )
+				{
+					return false;
+				}
+
+				if( !validateNode( child, i > 0 ? keys + i - 1 : low,
+				                   i < keyCount ? keys + i : high, depth + 1,
+				                   leafDepth, count ) )
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+
+		LeafNode *	m_root;
+		SizeT		m_size;
+		LeafAllocT	m_allocator;
+	};
+}
+
+#endif
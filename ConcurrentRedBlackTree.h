@@ -0,0 +1,528 @@
+#ifndef UTIL_CONCURRENTREDBLACKTREE_H
+#define UTIL_CONCURRENTREDBLACKTREE_H
+
+#include <functional>
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "PersistentRedBlackTree.h"
+
+namespace util
+{
+	namespace detail
+	{
+		// Epoch based reclamation for one writer and many readers. Readers
+		// pin the current epoch in a slot while they hold nodes, memory
+		// retired by the writer in an epoch older than every pinned one
+		// can no longer be reached and is freed. Once all _SlotCount slots
+		// are pinned, readers entering wait for one to leave.
+		template< std::size_t _SlotCount >
+		class EpochDomain
+		{
+			public:
+
+			using SizeT = std::size_t;
+			using EpochT = std::uint64_t;
+
+			static SizeT constexpr SLOT_COUNT	= _SlotCount;
+			static EpochT constexpr IDLE		= 0;
+
+			static_assert( SLOT_COUNT > 0, "Readers need a slot" );
+
+			EpochDomain():
+				m_epoch{ IDLE + 1 }
+			{
+				for( auto & slot: m_slots )
+				{
+					slot.m_epoch.store( IDLE, std::memory_order_relaxed );
+				}
+			}
+
+			EpochDomain( EpochDomain const & ) = delete;
+			EpochDomain & operator=( EpochDomain const & ) = delete;
+
+			// Pins the current epoch and returns the slot to leave. Each
+			// thread starts probing at a slot of its own, so that readers
+			// on different cores do not share cache lines.
+			SizeT enter()
+			{
+				SizeT slot = std::hash< std::thread::id >{}(
+					std::this_thread::get_id() ) % SLOT_COUNT;
+
+				while( true )
+				{
+					for( SizeT i = 0; i < SLOT_COUNT; ++i )
+					{
+						std::atomic< EpochT > & epoch = m_slots[ slot ].m_epoch;
+						EpochT idle = IDLE;
+
+						if( epoch.load( std::memory_order_relaxed ) == IDLE &&
+						    epoch.compare_exchange_strong( idle, m_epoch.load() ) )
+						{
+							return slot;
+						}
+						slot = ( slot + 1 ) % SLOT_COUNT;
+					}
+
+					// Every slot is pinned, wait for a reader to leave.
+					std::this_thread::yield();
+				}
+			}
+
+			void leave( SizeT slot )
+			{
+				m_slots[ slot ].m_epoch.store( IDLE, std::memory_order_release );
+			}
+
+			EpochT getEpoch() const
+			{
+				return m_epoch.load();
+			}
+
+			// Starts a new epoch and returns the oldest one still pinned.
+			// Memory retired before it is safe to free.
+			EpochT advance()
+			{
+				EpochT oldest = m_epoch.fetch_add( 1 ) + 1;
+
+				for( auto & slot: m_slots )
+				{
+					EpochT epoch = slot.m_epoch.load();
+
+					if( epoch != IDLE && epoch < oldest )
+					{
+						oldest = epoch;
+					}
+				}
+				return oldest;
+			}
+
+			bool isIdle() const
+			{
+				for( auto & slot: m_slots )
+				{
+					if( slot.m_epoch.load() != IDLE )
+					{
+						return false;
+					}
+				}
+				return true;
+			}
+
+			private:
+
+			struct alignas( 64 ) Slot
+			{
+				std::atomic< EpochT > m_epoch;
+			};
+
+			alignas( 64 ) std::atomic< EpochT > m_epoch;
+			Slot m_slots[ SLOT_COUNT ];
+		};
+	}
+
+	// Red-black tree read by any number of threads without locks while
+	// writers, serialized among themselves, modify it. Writers never touch
+	// a node readers can reach: they copy the path they change and publish
+	// the new root with one store. Replaced nodes are freed by the writers
+	// once no reader can still hold them, so the allocator need not be
+	// thread-safe.
+	//
+	// At most _ReaderSlots readers exist at once, counting the ones
+	// contains() makes. Beyond that read() waits for a reader to be
+	// destroyed, so a thread must never hold that many itself.
+	template< class _KeyT,
+	          class _LessT = std::less< _KeyT >,
+	          class _AllocT = std::allocator< _KeyT >,
+	          std::size_t _ReaderSlots = 128 >
+	class ConcurrentRedBlackTree: private detail::PathCopyingTree<
+		_KeyT, _LessT, _AllocT, detail::NoCount >
+	{
+		using BaseT = detail::PathCopyingTree<
+			_KeyT, _LessT, _AllocT, detail::NoCount >;
+		using Node = typename BaseT::Node;
+
+		template< class _K >
+		using IfTransparentT = typename std::enable_if<
+			detail::IsTransparent< _LessT >::value, _K >::type;
+
+		public:
+
+		using KeyT = _KeyT;
+		using LessT = _LessT;
+		using AllocT = _AllocT;
+		using SizeT = std::size_t;
+		using DomainT = detail::EpochDomain< _ReaderSlots >;
+		using EpochT = typename DomainT::EpochT;
+
+		// Consistent view of the tree as of its creation. Lookups through
+		// it take no locks, and the keys it hands out stay valid until it
+		// is destroyed. Writers meanwhile proceed, but nodes they replace
+		// are kept alive for as long as any reader exists.
+		//
+		// A reader remembers the path to the key getNext() or getPrevious()
+		// returned last, so stepping on from that key takes amortised
+		// constant time. It is thus used by one thread at a time.
+		class Reader
+		{
+			public:
+
+			friend ConcurrentRedBlackTree;
+
+			Reader( Reader && other ) noexcept:
+				m_tree{ other.m_tree },
+				m_slot{ other.m_slot },
+				m_root{ other.m_root },
+				m_depth{ other.m_depth }
+			{
+				std::copy( other.m_path, other.m_path + m_depth, m_path );
+				other.m_tree = nullptr;
+			}
+
+			Reader( Reader const & ) = delete;
+			Reader & operator=( Reader const & ) = delete;
+			Reader & operator=( Reader && ) = delete;
+
+			~Reader()
+			{
+				if( m_tree != nullptr )
+				{
+					m_tree->m_domain.leave( m_slot );
+				}
+			}
+
+			KeyT const * find( KeyT const & key ) const
+			{
+				return BaseT::getKey( m_tree->findNode( m_root, key ) );
+			}
+
+			template< class _K, class = IfTransparentT< _K > >
+			KeyT const * find( _K const & key ) const
+			{
+				return BaseT::getKey( m_tree->findNode( m_root, key ) );
+			}
+
+			bool contains( KeyT const & key ) const
+			{
+				return ( find( key ) != nullptr );
+			}
+
+			template< class _K, class = IfTransparentT< _K > >
+			bool contains( _K const & key ) const
+			{
+				return ( find( key ) != nullptr );
+			}
+
+			// Smallest key not less than key.
+			KeyT const * lowerBound( KeyT const & key ) const
+			{
+				return BaseT::getKey( m_tree->findBound( m_root, key, false ) );
+			}
+
+			// Smallest key greater than key.
+			KeyT const * upperBound( KeyT const & key ) const
+			{
+				return BaseT::getKey( m_tree->findBound( m_root, key, true ) );
+			}
+
+			KeyT const * getNext( KeyT const & key ) const
+			{
+				return BaseT::getKey( step( key, 1 ) );
+			}
+
+			// Greatest key less than key.
+			KeyT const * getPrevious( KeyT const & key ) const
+			{
+				return BaseT::getKey( step( key, 0 ) );
+			}
+
+			KeyT const * getFirst() const
+			{
+				return BaseT::getKey( BaseT::getEnd( m_root, 0 ) );
+			}
+
+			KeyT const * getLast() const
+			{
+				return BaseT::getKey( BaseT::getEnd( m_root, 1 ) );
+			}
+
+			// Calls func with every key in ascending order.
+			template< class _Func >
+			void forEach( _Func && func ) const
+			{
+				BaseT::visit( m_root, func );
+			}
+
+			private:
+
+			// A left-leaning red-black tree of n nodes is at most
+			// 2 log2( n + 1 ) high, and n is bounded by the address space.
+			static SizeT constexpr MAX_HEIGHT =
+				2 * std::numeric_limits< SizeT >::digits;
+
+			explicit Reader( ConcurrentRedBlackTree const * tree ):
+				m_tree{ tree },
+				m_slot{ tree->m_domain.enter() },
+				m_root{ tree->m_root.load() },
+				m_depth{ 0 }
+			{}
+
+			// Node following key on side, the right for the next one. From
+			// the key stepped to last, the remembered path is walked on;
+			// from any other key the tree is descended, remembering the
+			// path to the node found.
+			Node const * step( KeyT const & key, SizeT side ) const
+			{
+				if( m_depth > 0 && &m_path[ m_depth - 1 ]->m_key == &key )
+				{
+					Node const * node = m_path[ m_depth - 1 ]->m_children[ side ];
+
+					if( node != nullptr )
+					{
+						for( ; node != nullptr;
+						     node = node->m_children[ 1 - side ] )
+						{
+							assert( m_depth < MAX_HEIGHT );
+							m_path[ m_depth++ ] = node;
+						}
+						return m_path[ m_depth - 1 ];
+					}
+
+					// Climbs past the ancestors key follows on side.
+					while( m_depth > 1 && m_path[ m_depth - 2 ]->
+					       m_children[ side ] == m_path[ m_depth - 1 ] )
+					{
+						--m_depth;
+					}
+					--m_depth;
+				}
+				else
+				{
+					SizeT depth = 0;
+					m_depth = 0;
+
+					for( Node const * node = m_root; node != nullptr; )
+					{
+						assert( depth < MAX_HEIGHT );
+						m_path[ depth++ ] = node;
+
+						if( side == 1 ? m_tree->less( key, node->m_key ) :
+						                m_tree->less( node->m_key, key ) )
+						{
+							m_depth = depth;
+							node = node->m_children[ 1 - side ];
+						}
+						else
+						{
+							node = node->m_children[ side ];
+						}
+					}
+				}
+				return ( m_depth > 0 ? m_path[ m_depth - 1 ] : nullptr );
+			}
+
+			ConcurrentRedBlackTree const *	m_tree;
+			SizeT							m_slot;
+			Node const *					m_root;
+			mutable SizeT					m_depth;
+			mutable Node const *			m_path[ MAX_HEIGHT ];
+		};
+
+		// Nodes are freed in batches of about this many, which keeps the
+		// writers' scans of the reader slots rare.
+		static SizeT constexpr RECLAIM_BATCH = 256;
+
+		ConcurrentRedBlackTree():
+			ConcurrentRedBlackTree( LessT{} )
+		{}
+
+		explicit ConcurrentRedBlackTree( LessT const & lessFunc,
+		                                 AllocT const & allocator = AllocT{} ):
+			BaseT( lessFunc, allocator ),
+			m_root{ nullptr },
+			m_size{ 0 }
+		{}
+
+		explicit ConcurrentRedBlackTree( AllocT const & allocator ):
+			ConcurrentRedBlackTree( LessT{}, allocator )
+		{}
+
+		ConcurrentRedBlackTree( ConcurrentRedBlackTree const & ) = delete;
+		ConcurrentRedBlackTree & operator=(
+			ConcurrentRedBlackTree const & ) = delete;
+
+		// No reader may outlive the tree.
+		~ConcurrentRedBlackTree()
+		{
+			assert( m_domain.isIdle() );
+
+			BaseT::destroyTree( m_root.load( std::memory_order_relaxed ) );
+
+			for( auto & retired: m_retired )
+			{
+				BaseT::destroyNode( retired.first );
+			}
+		}
+
+		Reader read() const
+		{
+			return Reader( this );
+		}
+
+		bool add( KeyT const & key )
+		{
+			return addKey( key );
+		}
+
+		bool add( KeyT && key )
+		{
+			return addKey( std::move( key ) );
+		}
+
+		bool remove( KeyT const & key )
+		{
+			return removeKey( key );
+		}
+
+		template< class _K, class = IfTransparentT< _K > >
+		bool remove( _K const & key )
+		{
+			return removeKey( key );
+		}
+
+		void clear()
+		{
+			std::lock_guard< std::mutex > lock( m_writer );
+
+			Node * root = m_root.load( std::memory_order_relaxed );
+			publish( BaseT::update( [ & ]() -> Node *
+			{
+				BaseT::unlinkTree( root );
+				reserveRetired();
+				return nullptr;
+			} ) );
+			m_size.store( 0, std::memory_order_relaxed );
+		}
+
+		bool contains( KeyT const & key ) const
+		{
+			return read().contains( key );
+		}
+
+		template< class _K, class = IfTransparentT< _K > >
+		bool contains( _K const & key ) const
+		{
+			return read().contains( key );
+		}
+
+		// Size as of the latest write.
+		SizeT getSize() const
+		{
+			return m_size.load( std::memory_order_relaxed );
+		}
+
+		// Checks the left-leaning red-black rules. Call it with no writer
+		// running.
+		bool validate() const
+		{
+			return BaseT::isValid( m_root.load(), getSize() );
+		}
+
+		using BaseT::getAllocator;
+		using BaseT::getLess;
+		using BaseT::less;
+
+		private:
+
+		template< class _K >
+		bool addKey( _K && key )
+		{
+			std::lock_guard< std::mutex > lock( m_writer );
+
+			Node * root = m_root.load( std::memory_order_relaxed );
+
+			if( BaseT::findNode( root, key ) != nullptr )
+			{
+				return false;
+			}
+			publish( BaseT::insertKey( root, std::forward< _K >( key ),
+				[ this ]{ reserveRetired(); } ) );
+			m_size.store( getSize() + 1, std::memory_order_relaxed );
+			return true;
+		}
+
+		template< class _K >
+		bool removeKey( _K const & key )
+		{
+			std::lock_guard< std::mutex > lock( m_writer );
+
+			Node * root = m_root.load( std::memory_order_relaxed );
+
+			if( BaseT::findNode( root, key ) == nullptr )
+			{
+				return false;
+			}
+			publish( BaseT::eraseKey( root, key,
+				[ this ]{ reserveRetired(); } ) );
+			m_size.store( getSize() - 1, std::memory_order_relaxed );
+			return true;
+		}
+
+		// Makes room to retire the unlinked nodes once the new version is
+		// published, which then cannot fail.
+		void reserveRetired()
+		{
+			m_retired.reserve( m_retired.size() + BaseT::m_unlinked.size() );
+		}
+
+		// Makes root visible to readers and retires the nodes it no longer
+		// shares with the previous version.
+		void publish( Node * root )
+		{
+			m_root.store( root );
+			EpochT epoch = m_domain.getEpoch();
+
+			for( Node * node: BaseT::m_unlinked )
+			{
+				m_retired.emplace_back( node, epoch );
+			}
+			BaseT::m_unlinked.clear();
+
+			if( m_retired.size() >= RECLAIM_BATCH )
+			{
+				reclaim();
+			}
+		}
+
+		// Frees the retired nodes no reader can reach, which are retired
+		// in epoch order.
+		void reclaim()
+		{
+			EpochT oldest = m_domain.advance();
+			auto end = m_retired.begin();
+
+			for( ; end != m_retired.end() && end->second < oldest; ++end )
+			{
+				BaseT::destroyNode( end->first );
+			}
+			m_retired.erase( m_retired.begin(), end );
+		}
+
+		std::atomic< Node * >	m_root;
+		std::atomic< SizeT >	m_size;
+		std::mutex				m_writer;
+		std::vector< std::pair< Node *, EpochT > > m_retired;
+		mutable DomainT			m_domain;
+	};
+}
+
+#endif
@@ -0,0 +1,551 @@
+#ifndef UTIL_FROZENREDBLACKTREE_H
+#define UTIL_FROZENREDBLACKTREE_H
+
+#include <functional>
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "RedBlackTree.h"
+
+namespace util
+{
+	namespace detail
+	{
+		// Number of low one bits of value, which must not be all ones.
+		inline unsigned countTrailingOnes( std::size_t value )
+		{
+#if defined( __GNUC__ ) || defined( __clang__ )
+			return unsigned( __builtin_ctzll(
+				~static_cast< unsigned long long >( value ) ) );
+#else
+			unsigned count = 0;
+
+			for( ; value & 1; value >>= 1 )
+			{
+				++count;
+			}
+			return count;
+#endif
+		}
+	}
+
+	// Immutable tree of keys in one array, in the breadth-first (Eytzinger)
+	// order of a complete binary tree: the children of the key at position
+	// k, counting from 1, are at 2k and 2k + 1. Descents compute the next
+	// position instead of loading a pointer, so they run without branches
+	// on the comparison and prefetch the keys a few levels ahead, and the
+	// array holds the keys alone, without links or colours. The array is
+	// aligned to a cache line, which the allocator must honour.
+	template< class _KeyT, class _LessT, class _AllocT >
+	class FrozenRedBlackTree: private detail::Compressed< _LessT >
+	{
+		using LessBase = detail::Compressed< _LessT >;
+
+		public:
+
+		using KeyT = _KeyT;
+		using LessT = _LessT;
+		using AllocT = _AllocT;
+		using SizeT = std::size_t;
+
+		// Visits the keys in ascending order.
+		class const_iterator
+		{
+			public:
+
+			friend FrozenRedBlackTree;
+
+			using iterator_category = std::forward_iterator_tag;
+			using value_type = KeyT;
+			using difference_type = std::ptrdiff_t;
+			using pointer = KeyT const *;
+			using reference = KeyT const &;
+
+			const_iterator():
+				m_tree{ nullptr },
+				m_position{ 0 }
+			{}
+
+			reference operator*() const
+			{
+				return m_tree->getKey( m_position );
+			}
+
+			pointer operator->() const
+			{
+				return &m_tree->getKey( m_position );
+			}
+
+			const_iterator & operator++()
+			{
+				m_position = m_tree->getNextPosition( m_position );
+				return *this;
+			}
+
+			const_iterator operator++( int )
+			{
+				const_iterator result = *this;
+				++( *this );
+				return result;
+			}
+
+			bool operator==( const_iterator const & other ) const
+			{
+				return m_position == other.m_position;
+			}
+
+			bool operator!=( const_iterator const & other ) const
+			{
+				return m_position != other.m_position;
+			}
+
+			private:
+
+			const_iterator( FrozenRedBlackTree const * tree, SizeT position ):
+				m_tree{ tree },
+				m_position{ position }
+			{}
+
+			FrozenRedBlackTree const *	m_tree;
+			SizeT						m_position;
+		};
+
+		template< class _K >
+		using IfTransparentT = typename std::enable_if<
+			detail::IsTransparent< LessT >::value, _K >::type;
+
+		explicit FrozenRedBlackTree( LessT const & lessFunc = LessT{},
+		                             AllocT const & allocator = AllocT{} ):
+			LessBase( lessFunc ),
+			m_lines{ nullptr },
+			m_size{ 0 },
+			m_allocator{ allocator }
+		{}
+
+		// Copies strictly increasing keys, in linear time.
+		template< class _Iter >
+		FrozenRedBlackTree( SortedUniqueT, _Iter first, _Iter last,
+		                    LessT const & lessFunc = LessT{},
+		                    AllocT const & allocator = AllocT{} ):
+			FrozenRedBlackTree( lessFunc, allocator )
+		{
+			build( first, SizeT( std::distance( first, last ) ) );
+		}
+
+		template< class _TraitsT >
+		explicit FrozenRedBlackTree( RedBlackTree< KeyT, LessT, AllocT,
+		                                           _TraitsT > const & tree ):
+			FrozenRedBlackTree( SORTED_UNIQUE, tree.begin(), tree.end(),
+			                    tree.getLess(), tree.getAllocator() )
+		{}
+
+		FrozenRedBlackTree( FrozenRedBlackTree const & other ):
+			LessBase( other.LessBase::get() ),
+			m_lines{ nullptr },
+			m_size{ 0 },
+			m_allocator{ LineAllocTraits::
+			             select_on_container_copy_construction(
+			                 other.m_allocator ) }
+		{
+			copyKeys( other );
+		}
+
+		FrozenRedBlackTree( FrozenRedBlackTree && other ) noexcept:
+			LessBase( other.LessBase::get() ),
+			m_lines{ nullptr },
+			m_size{ 0 },
+			m_allocator{ std::move( other.m_allocator ) }
+		{
+			steal( other );
+		}
+
+		FrozenRedBlackTree & operator=( FrozenRedBlackTree const & other )
+		{
+			if( this == &other )
+			{
+				return *this;
+			}
+			release();
+			LessBase::get() = other.LessBase::get();
+
+			if constexpr( LineAllocTraits::
+			              propagate_on_container_copy_assignment::value )
+			{
+				m_allocator = other.m_allocator;
+			}
+			copyKeys( other );
+			return *this;
+		}
+
+		FrozenRedBlackTree & operator=( FrozenRedBlackTree && other )
+		{
+			if( this == &other )
+			{
+				return *this;
+			}
+			release();
+			LessBase::get() = other.LessBase::get();
+
+			if constexpr( LineAllocTraits::
+			              propagate_on_container_move_assignment::value )
+			{
+				m_allocator = std::move( other.m_allocator );
+			}
+			else if( !( m_allocator == other.m_allocator ) )
+			{
+				// The array cannot change allocator, copy the keys instead.
+				copyKeys( other );
+				other.release();
+				return *this;
+			}
+			steal( other );
+			return *this;
+		}
+
+		~FrozenRedBlackTree()
+		{
+			release();
+		}
+
+		// Copies the keys back into a tree that may change, in linear time.
+		template< class _TraitsT = TreeTraits >
+		RedBlackTree< KeyT, LessT, AllocT, _TraitsT > thaw() const
+		{
+			return RedBlackTree< KeyT, LessT, AllocT, _TraitsT >::fromSorted(
+				begin(), end(), getLess(), getAllocator() );
+		}
+
+		KeyT const * find( KeyT const & key ) const
+		{
+			return findKey( key );
+		}
+
+		template< class _K, class = IfTransparentT< _K > >
+		KeyT const * find( _K const & key ) const
+		{
+			return findKey( key );
+		}
+
+		bool contains( KeyT const & key ) const
+		{
+			return ( findKey( key ) != nullptr );
+		}
+
+		template< class _K, class = IfTransparentT< _K > >
+		bool contains( _K const & key ) const
+		{
+			return ( findKey( key ) != nullptr );
+		}
+
+		// Smallest key not less than key.
+		KeyT const * lowerBound( KeyT const & key ) const
+		{
+			return toKey( getBound( key, false ) );
+		}
+
+		template< class _K, class = IfTransparentT< _K > >
+		KeyT const * lowerBound( _K const & key ) const
+		{
+			return toKey( getBound( key, false ) );
+		}
+
+		// Smallest key greater than key.
+		KeyT const * upperBound( KeyT const & key ) const
+		{
+			return toKey( getBound( key, true ) );
+		}
+
+		template< class _K, class = IfTransparentT< _K > >
+		KeyT const * upperBound( _K const & key ) const
+		{
+			return toKey( getBound( key, true ) );
+		}
+
+		SizeT getSize() const
+		{
+			return m_size;
+		}
+
+		const_iterator begin() const
+		{
+			if( m_size == 0 )
+			{
+				return end();
+			}
+			SizeT position = 1;
+
+			while( 2 * position <= m_size )
+			{
+				position *= 2;
+			}
+			return const_iterator( this, position );
+		}
+
+		const_iterator end() const
+		{
+			return const_iterator( this, 0 );
+		}
+
+		// Calls func with every key in ascending order.
+		template< class _Func >
+		void forEach( _Func && func ) const
+		{
+			for( KeyT const & key: *this )
+			{
+				func( key );
+			}
+		}
+
+		AllocT getAllocator() const
+		{
+			return AllocT( m_allocator );
+		}
+
+		LessT getLess() const
+		{
+			return LessBase::get();
+		}
+
+		// Whether the keys are strictly increasing in order.
+		bool validate() const
+		{
+			return std::adjacent_find( begin(), end(),
+				[ this ]( KeyT const & k1, KeyT const & k2 )
+				{
+					return !less( k1, k2 );
+				} ) == end();
+		}
+
+		private:
+
+		static SizeT constexpr LINE = 64;
+
+		// Keys of a cache line. Position p is at index p of an array
+		// aligned to a line, so when the key size divides the line, the
+		// line at position k * PREFETCH holds the descendants of k
+		// log2( PREFETCH ) levels down and nothing else.
+		static SizeT constexpr PREFETCH = std::max< SizeT >(
+			LINE / sizeof( KeyT ), 1 );
+
+		static_assert( alignof( KeyT ) <= LINE,
+		               "Keys are laid out from a cache line boundary" );
+
+		struct alignas( LINE ) Line
+		{
+			unsigned char	m_bytes[ LINE ];
+		};
+
+		using LineAllocT = typename std::allocator_traits< AllocT >::
+			template rebind_alloc< Line >;
+		using LineAllocTraits = std::allocator_traits< LineAllocT >;
+
+		template< class _K1, class _K2 >
+		bool less( _K1 const & k1, _K2 const & k2 ) const
+		{
+			return LessBase::get()( k1, k2 );
+		}
+
+		KeyT * getKeys() const
+		{
+			return reinterpret_cast< KeyT * >( m_lines );
+		}
+
+		KeyT const & getKey( SizeT position ) const
+		{
+			return getKeys()[ position ];
+		}
+
+		SizeT getNextPosition( SizeT position ) const
+		{
+			return getNextPosition( position, m_size );
+		}
+
+		// Lines holding count keys after the unused position 0.
+		static SizeT getLineCount( SizeT count )
+		{
+			return ( ( count + 1 ) * sizeof( KeyT ) + LINE - 1 ) / LINE;
+		}
+
+		// Copies count keys into a new array, the key at each position
+		// from source( position ).
+		template< class _Source >
+		void fill( SizeT count, _Source source )
+		{
+			assert( m_lines == nullptr );
+
+			if( count == 0 )
+			{
+				return;
+			}
+			SizeT lineCount = getLineCount( count );
+			Line * lines = LineAllocTraits::allocate( m_allocator, lineCount );
+			KeyT * keys = reinterpret_cast< KeyT * >( lines );
+			SizeT position = 1;
+
+			try
+			{
+				for( ; position <= count; ++position )
+				{
+					::new( static_cast< void * >( keys + position ) )
+						KeyT( source( position ) );
+				}
+			}
+			catch( ... )
+			{
+				std::destroy( keys + 1, keys + position );
+				LineAllocTraits::deallocate( m_allocator, lines, lineCount );
+				throw;
+			}
+			m_lines = lines;
+			m_size = count;
+		}
+
+		void copyKeys( FrozenRedBlackTree const & other )
+		{
+			KeyT const * keys = other.getKeys();
+			fill( other.m_size, [ keys ]( SizeT position ) -> KeyT const &
+			{
+				return keys[ position ];
+			} );
+		}
+
+		void steal( FrozenRedBlackTree & other )
+		{
+			m_lines = other.m_lines;
+			m_size = other.m_size;
+			other.m_lines = nullptr;
+			other.m_size = 0;
+		}
+
+		void release()
+		{
+			if( m_lines != nullptr )
+			{
+				std::destroy( getKeys() + 1, getKeys() + 1 + m_size );
+				LineAllocTraits::deallocate( m_allocator, m_lines,
+				                             getLineCount( m_size ) );
+				m_lines = nullptr;
+				m_size = 0;
+			}
+		}
+
+		// Lays out count keys from first in breadth-first order.
+		template< class _Iter >
+		void build( _Iter first, SizeT count )
+		{
+			std::vector< KeyT const * > order( count );
+
+			// Positions are visited in key order through a tree of the
+			// final size, which the keys are not in yet.
+			SizeT position = 1;
+
+			while( 2 * position <= count )
+			{
+				position *= 2;
+			}
+
+			for( SizeT i = 0; i < count; ++i, ++first )
+			{
+				order[ position - 1 ] = &*first;
+				position = getNextPosition( position, count );
+			}
+
+			fill( count, [ & ]( SizeT position ) -> KeyT const &
+			{
+				return *order[ position - 1 ];
+			} );
+			assert( validate() );
+		}
+
+		// Position after position in key order in a tree of count keys, 0
+		// after the last. From a node without a right subtree that is the
+		// parent of the lowest left child on the way up, found by dropping
+		// the trailing ones.
+		static SizeT getNextPosition( SizeT position, SizeT count )
+		{
+			if( 2 * position + 1 <= count )
+			{
+				position = 2 * position + 1;
+
+				while( 2 * position <= count )
+				{
+					position *= 2;
+				}
+				return position;
+			}
+			return position >> ( detail::countTrailingOnes( position ) + 1 );
+		}
+
+		// Position of the smallest key not less than key, or greater than
+		// key with upper, or 0 if there is none. The descent goes right
+		// past every key that is less, and the answer is the last node
+		// where it went left: the trailing ones of the final position are
+		// the steps taken right since.
+		template< class _K >
+		SizeT getBound( _K const & key, bool upper ) const
+		{
+			SizeT count = m_size;
+			KeyT const * keys = getKeys();
+			SizeT position = 1;
+
+			if( upper )
+			{
+				while( position <= count )
+				{
+					prefetchBelow( keys, position, count );
+					position = 2 * position +
+					           SizeT( !less( key, keys[ position ] ) );
+				}
+			}
+			else
+			{
+				while( position <= count )
+				{
+					prefetchBelow( keys, position, count );
+					position = 2 * position +
+					           SizeT( less( keys[ position ], key ) );
+				}
+			}
+			return position >> ( detail::countTrailingOnes( position ) + 1 );
+		}
+
+		// Prefetches the line of the descendants of position, clamped to
+		// the last key so as to stay in the array. With a key per line
+		// that is the key about to be compared, so nothing is prefetched.
+		static void prefetchBelow( KeyT const * keys, SizeT position,
+		                           SizeT count )
+		{
+			if constexpr( PREFETCH > 1 )
+			{
+				detail::prefetch( keys +
+					std::min( position * PREFETCH, count ) );
+			}
+		}
+
+		template< class _K >
+		KeyT const * findKey( _K const & key ) const
+		{
+			KeyT const * lower = toKey( getBound( key, false ) );
+			return ( lower != nullptr && !less( key, *lower ) ? lower :
+			         nullptr );
+		}
+
+		KeyT const * toKey( SizeT position ) const
+		{
+			return ( position != 0 ? &getKey( position ) : nullptr );
+		}
+
+		Line *		m_lines;
+		SizeT		m_size;
+		LineAllocT	m_allocator;
+	};
+}
+
+#endif
@@ -0,0 +1,220 @@
+#ifndef UTIL_FROZENTREEVIEW_H
+#define UTIL_FROZENTREEVIEW_H
+
+#include <functional>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#include "RedBlackTree.h"
+
+namespace util
+{
+	// Read-only view of a tree that RedBlackTree::serialize() wrote, say
+	// to a file mapped into memory. The keys are searched where they lie,
+	// without building anything, so opening takes constant time and the
+	// buffer must outlive the view. The format holds offsets only, no
+	// pointers, and can be mapped at any address aligned for KeyT.
+	template< class _KeyT,
+	          class _LessT = std::less< _KeyT > >
+	class FrozenTreeView: private detail::Compressed< _LessT >
+	{
+		using LessBase = detail::Compressed< _LessT >;
+
+		public:
+
+		using KeyT = _KeyT;
+		using LessT = _LessT;
+		using SizeT = std::size_t;
+		using const_iterator = KeyT const *;
+
+		static_assert( std::is_trivially_copyable< KeyT >::value,
+		               "Keys are read as their bytes" );
+
+		template< class _K >
+		using IfTransparentT = typename std::enable_if<
+			detail::IsTransparent< LessT >::value, _K >::type;
+
+		explicit FrozenTreeView( LessT const & lessFunc = LessT{} ):
+			LessBase( lessFunc ),
+			m_keys{ nullptr },
+			m_size{ 0 }
+		{}
+
+		// Views the tree serialized in the size bytes at buffer. Returns
+		// false and views an empty tree unless they hold a tree of KeyT
+		// aligned for it. The order of the keys is trusted; validate()
+		// checks it in linear time.
+		bool open( void const * buffer, SizeT size )
+		{
+			SizeT offset = detail::getSerialOffset< KeyT >();
+			std::uint64_t count = 0;
+			close();
+
+			if( size < offset ||
+			    !detail::readSerialHeader< KeyT >( buffer, count ) ||
+			    count > ( size - offset ) / sizeof( KeyT ) )
+			{
+				return false;
+			}
+			char const * bytes = static_cast< char const * >( buffer ) + offset;
+
+			if( reinterpret_cast< std::uintptr_t >( bytes ) %
+			    alignof( KeyT ) != 0 )
+			{
+				return false;
+			}
+			m_keys = reinterpret_cast< KeyT const * >( bytes );
+			m_size = SizeT( count );
+			return true;
+		}
+
+		void close()
+		{
+			m_keys = nullptr;
+			m_size = 0;
+		}
+
+		KeyT const * find( KeyT const & key ) const
+		{
+			return findKey( key );
+		}
+
+		template< class _K, class = IfTransparentT< _K > >
+		KeyT const * find( _K const & key ) const
+		{
+			return findKey( key );
+		}
+
+		bool contains( KeyT const & key ) const
+		{
+			return ( findKey( key ) != nullptr );
+		}
+
+		template< class _K, class = IfTransparentT< _K > >
+		bool contains( _K const & key ) const
+		{
+			return ( findKey( key ) != nullptr );
+		}
+
+		// Smallest key not less than key.
+		KeyT const * lowerBound( KeyT const & key ) const
+		{
+			return toKey( getLower( key ) );
+		}
+
+		template< class _K, class = IfTransparentT< _K > >
+		KeyT const * lowerBound( _K const & key ) const
+		{
+			return toKey( getLower( key ) );
+		}
+
+		// Smallest key greater than key.
+		KeyT const * upperBound( KeyT const & key ) const
+		{
+			return toKey( getUpper( key ) );
+		}
+
+		template< class _K, class = IfTransparentT< _K > >
+		KeyT const * upperBound( _K const & key ) const
+		{
+			return toKey( getUpper( key ) );
+		}
+
+		// Key at index in sorted order, or nullptr if index is out of
+		// range.
+		KeyT const * select( SizeT index ) const
+		{
+			return ( index < m_size ? m_keys + index : nullptr );
+		}
+
+		// Returns the number of keys less than key.
+		SizeT rank( KeyT const & key ) const
+		{
+			return SizeT( getLower( key ) - m_keys );
+		}
+
+		template< class _K, class = IfTransparentT< _K > >
+		SizeT rank( _K const & key ) const
+		{
+			return SizeT( getLower( key ) - m_keys );
+		}
+
+		SizeT getSize() const
+		{
+			return m_size;
+		}
+
+		const_iterator begin() const
+		{
+			return m_keys;
+		}
+
+		const_iterator end() const
+		{
+			return m_keys + m_size;
+		}
+
+		LessT getLess() const
+		{
+			return LessBase::get();
+		}
+
+		// Whether the keys are strictly increasing.
+		bool validate() const
+		{
+			return std::adjacent_find( begin(), end(),
+				[ this ]( KeyT const & k1, KeyT const & k2 )
+				{
+					return !less( k1, k2 );
+				} ) == end();
+		}
+
+		private:
+
+		template< class _K1, class _K2 >
+		bool less( _K1 const & k1, _K2 const & k2 ) const
+		{
+			return LessBase::get()( k1, k2 );
+		}
+
+		template< class _K >
+		KeyT const * getLower( _K const & key ) const
+		{
+			return std::lower_bound( begin(), end(), key,
+				[ this ]( KeyT const & k1, _K const & k2 )
+				{
+					return less( k1, k2 );
+				} );
+		}
+
+		template< class _K >
+		KeyT const * getUpper( _K const & key ) const
+		{
+			return std::upper_bound( begin(), end(), key,
+				[ this ]( _K const & k1, KeyT const & k2 )
+				{
+					return less( k1, k2 );
+				} );
+		}
+
+		template< class _K >
+		KeyT const * findKey( _K const & key ) const
+		{
+			KeyT const * lower = getLower( key );
+			return ( lower != end() && !less( key, *lower ) ? lower :
+			         nullptr );
+		}
+
+		KeyT const * toKey( KeyT const * position ) const
+		{
+			return ( position != end() ? position : nullptr );
+		}
+
+		KeyT const *	m_keys;
+		SizeT			m_size;
+	};
+}
+
+#endif
@@ -0,0 +1,856 @@
+#ifndef UTIL_PERSISTENTREDBLACKTREE_H
+#define UTIL_PERSISTENTREDBLACKTREE_H
+
+#include <functional>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "RedBlackTree.h"
+
+namespace util
+{
+	namespace detail
+	{
+		struct NoCount
+		{};
+
+		// Node of a tree whose versions share subtrees. Fresh nodes were
+		// created for the version being built and may still change, any
+		// other node is part of a version that may be read.
+		template< class _KeyT, class _CountT >
+		struct PathNode
+		{
+			template< class... _Args >
+			explicit PathNode( std::in_place_t, _Args && ... args ):
+				m_children{ nullptr, nullptr },
+				m_red{ true },
+				m_fresh{ true },
+				m_count{},
+				m_key( std::forward< _Args >( args )... )
+			{}
+
+			PathNode *	m_children[ 2 ];
+			bool		m_red;
+			bool		m_fresh;
+			_CountT		m_count;
+			_KeyT		m_key;
+		};
+
+		// Left-leaning red-black tree, as formulated by Sedgewick, over
+		// nodes without parent links. A version is changed by copying the
+		// path it touches: nodes that are not fresh are copied before they
+		// are modified and queued as unlinked, for the derived tree to free
+		// once no version holds them. With a count type, nodes count the
+		// links to them from the nodes and trees of every version.
+		template< class _KeyT, class _LessT, class _AllocT, class _CountT >
+		class PathCopyingTree: private Compressed< _LessT >
+		{
+			using LessBase = Compressed< _LessT >;
+
+			public:
+
+			using KeyT = _KeyT;
+			using LessT = _LessT;
+			using AllocT = _AllocT;
+			using SizeT = std::size_t;
+			using Node = PathNode< KeyT, _CountT >;
+
+			static bool constexpr COUNTED =
+				!std::is_same< _CountT, NoCount >::value;
+
+			using NodeAllocT = typename std::allocator_traits< AllocT >::
+				template rebind_alloc< Node >;
+			using NodeAllocTraits = std::allocator_traits< NodeAllocT >;
+
+			PathCopyingTree( LessT const & lessFunc, AllocT const & allocator ):
+				LessBase( lessFunc ),
+				m_allocator{ allocator }
+			{}
+
+			AllocT getAllocator() const
+			{
+				return AllocT( m_allocator );
+			}
+
+			LessT getLess() const
+			{
+				return LessBase::get();
+			}
+
+			template< class _K1, class _K2 >
+			bool less( _K1 const & k1, _K2 const & k2 ) const
+			{
+				return LessBase::get()( k1, k2 );
+			}
+
+			protected:
+
+			template< class _K >
+			Node const * findNode( Node const * node, _K const & key ) const
+			{
+				while( node != nullptr )
+				{
+					if( less( key, node->m_key ) )
+					{
+						node = node->m_children[ 0 ];
+					}
+					else if( less( node->m_key, key ) )
+					{
+						node = node->m_children[ 1 ];
+					}
+					else
+					{
+						return node;
+					}
+				}
+				return nullptr;
+			}
+
+			// Smallest node not less than key, or greater with upper.
+			template< class _K >
+			Node const * findBound( Node const * node, _K const & key,
+			                        bool upper ) const
+			{
+				Node const * bound = nullptr;
+
+				while( node != nullptr )
+				{
+					if( upper ? less( key, node->m_key ) :
+					            !less( node->m_key, key ) )
+					{
+						bound = node;
+						node = node->m_children[ 0 ];
+					}
+					else
+					{
+						node = node->m_children[ 1 ];
+					}
+				}
+				return bound;
+			}
+
+			// Greatest node less than key.
+			template< class _K >
+			Node const * findBefore( Node const * node, _K const & key ) const
+			{
+				Node const * bound = nullptr;
+
+				while( node != nullptr )
+				{
+					if( less( node->m_key, key ) )
+					{
+						bound = node;
+						node = node->m_children[ 1 ];
+					}
+					else
+					{
+						node = node->m_children[ 0 ];
+					}
+				}
+				return bound;
+			}
+
+			static Node const * getEnd( Node const * node, SizeT side )
+			{
+				while( node != nullptr && node->m_children[ side ] != nullptr )
+				{
+					node = node->m_children[ side ];
+				}
+				return node;
+			}
+
+			static KeyT const * getKey( Node const * node )
+			{
+				return ( node != nullptr ? &node->m_key : nullptr );
+			}
+
+			template< class _Func >
+			static void visit( Node const * node, _Func & func )
+			{
+				for( ; node != nullptr; node = node->m_children[ 1 ] )
+				{
+					visit( node->m_children[ 0 ], func );
+					func( node->m_key );
+				}
+			}
+
+			// Returns the root of a version holding key as well, which must
+			// be absent. Prepare runs last and may throw too, say to reserve
+			// room for the unlinked nodes.
+			template< class _K, class _Prepare >
+			Node * insertKey( Node * root, _K && key, _Prepare && prepare )
+			{
+				return update( [ & ]()
+				{
+					root = insert( root, std::forward< _K >( key ) );
+					root->m_red = false;
+					prepare();
+					return root;
+				} );
+			}
+
+			// Returns the root of a version without key, which must be
+			// present.
+			template< class _K, class _Prepare >
+			Node * eraseKey( Node * root, _K const & key, _Prepare && prepare )
+			{
+				return update( [ & ]()
+				{
+					root = own( root );
+
+					if( !isRed( root->m_children[ 0 ] ) &&
+					    !isRed( root->m_children[ 1 ] ) )
+					{
+						root->m_red = true;
+					}
+					root = erase( root, key );
+
+					if( root != nullptr )
+					{
+						root->m_red = false;
+					}
+					prepare();
+					return root;
+				} );
+			}
+
+			// Builds a version with build, which either succeeds or leaves
+			// every existing version as it was. The nodes of the new version
+			// are no longer fresh afterwards.
+			template< class _Build >
+			Node * update( _Build && build )
+			{
+				Node * root = nullptr;
+
+				try
+				{
+					root = build();
+				}
+				catch( ... )
+				{
+					rollback();
+					throw;
+				}
+
+				for( Node * node: m_created )
+				{
+					node->m_fresh = false;
+				}
+				m_created.clear();
+				m_retained.clear();
+				return root;
+			}
+
+			template< class... _Args >
+			Node * createNode( _Args && ... args )
+			{
+				Node * node = NodeAllocTraits::allocate( m_allocator, 1 );
+
+				try
+				{
+					::new( static_cast< void * >( node ) )
+						Node( std::in_place, std::forward< _Args >( args )... );
+				}
+				catch( ... )
+				{
+					NodeAllocTraits::deallocate( m_allocator, node, 1 );
+					throw;
+				}
+
+				if constexpr( COUNTED )
+				{
+					node->m_count.store( 1, std::memory_order_relaxed );
+				}
+
+				try
+				{
+					m_created.push_back( node );
+				}
+				catch( ... )
+				{
+					destroyNode( node );
+					throw;
+				}
+				return node;
+			}
+
+			void destroyNode( Node * node )
+			{
+				node->~Node();
+				NodeAllocTraits::deallocate( m_allocator, node, 1 );
+			}
+
+			void destroyTree( Node * node )
+			{
+				while( node != nullptr )
+				{
+					destroyTree( node->m_children[ 0 ] );
+					Node * right = node->m_children[ 1 ];
+					destroyNode( node );
+					node = right;
+				}
+			}
+
+			static void addLink( Node * node )
+			{
+				if( node != nullptr )
+				{
+					node->m_count.fetch_add( 1, std::memory_order_relaxed );
+				}
+			}
+
+			// Drops one link to node, freeing the nodes no longer linked.
+			void release( Node * node )
+			{
+				static_assert( COUNTED, "Only counted nodes are released" );
+
+				while( node != nullptr &&
+				       node->m_count.fetch_sub( 1,
+				           std::memory_order_acq_rel ) == 1 )
+				{
+					release( node->m_children[ 0 ] );
+					Node * right = node->m_children[ 1 ];
+					destroyNode( node );
+					node = right;
+				}
+			}
+
+			void unlink( Node * node )
+			{
+				m_unlinked.push_back( node );
+			}
+
+			void unlinkTree( Node * node )
+			{
+				for( ; node != nullptr; node = node->m_children[ 1 ] )
+				{
+					unlinkTree( node->m_children[ 0 ] );
+					unlink( node );
+				}
+			}
+
+			// Black height of the subtree between the optional bounds, or
+			// INVALID. Counts the nodes into count.
+			SizeT getValidHeight( Node const * node, Node const * low,
+			                      Node const * high, SizeT & count ) const
+			{
+				if( node == nullptr )
+				{
+					return 0;
+				}
+				++count;
+
+				if( ( low != nullptr && !less( low->m_key, node->m_key ) ) ||
+				    ( high != nullptr && !less( node->m_key, high->m_key ) ) ||
+				    isRed( node->m_children[ 1 ] ) ||
+				    ( node->m_red && isRed( node->m_children[ 0 ] ) ) )
+				{
+					return INVALID;
+				}
+				SizeT left = getValidHeight( node->m_children[ 0 ], low, node,
+				                             count );
+				SizeT right = getValidHeight( node->m_children[ 1 ], node,
+				                              high, count );
+
+				if( left == INVALID || left != right )
+				{
+					return INVALID;
+				}
+				return left + !node->m_red;
+			}
+
+			bool isValid( Node const * root, SizeT size ) const
+			{
+				SizeT count = 0;
+				return ( !isRed( root ) &&
+				         getValidHeight( root, nullptr, nullptr, count ) !=
+				             INVALID &&
+				         count == size );
+			}
+
+			static SizeT constexpr INVALID = ~SizeT( 0 );
+
+			NodeAllocT				m_allocator;
+			std::vector< Node * >	m_unlinked;
+
+			private:
+
+			template< class _K >
+			Node * insert( Node * node, _K && key )
+			{
+				if( node == nullptr )
+				{
+					return createNode( std::forward< _K >( key ) );
+				}
+				node = own( node );
+				Node * & child = node->m_children[ !less( key, node->m_key ) ];
+				child = insert( child, std::forward< _K >( key ) );
+				return balance( node );
+			}
+
+			template< class _K >
+			Node * erase( Node * node, _K const & key )
+			{
+				node = own( node );
+
+				if( less( key, node->m_key ) )
+				{
+					if( !isRed( node->m_children[ 0 ] ) &&
+					    !isRed( node->m_children[ 0 ]->m_children[ 0 ] ) )
+					{
+						node = moveRedLeft( node );
+					}
+					node->m_children[ 0 ] = erase( node->m_children[ 0 ], key );
+					return balance( node );
+				}
+
+				if( isRed( node->m_children[ 0 ] ) )
+				{
+					node = rotateRight( node );
+				}
+
+				// From here on key is not less than the key of node.
+				if( !less( node->m_key, key ) &&
+				    node->m_children[ 1 ] == nullptr )
+				{
+					unlink( node );
+					return nullptr;
+				}
+
+				if( !isRed( node->m_children[ 1 ] ) &&
+				    !isRed( node->m_children[ 1 ]->m_children[ 0 ] ) )
+				{
+					node = moveRedRight( node );
+				}
+
+				if( !less( node->m_key, key ) )
+				{
+					// Other versions may hold the successor, so its key is
+					// copied.
+					Node const * next = getEnd( node->m_children[ 1 ], 0 );
+					Node * replacement = createNode( next->m_key );
+					copyLinks( replacement, node );
+					unlink( node );
+					node = replacement;
+					node->m_children[ 1 ] = eraseFirst( node->m_children[ 1 ] );
+				}
+				else
+				{
+					node->m_children[ 1 ] = erase( node->m_children[ 1 ], key );
+				}
+				return balance( node );
+			}
+
+			Node * eraseFirst( Node * node )
+			{
+				if( node->m_children[ 0 ] == nullptr )
+				{
+					unlink( node );
+					return nullptr;
+				}
+				node = own( node );
+
+				if( !isRed( node->m_children[ 0 ] ) &&
+				    !isRed( node->m_children[ 0 ]->m_children[ 0 ] ) )
+				{
+					node = moveRedLeft( node );
+				}
+				node->m_children[ 0 ] = eraseFirst( node->m_children[ 0 ] );
+				return balance( node );
+			}
+
+			Node * rotateLeft( Node * node )
+			{
+				Node * right = own( node->m_children[ 1 ] );
+				node->m_children[ 1 ] = right->m_children[ 0 ];
+				right->m_children[ 0 ] = node;
+				right->m_red = node->m_red;
+				node->m_red = true;
+				return right;
+			}
+
+			Node * rotateRight( Node * node )
+			{
+				Node * left = own( node->m_children[ 0 ] );
+				node->m_children[ 0 ] = left->m_children[ 1 ];
+				left->m_children[ 1 ] = node;
+				left->m_red = node->m_red;
+				node->m_red = true;
+				return left;
+			}
+
+			void flipColors( Node * node )
+			{
+				node->m_red = !node->m_red;
+
+				for( auto & child: node->m_children )
+				{
+					child = own( child );
+					child->m_red = !child->m_red;
+				}
+			}
+
+			Node * moveRedLeft( Node * node )
+			{
+				flipColors( node );
+
+				if( isRed( node->m_children[ 1 ]->m_children[ 0 ] ) )
+				{
+					node->m_children[ 1 ] = rotateRight( node->m_children[ 1 ] );
+					node = rotateLeft( node );
+					flipColors( node );
+				}
+				return node;
+			}
+
+			Node * moveRedRight( Node * node )
+			{
+				flipColors( node );
+
+				if( isRed( node->m_children[ 0 ]->m_children[ 0 ] ) )
+				{
+					node = rotateRight( node );
+					flipColors( node );
+				}
+				return node;
+			}
+
+			Node * balance( Node * node )
+			{
+				if( isRed( node->m_children[ 1 ] ) &&
+				    !isRed( node->m_children[ 0 ] ) )
+				{
+					node = rotateLeft( node );
+				}
+
+				if( isRed( node->m_children[ 0 ] ) &&
+				    isRed( node->m_children[ 0 ]->m_children[ 0 ] ) )
+				{
+					node = rotateRight( node );
+				}
+
+				if( isRed( node->m_children[ 0 ] ) &&
+				    isRed( node->m_children[ 1 ] ) )
+				{
+					flipColors( node );
+				}
+				return node;
+			}
+
+			static bool isRed( Node const * node )
+			{
+				return ( node != nullptr && node->m_red );
+			}
+
+			// Returns node, or a fresh copy of it that node is unlinked for.
+			Node * own( Node * node )
+			{
+				if( node == nullptr || node->m_fresh )
+				{
+					return node;
+				}
+				Node * copy = createNode( node->m_key );
+				copyLinks( copy, node );
+				unlink( node );
+				return copy;
+			}
+
+			void copyLinks( Node * node, Node const * source )
+			{
+				node->m_red = source->m_red;
+
+				for( Node * child: source->m_children )
+				{
+					retain( child );
+				}
+				node->m_children[ 0 ] = source->m_children[ 0 ];
+				node->m_children[ 1 ] = source->m_children[ 1 ];
+			}
+
+			// Counts a link from a fresh node immediately, whereas dropped
+			// links are only released once the version is complete.
+			void retain( Node * node )
+			{
+				if constexpr( COUNTED )
+				{
+					if( node != nullptr )
+					{
+						m_retained.push_back( node );
+						addLink( node );
+					}
+				}
+			}
+
+			// Undoes the version being built, which changed no counts but
+			// for the links retained.
+			void rollback()
+			{
+				if constexpr( COUNTED )
+				{
+					for( Node * node: m_retained )
+					{
+						node->m_count.fetch_sub( 1, std::memory_order_relaxed );
+					}
+					m_retained.clear();
+				}
+
+				for( Node * node: m_created )
+				{
+					destroyNode( node );
+				}
+				m_created.clear();
+				m_unlinked.clear();
+			}
+
+			std::vector< Node * >	m_created;
+			std::vector< Node * >	m_retained;
+		};
+	}
+
+	// Red-black tree whose copies are taken in constant time and share
+	// all nodes. Changes copy only the path they touch, so every copy
+	// stays a consistent point-in-time view until it is destroyed. Nodes
+	// count the links to them and go when the last is dropped. Copies may
+	// be used by different threads, provided the allocator is thread-safe.
+	template< class _KeyT,
+	          class _LessT = std::less< _KeyT >,
+	          class _AllocT = std::allocator< _KeyT > >
+	class PersistentRedBlackTree: private detail::PathCopyingTree<
+		_KeyT, _LessT, _AllocT, std::atomic< std::uint32_t > >
+	{
+		using BaseT = detail::PathCopyingTree<
+			_KeyT, _LessT, _AllocT, std::atomic< std::uint32_t > >;
+		using Node = typename BaseT::Node;
+
+		template< class _K >
+		using IfTransparentT = typename std::enable_if<
+			detail::IsTransparent< _LessT >::value, _K >::type;
+
+		public:
+
+		using KeyT = _KeyT;
+		using LessT = _LessT;
+		using AllocT = _AllocT;
+		using SizeT = std::size_t;
+
+		PersistentRedBlackTree():
+			PersistentRedBlackTree( LessT{} )
+		{}
+
+		explicit PersistentRedBlackTree( LessT const & lessFunc,
+		                                 AllocT const & allocator = AllocT{} ):
+			BaseT( lessFunc, allocator ),
+			m_root{ nullptr },
+			m_size{ 0 }
+		{}
+
+		explicit PersistentRedBlackTree( AllocT const & allocator ):
+			PersistentRedBlackTree( LessT{}, allocator )
+		{}
+
+		// Copies share the nodes of other, and with them its allocator.
+		PersistentRedBlackTree( PersistentRedBlackTree const & other ):
+			BaseT( other ),
+			m_root{ other.m_root },
+			m_size{ other.m_size }
+		{
+			BaseT::addLink( m_root );
+		}
+
+		PersistentRedBlackTree( PersistentRedBlackTree && other ) noexcept:
+			BaseT( other ),
+			m_root{ other.m_root },
+			m_size{ other.m_size }
+		{
+			other.m_root = nullptr;
+			other.m_size = 0;
+		}
+
+		PersistentRedBlackTree & operator=(
+			PersistentRedBlackTree const & other )
+		{
+			PersistentRedBlackTree copy( other );
+			return ( *this = std::move( copy ) );
+		}
+
+		PersistentRedBlackTree & operator=( PersistentRedBlackTree && other )
+		{
+			if( this != &other )
+			{
+				clear();
+				BaseT::operator=( other );
+				m_root = other.m_root;
+				m_size = other.m_size;
+				other.m_root = nullptr;
+				other.m_size = 0;
+			}
+			return *this;
+		}
+
+		~PersistentRedBlackTree()
+		{
+			clear();
+		}
+
+		// Point-in-time view of this tree, taken in constant time.
+		PersistentRedBlackTree snapshot() const
+		{
+			return *this;
+		}
+
+		bool add( KeyT const & key )
+		{
+			return addKey( key );
+		}
+
+		bool add( KeyT && key )
+		{
+			return addKey( std::move( key ) );
+		}
+
+		bool remove( KeyT const & key )
+		{
+			return removeKey( key );
+		}
+
+		template< class _K, class = IfTransparentT< _K > >
+		bool remove( _K const & key )
+		{
+			return removeKey( key );
+		}
+
+		void clear()
+		{
+			BaseT::release( m_root );
+			m_root = nullptr;
+			m_size = 0;
+		}
+
+		KeyT const * find( KeyT const & key ) const
+		{
+			return BaseT::getKey( BaseT::findNode( m_root, key ) );
+		}
+
+		template< class _K, class = IfTransparentT< _K > >
+		KeyT const * find( _K const & key ) const
+		{
+			return BaseT::getKey( BaseT::findNode( m_root, key ) );
+		}
+
+		bool contains( KeyT const & key ) const
+		{
+			return ( find( key ) != nullptr );
+		}
+
+		template< class _K, class = IfTransparentT< _K > >
+		bool contains( _K const & key ) const
+		{
+			return ( find( key ) != nullptr );
+		}
+
+		// Smallest key not less than key.
+		KeyT const * lowerBound( KeyT const & key ) const
+		{
+			return BaseT::getKey( BaseT::findBound( m_root, key, false ) );
+		}
+
+		// Smallest key greater than key.
+		KeyT const * upperBound( KeyT const & key ) const
+		{
+			return BaseT::getKey( BaseT::findBound( m_root, key, true ) );
+		}
+
+		KeyT const * getNext( KeyT const & key ) const
+		{
+			return upperBound( key );
+		}
+
+		// Greatest key less than key.
+		KeyT const * getPrevious( KeyT const & key ) const
+		{
+			return BaseT::getKey( BaseT::findBefore( m_root, key ) );
+		}
+
+		KeyT const * getFirst() const
+		{
+			return BaseT::getKey( BaseT::getEnd( m_root, 0 ) );
+		}
+
+		KeyT const * getLast() const
+		{
+			return BaseT::getKey( BaseT::getEnd( m_root, 1 ) );
+		}
+
+		// Calls func with every key in ascending order.
+		template< class _Func >
+		void forEach( _Func && func ) const
+		{
+			BaseT::visit( m_root, func );
+		}
+
+		SizeT getSize() const
+		{
+			return m_size;
+		}
+
+		bool validate() const
+		{
+			return BaseT::isValid( m_root, m_size );
+		}
+
+		using BaseT::getAllocator;
+		using BaseT::getLess;
+		using BaseT::less;
+
+		private:
+
+		template< class _K >
+		bool addKey( _K && key )
+		{
+			if( BaseT::findNode( m_root, key ) != nullptr )
+			{
+				return false;
+			}
+			commit( BaseT::insertKey( m_root, std::forward< _K >( key ),
+			                          []{} ) );
+			++m_size;
+			return true;
+		}
+
+		template< class _K >
+		bool removeKey( _K const & key )
+		{
+			if( BaseT::findNode( m_root, key ) == nullptr )
+			{
+				return false;
+			}
+			commit( BaseT::eraseKey( m_root, key, []{} ) );
+			--m_size;
+			return true;
+		}
+
+		// Drops the links of the nodes unlinked from the new version.
+		void commit( Node * root )
+		{
+			m_root = root;
+
+			for( Node * node: BaseT::m_unlinked )
+			{
+				BaseT::release( node );
+			}
+			BaseT::m_unlinked.clear();
+		}
+
+		Node *	m_root;
+		SizeT	m_size;
+	};
+}
+
+#endif
@@ -0,0 +1,226 @@
+#ifndef UTIL_POOLALLOCATOR_H
+#define UTIL_POOLALLOCATOR_H
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+
+namespace util
+{
+	// Slab arena handing out small fixed-size blocks. Blocks are carved from
+	// large chunks and recycled through a free list per size class, so nodes
+	// of a container end up packed together and rarely reach the global
+	// allocator. Not thread-safe.
+	class PoolArena
+	{
+		public:
+
+		using SizeT = std::size_t;
+		using ByteT = std::uint8_t;
+
+		static SizeT constexpr GRANULARITY	= alignof( void * );
+		static SizeT constexpr CLASS_COUNT	= 32;
+		static SizeT constexpr MAX_BLOCK	= GRANULARITY * CLASS_COUNT;
+
+		explicit PoolArena( SizeT chunkSize = 64 * 1024 ):
+			m_chunks{ nullptr },
+			m_chunkSize{ chunkSize }
+		{
+			assert( chunkSize >= MAX_BLOCK );
+			resetClasses();
+		}
+
+		PoolArena( PoolArena const & ) = delete;
+		PoolArena & operator=( PoolArena const & ) = delete;
+
+		~PoolArena()
+		{
+			release();
+		}
+
+		void * allocate( SizeT bytes, SizeT alignment )
+		{
+			if( !isPooled( bytes, alignment ) )
+			{
+				return ::operator new( bytes, std::align_val_t( alignment ) );
+			}
+			SizeT index = getClass( bytes );
+			Block * block = m_free[ index ];
+
+			// Recycle a freed block first.
+			if( block != nullptr )
+			{
+				m_free[ index ] = block->m_next;
+				return block;
+			}
+			SizeT size = ( index + 1 ) * GRANULARITY;
+
+			// Carve a new block from the current chunk of this class.
+			if( m_cursor[ index ] == nullptr ||
+			    SizeT( m_end[ index ] - m_cursor[ index ] ) < size )
+			{
+				addChunk( index );
+			}
+			void * result = m_cursor[ index ];
+			m_cursor[ index ] += size;
+			return result;
+		}
+
+		void deallocate( void * block, SizeT bytes, SizeT alignment )
+		{
+			if( !isPooled( bytes, alignment ) )
+			{
+				::operator delete( block, std::align_val_t( alignment ) );
+				return;
+			}
+			SizeT index = getClass( bytes );
+			Block * freed = static_cast< Block * >( block );
+			freed->m_next = m_free[ index ];
+			m_free[ index ] = freed;
+		}
+
+		// Returns every chunk to the system at once. All blocks handed out
+		// by the arena become invalid.
+		void release()
+		{
+			while( m_chunks != nullptr )
+			{
+				Chunk * next = m_chunks->m_next;
+				::operator delete( m_chunks );
+				m_chunks = next;
+			}
+			resetClasses();
+		}
+
+		SizeT getChunkSize() const
+		{
+			return m_chunkSize;
+		}
+
+		private:
+
+		struct Block
+		{
+			Block * m_next;
+		};
+
+		struct alignas( std::max_align_t ) Chunk
+		{
+			Chunk * m_next;
+		};
+
+		static bool isPooled( SizeT bytes, SizeT alignment )
+		{
+			return ( bytes > 0 && bytes <= MAX_BLOCK &&
+			         alignment <= GRANULARITY );
+		}
+
+		static SizeT getClass( SizeT bytes )
+		{
+			return ( bytes + GRANULARITY - 1 ) / GRANULARITY - 1;
+		}
+
+		void addChunk( SizeT index )
+		{
+			void * memory = ::operator new( sizeof( Chunk ) + m_chunkSize );
+			Chunk * chunk = static_cast< Chunk * >( memory );
+			chunk->m_next = m_chunks;
+			m_chunks = chunk;
+			m_cursor[ index ] = reinterpret_cast< ByteT * >( chunk + 1 );
+			m_end[ index ] = m_cursor[ index ] + m_chunkSize;
+		}
+
+		void resetClasses()
+		{
+			for( SizeT i = 0; i < CLASS_COUNT; ++i )
+			{
+				m_free[ i ] = nullptr;
+				m_cursor[ i ] = nullptr;
+				m_end[ i ] = nullptr;
+			}
+		}
+
+		Block *	m_free[ CLASS_COUNT ];
+		ByteT *	m_cursor[ CLASS_COUNT ];
+		ByteT *	m_end[ CLASS_COUNT ];
+		Chunk *	m_chunks;
+		SizeT	m_chunkSize;
+	};
+
+	// std::allocator-compatible front end for a shared PoolArena. Copies and
+	// rebound copies share the same arena and compare equal.
+	template< class _T >
+	class PoolAllocator
+	{
+		public:
+
+		using value_type = _T;
+		using SizeT = std::size_t;
+
+		using propagate_on_container_copy_assignment	= std::true_type;
+		using propagate_on_container_move_assignment	= std::true_type;
+		using propagate_on_container_swap				= std::true_type;
+		using is_always_equal							= std::false_type;
+
+		template< class _U >
+		struct rebind
+		{
+			using other = PoolAllocator< _U >;
+		};
+
+		PoolAllocator():
+			m_arena{ std::make_shared< PoolArena >() }
+		{}
+
+		explicit PoolAllocator( std::shared_ptr< PoolArena > arena ):
+			m_arena{ std::move( arena ) }
+		{
+			assert( m_arena != nullptr );
+		}
+
+		// Copies stand in for moves so that the source keeps its arena.
+		PoolAllocator( PoolAllocator const & other ) noexcept = default;
+		PoolAllocator & operator=( PoolAllocator const & other ) = default;
+
+		template< class _U >
+		PoolAllocator( PoolAllocator< _U > const & other ) noexcept:
+			m_arena{ other.getArena() }
+		{}
+
+		_T * allocate( SizeT count )
+		{
+			return static_cast< _T * >(
+				m_arena->allocate( count * sizeof( _T ), alignof( _T ) ) );
+		}
+
+		void deallocate( _T * block, SizeT count )
+		{
+			m_arena->deallocate( block, count * sizeof( _T ), alignof( _T ) );
+		}
+
+		std::shared_ptr< PoolArena > const & getArena() const
+		{
+			return m_arena;
+		}
+
+		template< class _U >
+		bool operator==( PoolAllocator< _U > const & other ) const
+		{
+			return m_arena == other.getArena();
+		}
+
+		template< class _U >
+		bool operator!=( PoolAllocator< _U > const & other ) const
+		{
+			return m_arena != other.getArena();
+		}
+
+		private:
+
+		std::shared_ptr< PoolArena > m_arena;
+	};
+}
+
+#endif
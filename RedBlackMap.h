@@ -0,0 +1,183 @@
+#ifndef UTIL_REDBLACKMAP_H
+#define UTIL_REDBLACKMAP_H
+
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+
+#include "RedBlackTree.h"
+
+namespace util
+{
+	namespace detail
+	{
+		// Orders map elements by key alone and lets the tree be searched
+		// with a bare key.
+		template< class _KeyT, class _ValueT, class _LessT >
+		class MapLess: private Compressed< _LessT >
+		{
+			using LessBase = Compressed< _LessT >;
+
+			public:
+
+			using is_transparent = void;
+			using ElementT = std::pair< _KeyT const, _ValueT >;
+
+			explicit MapLess( _LessT const & lessFunc = _LessT{} ):
+				LessBase( lessFunc )
+			{}
+
+			bool operator()( ElementT const & e1, ElementT const & e2 ) const
+			{
+				return LessBase::get()( e1.first, e2.first );
+			}
+
+			bool operator()( ElementT const & e, _KeyT const & k ) const
+			{
+				return LessBase::get()( e.first, k );
+			}
+
+			bool operator()( _KeyT const & k, ElementT const & e ) const
+			{
+				return LessBase::get()( k, e.first );
+			}
+
+			template< class _K, class _L = _LessT,
+			          class = typename std::enable_if<
+			              IsTransparent< _L >::value >::type >
+			bool operator()( ElementT const & e, _K const & k ) const
+			{
+				return LessBase::get()( e.first, k );
+			}
+
+			template< class _K, class _L = _LessT,
+			          class = typename std::enable_if<
+			              IsTransparent< _L >::value >::type >
+			bool operator()( _K const & k, ElementT const & e ) const
+			{
+				return LessBase::get()( k, e.first );
+			}
+
+			_LessT const & getLess() const
+			{
+				return LessBase::get();
+			}
+		};
+	}
+
+	// Red-black tree of key and mapped value pairs, ordered by key.
+	template< class _KeyT,
+	          class _ValueT,
+	          class _LessT = std::less< _KeyT >,
+	          class _AllocT = std::allocator<
+	              std::pair< _KeyT const, _ValueT > >,
+	          class _TraitsT = TreeTraits >
+	class RedBlackMap: public RedBlackTree<
+		std::pair< _KeyT const, _ValueT >,
+		detail::MapLess< _KeyT, _ValueT, _LessT >,
+		_AllocT,
+		_TraitsT >
+	{
+		using BaseT = RedBlackTree<
+			std::pair< _KeyT const, _ValueT >,
+			detail::MapLess< _KeyT, _ValueT, _LessT >,
+			_AllocT,
+			_TraitsT >;
+
+		public:
+
+		using KeyT = _KeyT;
+		using ValueT = _ValueT;
+		using LessT = _LessT;
+		using AllocT = _AllocT;
+		using TraitsT = _TraitsT;
+		using ElementT = std::pair< KeyT const, ValueT >;
+		using ElementLessT = detail::MapLess< KeyT, ValueT, LessT >;
+		using Node = typename BaseT::Node;
+
+		RedBlackMap():
+			RedBlackMap( LessT{} )
+		{}
+
+		explicit RedBlackMap( LessT const & lessFunc,
+		                      AllocT const & allocator = AllocT{} ):
+			BaseT( ElementLessT( lessFunc ), allocator )
+		{}
+
+		explicit RedBlackMap( AllocT const & allocator ):
+			RedBlackMap( LessT{}, allocator )
+		{}
+
+		RedBlackMap( std::initializer_list< ElementT > elements,
+		             LessT const & lessFunc = LessT{},
+		             AllocT const & allocator = AllocT{} ):
+			BaseT( elements, ElementLessT( lessFunc ), allocator )
+		{}
+
+		template< class _FirstIter, class _LastIter >
+		RedBlackMap( _FirstIter first, _LastIter last,
+		             LessT const & lessFunc = LessT{},
+		             AllocT const & allocator = AllocT{} ):
+			BaseT( first, last, ElementLessT( lessFunc ), allocator )
+		{}
+
+		// Constructs the mapped value in place only if key is absent.
+		template< class... _Args >
+		std::pair< Node *, bool > tryEmplace( KeyT const & key,
+		                                      _Args && ... args )
+		{
+			return BaseT::emplaceKey( key,
+				std::piecewise_construct,
+				std::forward_as_tuple( key ),
+				std::forward_as_tuple( std::forward< _Args >( args )... ) );
+		}
+
+		template< class... _Args >
+		std::pair< Node *, bool > tryEmplace( KeyT && key, _Args && ... args )
+		{
+			return BaseT::emplaceKey( key,
+				std::piecewise_construct,
+				std::forward_as_tuple( std::move( key ) ),
+				std::forward_as_tuple( std::forward< _Args >( args )... ) );
+		}
+
+		ValueT & operator[]( KeyT const & key )
+		{
+			return tryEmplace( key ).first->getKey().second;
+		}
+
+		ValueT & operator[]( KeyT && key )
+		{
+			return tryEmplace( std::move( key ) ).first->getKey().second;
+		}
+
+		ValueT & at( KeyT const & key )
+		{
+			Node * node = BaseT::find( key );
+
+			if( node == nullptr )
+			{
+				throw std::out_of_range( "RedBlackMap::at" );
+			}
+			return node->getKey().second;
+		}
+
+		ValueT const & at( KeyT const & key ) const
+		{
+			Node const * node = BaseT::find( key );
+
+			if( node == nullptr )
+			{
+				throw std::out_of_range( "RedBlackMap::at" );
+			}
+			return node->getKey().second;
+		}
+
+		LessT getLess() const
+		{
+			return BaseT::getLess().getLess();
+		}
+	};
+}
+
+#endif
@@ -0,0 +1,247 @@
+#ifndef UTIL_REDBLACKMULTISET_H
+#define UTIL_REDBLACKMULTISET_H
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+#include "RedBlackMap.h"
+
+namespace util
+{
+	// Sorted multiset keeping one node per distinct key together with the
+	// number of times it occurs, so that repeats of a key cost no node of
+	// their own. Elements are pairs of a key and its count, which is
+	// never zero.
+	template< class _KeyT,
+	          class _LessT = std::less< _KeyT >,
+	          class _AllocT = std::allocator< _KeyT >,
+	          class _TraitsT = TreeTraits >
+	class RedBlackMultiset
+	{
+		public:
+
+		using KeyT = _KeyT;
+		using LessT = _LessT;
+		using AllocT = _AllocT;
+		using TraitsT = _TraitsT;
+		using SizeT = std::size_t;
+		using MapT = RedBlackMap< KeyT, SizeT, LessT,
+			typename std::allocator_traits< AllocT >::template rebind_alloc<
+				std::pair< KeyT const, SizeT > >,
+			TraitsT >;
+		using ElementT = typename MapT::ElementT;
+		using Node = typename MapT::Node;
+		using const_iterator = typename MapT::const_iterator;
+
+		RedBlackMultiset():
+			RedBlackMultiset( LessT{} )
+		{}
+
+		explicit RedBlackMultiset( LessT const & lessFunc,
+		                           AllocT const & allocator = AllocT{} ):
+			m_counts( lessFunc, typename MapT::AllocT( allocator ) ),
+			m_size{ 0 }
+		{}
+
+		template< class _FirstIter, class _LastIter >
+		RedBlackMultiset( _FirstIter first, _LastIter last,
+		                  LessT const & lessFunc = LessT{},
+		                  AllocT const & allocator = AllocT{} ):
+			RedBlackMultiset( lessFunc, allocator )
+		{
+			while( first != last )
+			{
+				add( *first );
+				++first;
+			}
+		}
+
+		RedBlackMultiset( RedBlackMultiset const & ) = default;
+		RedBlackMultiset & operator=( RedBlackMultiset const & ) = default;
+
+		RedBlackMultiset( RedBlackMultiset && other ) noexcept:
+			m_counts( std::move( other.m_counts ) ),
+			m_size{ other.m_size }
+		{
+			other.m_size = 0;
+		}
+
+		RedBlackMultiset & operator=( RedBlackMultiset && other )
+		{
+			if( this != &other )
+			{
+				m_counts = std::move( other.m_counts );
+				m_size = other.m_size;
+				other.m_size = 0;
+			}
+			return *this;
+		}
+
+		// Adds count occurrences of key, returning how many there are now.
+		// A key already present only has its count raised.
+		SizeT add( KeyT const & key, SizeT count = 1 )
+		{
+			return addCount( m_counts.tryEmplace( key, SizeT( 0 ) ).first,
+			                 count );
+		}
+
+		SizeT add( KeyT && key, SizeT count = 1 )
+		{
+			return addCount( m_counts.tryEmplace( std::move( key ),
+			                                      SizeT( 0 ) ).first, count );
+		}
+
+		// Removes one occurrence of key, and its node with the last one.
+		bool removeOne( KeyT const & key )
+		{
+			Node * node = m_counts.find( key );
+
+			if( node == nullptr )
+			{
+				return false;
+			}
+
+			if( --node->getKey().second == 0 )
+			{
+				m_counts.remove( node );
+			}
+			m_size -= 1;
+			return true;
+		}
+
+		// Removes every occurrence of key, returning how many there were.
+		SizeT removeAll( KeyT const & key )
+		{
+			Node * node = m_counts.find( key );
+
+			if( node == nullptr )
+			{
+				return 0;
+			}
+			SizeT count = node->getKey().second;
+			m_counts.remove( node );
+			m_size -= count;
+			return count;
+		}
+
+		SizeT count( KeyT const & key ) const
+		{
+			Node const * node = m_counts.find( key );
+			return ( node != nullptr ? node->getKey().second : 0 );
+		}
+
+		bool contains( KeyT const & key ) const
+		{
+			return m_counts.contains( key );
+		}
+
+		Node const * find( KeyT const & key ) const
+		{
+			return m_counts.find( key );
+		}
+
+		// Returns the node holding the smallest key not less than key, or
+		// nullptr if there is none.
+		Node const * lowerBound( KeyT const & key ) const
+		{
+			return m_counts.lowerBound( key );
+		}
+
+		// Returns the node holding the smallest key greater than key, or
+		// nullptr if there is none.
+		Node const * upperBound( KeyT const & key ) const
+		{
+			return m_counts.upperBound( key );
+		}
+
+		// Returns the positions spanning the element of key, its count
+		// giving the number of occurrences.
+		std::pair< const_iterator, const_iterator >
+		equalRange( KeyT const & key ) const
+		{
+			return m_counts.equalRange( key );
+		}
+
+		// Number of occurrences of all keys.
+		SizeT getSize() const
+		{
+			return m_size;
+		}
+
+		// Number of distinct keys, and so of nodes.
+		SizeT getDistinctSize() const
+		{
+			return m_counts.getSize();
+		}
+
+		// Calls func with every occurrence of every key in ascending order.
+		template< class _Func >
+		void forEach( _Func && func ) const
+		{
+			for( ElementT const & element: m_counts )
+			{
+				for( SizeT i = 0; i < element.second; ++i )
+				{
+					func( element.first );
+				}
+			}
+		}
+
+		const_iterator begin() const
+		{
+			return m_counts.begin();
+		}
+
+		const_iterator end() const
+		{
+			return m_counts.end();
+		}
+
+		void clear()
+		{
+			m_counts.clear();
+			m_size = 0;
+		}
+
+		LessT getLess() const
+		{
+			return m_counts.getLess();
+		}
+
+		bool validate() const
+		{
+			SizeT size = 0;
+
+			for( ElementT const & element: m_counts )
+			{
+				if( element.second == 0 )
+				{
+					return false;
+				}
+				size += element.second;
+			}
+			return ( m_counts.validate() && size == m_size );
+		}
+
+		private:
+
+		SizeT addCount( Node * node, SizeT count )
+		{
+			SizeT total = ( node->getKey().second += count );
+			m_size += count;
+
+			// Adding nothing to a new key leaves no empty node behind.
+			if( total == 0 )
+			{
+				m_counts.remove( node );
+			}
+			return total;
+		}
+
+		MapT	m_counts;
+		SizeT	m_size;
+	};
+}
+
+#endif
@@ -2,27 +2,428 @@
 #define UTIL_REDBLACKTREE_H
 
 #include <functional>
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <iterator>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <initializer_list>
+#include <istream>
 #include <limits>
+#include <memory>
+#include <new>
+#include <optional>
+#include <ostream>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "PoolAllocator.h"
 
 namespace util
 {
+	// Tag selecting the linear-time constructors for strictly increasing
+	// input.
+	struct SortedUniqueT
+	{
+		explicit SortedUniqueT() = default;
+	};
+
+	inline SortedUniqueT constexpr SORTED_UNIQUE{};
+
+	// Compile-time options of RedBlackTree. Derive from TreeTraits and
+	// shadow the members to be changed.
+	struct TreeTraits
+	{
+		// Nodes track the size of their subtree, enabling select(), rank()
+		// and countRange() in logarithmic time.
+		static bool constexpr ORDER_STATISTICS = false;
+
+		// Nodes keep their colour and side bits in the low bits of the
+		// parent pointer, saving a word per node for small keys.
+		static bool constexpr COMPACT_NODES = false;
+
+		// The tree counts its searches, allocations and rebalancing cases
+		// for getStats(). Without it no counting code is compiled.
+		static bool constexpr STATISTICS = false;
+	};
+
+	struct OrderStatisticTraits: TreeTraits
+	{
+		static bool constexpr ORDER_STATISTICS = true;
+	};
+
+	struct CompactTraits: TreeTraits
+	{
+		static bool constexpr COMPACT_NODES = true;
+	};
+
+	struct StatisticTraits: TreeTraits
+	{
+		static bool constexpr STATISTICS = true;
+	};
+
+	// Counts a tree with STATISTICS has gathered, as getStats() returns
+	// them.
+	struct TreeStats
+	{
+		enum Counter
+		{
+			// Single-key descents of lookups, bounds and insertions, with
+			// the comparisons made and the nodes visited on the way.
+			SEARCHES,
+			COMPARISONS,
+			DEPTH,
+			ALLOCATIONS,
+			FREES,
+			// Removals of inner nodes, which trade places with their
+			// successor first.
+			SWAPS,
+			// Rebalancing cases, after the functions handling them.
+			ADD_TWO_LEFT,
+			ADD_TWO_RIGHT,
+			ADD_THREE_LEFT,
+			ADD_THREE_MIDDLE,
+			ADD_THREE_RIGHT,
+			REM_TWO_LEFT_TWO,
+			REM_TWO_LEFT_THREE,
+			REM_TWO_RIGHT_TWO,
+			REM_TWO_RIGHT_THREE,
+			REM_THREE_LEFT_TWO_X,
+			REM_THREE_LEFT_THREE_X,
+			REM_THREE_MIDDLE_TWO_X,
+			REM_THREE_MIDDLE_THREE_X,
+			REM_THREE_RIGHT_X_TWO,
+			REM_THREE_RIGHT_X_THREE,
+			COUNTER_COUNT
+		};
+
+		static char const * getName( Counter counter )
+		{
+			static char const * const NAMES[ COUNTER_COUNT ] =
+			{
+				"searches",
+				"comparisons",
+				"depth",
+				"allocations",
+				"frees",
+				"swaps",
+				"addTwoLeft",
+				"addTwoRight",
+				"addThreeLeft",
+				"addThreeMiddle",
+				"addThreeRight",
+				"remTwoLeft_Two",
+				"remTwoLeft_Three",
+				"remTwoRight_Two",
+				"remTwoRight_Three",
+				"remThreeLeft_Two_X",
+				"remThreeLeft_Three_X",
+				"remThreeMiddle_Two_X",
+				"remThreeMiddle_Three_X",
+				"remThreeRight_X_Two",
+				"remThreeRight_X_Three",
+			};
+			return NAMES[ counter ];
+		}
+
+		std::size_t operator[]( Counter counter ) const
+		{
+			return counts[ counter ];
+		}
+
+		std::size_t	counts[ COUNTER_COUNT ] = {};
+	};
+
+	namespace detail
+	{
+		template< class _LessT, class = void >
+		struct IsTransparent: std::false_type
+		{};
+
+		template< class _LessT >
+		struct IsTransparent< _LessT,
+			std::void_t< typename _LessT::is_transparent > >: std::true_type
+		{};
+
+		// Map elements keep their key const, so they may be handed out
+		// mutably without breaking the ordering.
+		template< class _T >
+		struct HasConstKey: std::false_type
+		{};
+
+		template< class _K, class _V >
+		struct HasConstKey< std::pair< _K const, _V > >: std::true_type
+		{};
+
+		template< class _A >
+		struct IsPoolAllocator: std::false_type
+		{};
+
+		template< class _T >
+		struct IsPoolAllocator< PoolAllocator< _T > >: std::true_type
+		{};
+
+		// Hints that address will be read soon.
+		inline void prefetch( void const * address )
+		{
+#if defined( __GNUC__ ) || defined( __clang__ )
+			__builtin_prefetch( address );
+#else
+			( void )address;
+#endif
+		}
+
+		template< bool _Enabled >
+		class SubtreeSize
+		{};
+
+		template<>
+		class SubtreeSize< true >
+		{
+			public:
+
+			std::size_t getSubtreeSize() const
+			{
+				return m_subtreeSize;
+			}
+
+			protected:
+
+			std::size_t m_subtreeSize = 1;
+		};
+
+		template< bool _Enabled >
+		class StatCounters
+		{};
+
+		// Counters are atomic, as parallel builds and set operations
+		// allocate from several threads, but count without ordering.
+		template<>
+		class StatCounters< true >
+		{
+			protected:
+
+			void addCount( TreeStats::Counter counter,
+			               std::size_t amount ) const
+			{
+				m_counts[ counter ].fetch_add( amount,
+				                               std::memory_order_relaxed );
+			}
+
+			mutable std::atomic< std::size_t >
+				m_counts[ TreeStats::COUNTER_COUNT ] = {};
+		};
+
+		// Parent pointer of a node together with its two type bits.
+		template< class _NodeT, bool _Compact >
+		class ParentLink
+		{
+			protected:
+
+			using ByteT = std::uint8_t;
+
+			_NodeT * getParentLink() const
+			{
+				return m_parent;
+			}
+
+			void setParentLink( _NodeT * parent )
+			{
+				m_parent = parent;
+			}
+
+			ByteT getType() const
+			{
+				return m_type;
+			}
+
+			void setType( ByteT type )
+			{
+				m_type = type;
+			}
+
+			private:
+
+			_NodeT *	m_parent = nullptr;
+			ByteT		m_type = 0;
+		};
+
+		template< class _NodeT >
+		class ParentLink< _NodeT, true >
+		{
+			protected:
+
+			using ByteT = std::uint8_t;
+
+			static std::uintptr_t constexpr TYPE_MASK = 3;
+
+			static_assert( alignof( void * ) > TYPE_MASK,
+			               "Pointers lack spare low bits" );
+
+			_NodeT * getParentLink() const
+			{
+				return reinterpret_cast< _NodeT * >( m_link & ~TYPE_MASK );
+			}
+
+			void setParentLink( _NodeT * parent )
+			{
+				std::uintptr_t bits = reinterpret_cast< std::uintptr_t >( parent );
+				assert( ( bits & TYPE_MASK ) == 0 );
+
+				m_link = bits | ( m_link & TYPE_MASK );
+			}
+
+			ByteT getType() const
+			{
+				return ByteT( m_link & TYPE_MASK );
+			}
+
+			void setType( ByteT type )
+			{
+				assert( type <= TYPE_MASK );
+
+				m_link = ( m_link & ~TYPE_MASK ) | type;
+			}
+
+			private:
+
+			std::uintptr_t m_link = 0;
+		};
+
+		// Holds a value as a base class when it is an empty class, so that
+		// stateless comparators and allocators take no space.
+		template< class _T,
+		          bool = std::is_empty< _T >::value &&
+		                 !std::is_final< _T >::value >
+		class Compressed
+		{
+			public:
+
+			explicit Compressed( _T const & value ):
+				m_value{ value }
+			{}
+
+			_T & get()
+			{
+				return m_value;
+			}
+
+			_T const & get() const
+			{
+				return m_value;
+			}
+
+			private:
+
+			_T m_value;
+		};
+
+		template< class _T >
+		class Compressed< _T, true >: private _T
+		{
+			public:
+
+			explicit Compressed( _T const & value ):
+				_T( value )
+			{}
+
+			_T & get()
+			{
+				return *this;
+			}
+
+			_T const & get() const
+			{
+				return *this;
+			}
+		};
+
+		// Leads a serialized tree, its count keys following in ascending
+		// order from the first offset past it aligned for the key type.
+		// The tree shape is not stored: the linear-time build gives the
+		// same shape for the same count.
+		struct SerialHeader
+		{
+			// "RBT1" in the byte order of the writer, which reads back
+			// reversed on machines of the other.
+			static std::uint32_t constexpr MAGIC = 0x52425431;
+
+			std::uint32_t	magic;
+			std::uint32_t	keySize;
+			std::uint64_t	count;
+		};
+
+		template< class _KeyT >
+		constexpr std::size_t getSerialOffset()
+		{
+			return ( sizeof( SerialHeader ) + alignof( _KeyT ) - 1 ) /
+			       alignof( _KeyT ) * alignof( _KeyT );
+		}
+
+		// Reads the header at buffer into count, returning false unless it
+		// was written for keys of this size on a machine of this byte
+		// order.
+		template< class _KeyT >
+		bool readSerialHeader( void const * buffer, std::uint64_t & count )
+		{
+			SerialHeader header;
+			std::memcpy( &header, buffer, sizeof( header ) );
+			count = header.count;
+			return ( header.magic == SerialHeader::MAGIC &&
+			         header.keySize == sizeof( _KeyT ) );
+		}
+	}
+
+	// Immutable copy of a tree laid out for lookups, defined in
+	// FrozenRedBlackTree.h.
+	template< class _KeyT,
+	          class _LessT = std::less< _KeyT >,
+	          class _AllocT = std::allocator< _KeyT > >
+	class FrozenRedBlackTree;
+
 	template< class _KeyT,
-	          class _LessT = std::less< _KeyT > >
-	class RedBlackTree
+	          class _LessT = std::less< _KeyT >,
+	          class _AllocT = std::allocator< _KeyT >,
+	          class _TraitsT = TreeTraits >
+	class RedBlackTree: private detail::Compressed< _LessT >,
+	                    private detail::StatCounters< _TraitsT::STATISTICS >
 	{
+		using LessBase = detail::Compressed< _LessT >;
+		using StatsBase = detail::StatCounters< _TraitsT::STATISTICS >;
+
 		public:
 
 		using KeyT = _KeyT;
 		using LessT = _LessT;
+		using AllocT = _AllocT;
+		using TraitsT = _TraitsT;
 		using SizeT = std::size_t;
 		using ByteT = std::uint8_t;
 
-		class Node
+		static bool constexpr ORDER_STATISTICS = TraitsT::ORDER_STATISTICS;
+		static bool constexpr COMPACT_NODES = TraitsT::COMPACT_NODES;
+		static bool constexpr STATISTICS = TraitsT::STATISTICS;
+
+		// Whether the parallel builds and set operations are offered. They
+		// allocate and free nodes on several threads through copies of the
+		// allocator, and copies of a PoolAllocator share an arena that is
+		// not thread-safe.
+		static bool constexpr PARALLEL =
+			!detail::IsPoolAllocator< AllocT >::value;
+
+		class Node: public detail::SubtreeSize< ORDER_STATISTICS >,
+		            private detail::ParentLink< Node, COMPACT_NODES >
 		{
+			using LinkBase = detail::ParentLink< Node, COMPACT_NODES >;
+
 			public:
 
-			friend RedBlackTree< KeyT, LessT >;
+			friend RedBlackTree;
 
 			Node * getChild( bool left )
 			{
@@ -56,15 +457,15 @@ namespace util
 
 			Node * getParent()
 			{
-				return m_parent;
+				return LinkBase::getParentLink();
 			}
 
 			Node const * getParent() const
 			{
-				return m_parent;
+				return LinkBase::getParentLink();
 			}
 
-			Node * getPrevious() const
+			Node * getPrevious()
 			{
 				Node * node = this;
 				
@@ -81,13 +482,13 @@ namespace util
 				}
 
 				// No left child so traverse upwards.
-				while( node->m_parent != nullptr )
+				while( node->getParent() != nullptr )
 				{
 					if( node->isGreaterThanParent() )
 					{
-						return node->m_parent;
+						return node->getParent();
 					}
-					node = node->m_parent;
+					node = node->getParent();
 				}
 				return this;
 			}
@@ -114,13 +515,13 @@ namespace util
 				}
 
 				// No right child so traverse upwards.
-				while( node->m_parent != nullptr )
+				while( node->getParent() != nullptr )
 				{
 					if( node->isLessThanParent() )
 					{
-						return node->m_parent;
+						return node->getParent();
 					}
-					node = node->m_parent;
+					node = node->getParent();
 				}
 				return this;
 			}
@@ -135,6 +536,14 @@ namespace util
 				return m_key;
 			}
 
+			template< class _T = KeyT,
+			          class = typename std::enable_if<
+			              detail::HasConstKey< _T >::value >::type >
+			KeyT & getKey()
+			{
+				return m_key;
+			}
+
 			private:
 
 			static ByteT constexpr RED_INDEX	= 0;
@@ -143,25 +552,32 @@ namespace util
 			static ByteT constexpr RED	= 1 << RED_INDEX;
 			static ByteT constexpr LESS	= 1 << LESS_INDEX;
 
-			Node( KeyT const & key = KeyT{} ): 
+			Node( KeyT const & key ): 
 				m_children{ nullptr, nullptr },
-			    m_parent{ nullptr },
-			    m_type{ 0 },
 			    m_key{ key }
 			{}
 
+			Node( KeyT && key ): 
+				m_children{ nullptr, nullptr },
+			    m_key{ std::move( key ) }
+			{}
+
+			template< class... _Args >
+			Node( std::in_place_t, _Args && ... args ):
+				m_children{ nullptr, nullptr },
+			    m_key( std::forward< _Args >( args )... )
+			{}
+
 			Node( Node const & other ): 
+				LinkBase( other ),
 				m_children{ other.m_children[ 0 ], other.m_children[ 1 ] },
-			    m_parent{ other.m_parent },
-			    m_type{ other.m_type },
 			    m_key{ other.m_key }
 			{}
 
 			Node( Node && other ): 
+				LinkBase( other ),
 				m_children{ other.m_children[ 0 ], other.m_children[ 1 ] },
-			    m_parent{ other.m_parent },
-			    m_type{ other.m_type },
-			    m_key{ other.m_key }
+			    m_key{ std::move( other.m_key ) }
 			{}
 
 			~Node()
@@ -184,18 +600,18 @@ namespace util
 
 			void setParent( Node * parent )
 			{
-				m_parent = parent;
+				LinkBase::setParentLink( parent );
 			}
 
 			bool isRed() const
 			{
-				return ( ( m_type & RED ) > 0 );
+				return ( ( LinkBase::getType() & RED ) > 0 );
 			}
 
 			void setRed( bool isRed = true )
 			{
-				m_type &= ~RED;
-				m_type |= ( ByteT( isRed ) << RED_INDEX );
+				LinkBase::setType( ByteT( ( LinkBase::getType() & ~RED ) |
+				                          ( ByteT( isRed ) << RED_INDEX ) ) );
 			}
 
 			bool isBlack() const
@@ -210,13 +626,13 @@ namespace util
 
 			bool isLessThanParent() const
 			{
-				return ( ( m_type & LESS ) > 0 );
+				return ( ( LinkBase::getType() & LESS ) > 0 );
 			}
 
 			void setLessThanParent( bool isLess = true )
 			{
-				m_type &= ~LESS;
-				m_type |= ( ByteT( isLess ) << LESS_INDEX );
+				LinkBase::setType( ByteT( ( LinkBase::getType() & ~LESS ) |
+				                          ( ByteT( isLess ) << LESS_INDEX ) ) );
 			}
 
 			bool isGreaterThanParent() const
@@ -233,8 +649,7 @@ namespace util
 			{
 				m_children[ 0 ] = other.m_children[ 0 ];
 				m_children[ 1 ] = other.m_children[ 1 ];
-				m_parent		= other.m_parent;
-				m_type			= other.m_type;
+				LinkBase::operator=( other );
 				m_key			= other.m_key;
 
 				return *this;
@@ -244,371 +659,2975 @@ namespace util
 			{
 				m_children[ 0 ] = other.m_children[ 0 ];
 				m_children[ 1 ] = other.m_children[ 1 ];
-				m_parent		= other.m_parent;
-				m_type			= other.m_type;
-				m_key			= other.m_key;
+				LinkBase::operator=( other );
+				m_key			= std::move( other.m_key );
 
 				return *this;
 			}
 
 			Node *	m_children[ 2 ];
-			Node *	m_parent;
-			ByteT	m_type;
 			KeyT	m_key;
 		};
 
+		template< bool _Const >
+		class Iterator
+		{
+			public:
+
+			friend RedBlackTree;
+
+			using NodeT = typename std::conditional< _Const,
+				Node const, Node >::type;
+			using TreeT = RedBlackTree const;
+
+			using iterator_category = std::bidirectional_iterator_tag;
+			using value_type = KeyT;
+			using difference_type = std::ptrdiff_t;
+			using reference = typename std::conditional<
+				!_Const && detail::HasConstKey< KeyT >::value,
+				KeyT &, KeyT const & >::type;
+			using pointer = typename std::remove_reference< reference >::type *;
+
+			Iterator():
+				m_node{ nullptr },
+				m_tree{ nullptr }
+			{}
+
+			template< bool _OtherConst,
+			          class = typename std::enable_if<
+			              _Const && !_OtherConst >::type >
+			Iterator( Iterator< _OtherConst > const & other ):
+				m_node{ other.m_node },
+				m_tree{ other.m_tree }
+			{}
+
+			NodeT * getNode() const
+			{
+				return m_node;
+			}
+
+			reference operator*() const
+			{
+				return m_node->getKey();
+			}
+
+			pointer operator->() const
+			{
+				return &( m_node->getKey() );
+			}
+
+			Iterator & operator++()
+			{
+				assert( m_node != nullptr );
+
+				NodeT * next = m_node->getNext();
+				m_node = ( next != m_node ? next : nullptr );
+				return *this;
+			}
+
+			Iterator operator++( int )
+			{
+				Iterator result = *this;
+				++( *this );
+				return result;
+			}
+
+			Iterator & operator--()
+			{
+				if( m_node == nullptr )
+				{
+					// Step back from end.
+					m_node = m_tree->m_last;
+				}
+				else
+				{
+					NodeT * previous = m_node->getPrevious();
+					m_node = ( previous != m_node ? previous : nullptr );
+				}
+				return *this;
+			}
+
+			Iterator operator--( int )
+			{
+				Iterator result = *this;
+				--( *this );
+				return result;
+			}
+
+			template< bool _OtherConst >
+			bool operator==( Iterator< _OtherConst > const & other ) const
+			{
+				return m_node == other.m_node;
+			}
+
+			template< bool _OtherConst >
+			bool operator!=( Iterator< _OtherConst > const & other ) const
+			{
+				return m_node != other.m_node;
+			}
+
+			private:
+
+			Iterator( NodeT * node, TreeT * tree ):
+				m_node{ node },
+				m_tree{ tree }
+			{}
+
+			NodeT *	m_node;
+			TreeT *	m_tree;
+		};
+
+		using iterator = Iterator< false >;
+		using const_iterator = Iterator< true >;
+		using reverse_iterator = std::reverse_iterator< iterator >;
+		using const_reverse_iterator = std::reverse_iterator< const_iterator >;
+
+		// Enables lookups by any type the comparator accepts, as with
+		// std::set, when LessT declares is_transparent.
+		template< class _K >
+		using IfTransparentT = typename std::enable_if<
+			detail::IsTransparent< LessT >::value, _K >::type;
+
+		using NodeAllocT = typename std::allocator_traits< AllocT >::
+			template rebind_alloc< Node >;
+		using NodeAllocTraits = std::allocator_traits< NodeAllocT >;
+
 		RedBlackTree():
+			RedBlackTree( LessT{} )
+		{}
+
+		explicit RedBlackTree( LessT const & lessFunc,
+		                       AllocT const & allocator = AllocT{} ):
+			LessBase( lessFunc ),
 			m_root{ nullptr },
-			m_size{ 0 }
+			m_first{ nullptr },
+			m_last{ nullptr },
+			m_size{ 0 },
+			m_allocator{ allocator }
+		{}
+
+		explicit RedBlackTree( AllocT const & allocator ):
+			RedBlackTree( LessT{}, allocator )
+		{}
+
+		RedBlackTree( std::initializer_list< KeyT > keys,
+		              LessT const & lessFunc = LessT{},
+		              AllocT const & allocator = AllocT{} ):
+			RedBlackTree( lessFunc, allocator )
+		{
+			for( auto & key: keys )
+			{
+				add( key );
+			}
+		}
+
+		RedBlackTree( std::initializer_list< KeyT > keys,
+		              AllocT const & allocator ):
+			RedBlackTree( keys, LessT{}, allocator )
+		{}
+
+		template< class _FirstIter, class _LastIter >
+		RedBlackTree( _FirstIter first, _LastIter last,
+		              LessT const & lessFunc = LessT{},
+		              AllocT const & allocator = AllocT{} ):
+			RedBlackTree( lessFunc, allocator )
+		{
+			while( first != last )
+			{
+				add( *first );
+				++first;
+			}
+		}
+
+		template< class _FirstIter, class _LastIter >
+		RedBlackTree( _FirstIter first, _LastIter last,
+		              AllocT const & allocator ):
+			RedBlackTree( first, last, LessT{}, allocator )
 		{}
 
-		RedBlackTree( std::initializer_list< KeyT > keys ):
-			RedBlackTree()
+		// Builds the tree in linear time from strictly increasing keys.
+		template< class _FirstIter, class _LastIter >
+		RedBlackTree( SortedUniqueT, _FirstIter first, _LastIter last,
+		              LessT const & lessFunc = LessT{},
+		              AllocT const & allocator = AllocT{} ):
+			RedBlackTree( lessFunc, allocator )
+		{
+			Node * vine = nullptr;
+			Node * tail = nullptr;
+			SizeT count = 0;
+
+			try
+			{
+				while( first != last )
+				{
+					Node * node = createNode( *first );
+					++first;
+
+					if( tail != nullptr )
+					{
+						assert( less( tail->getKey(), node->getKey() ) );
+						tail->setRightChild( node );
+					}
+					else
+					{
+						vine = node;
+					}
+					tail = node;
+					++count;
+				}
+			}
+			catch( ... )
+			{
+				destroyVine( vine );
+				throw;
+			}
+			buildFromVine( vine, count );
+		}
+
+		template< class _FirstIter, class _LastIter >
+		RedBlackTree( SortedUniqueT, _FirstIter first, _LastIter last,
+		              AllocT const & allocator ):
+			RedBlackTree( SORTED_UNIQUE, first, last, LessT{}, allocator )
+		{}
+
+		template< class _FirstIter, class _LastIter >
+		static RedBlackTree fromSorted( _FirstIter first, _LastIter last,
+		                                LessT const & lessFunc = LessT{},
+		                                AllocT const & allocator = AllocT{} )
+		{
+			return RedBlackTree( SORTED_UNIQUE, first, last, lessFunc,
+			                     allocator );
+		}
+
+		// With parallel and random access input, subtrees are built on
+		// several threads, so the allocator must then be safe to share
+		// between threads. Only offered with PARALLEL.
+		template< class _FirstIter, class _LastIter, bool _Parallel = PARALLEL,
+		          class = typename std::enable_if< _Parallel >::type >
+		static RedBlackTree fromSorted( _FirstIter first, _LastIter last,
+		                                LessT const & lessFunc,
+		                                AllocT const & allocator,
+		                                bool parallel )
+		{
+			if constexpr( std::is_same< _FirstIter, _LastIter >::value &&
+			              std::is_base_of< std::random_access_iterator_tag,
+			                  typename std::iterator_traits< _FirstIter >::
+			                  iterator_category >::value )
+			{
+				if( parallel )
+				{
+					RedBlackTree tree( lessFunc, allocator );
+					tree.buildSorted( first, SizeT( last - first ), true );
+					return tree;
+				}
+			}
+			return RedBlackTree( SORTED_UNIQUE, first, last, lessFunc,
+			                     allocator );
+		}
+
+		// Copies clone the node shape and colours of other directly, in
+		// linear time and without comparing keys.
+		RedBlackTree( RedBlackTree const & other ):
+			LessBase( other.LessBase::get() ),
+			m_root{ nullptr },
+			m_first{ nullptr },
+			m_last{ nullptr },
+			m_size{ 0 },
+			m_allocator{ NodeAllocTraits::
+			             select_on_container_copy_construction(
+			                 other.m_allocator ) }
+		{
+			copyNodes( other );
+		}
+
+		RedBlackTree & operator=( RedBlackTree const & other )
+		{
+			if( this == &other )
+			{
+				return *this;
+			}
+			clear();
+			LessBase::get() = other.LessBase::get();
+
+			if constexpr( NodeAllocTraits::
+			              propagate_on_container_copy_assignment::value )
+			{
+				m_allocator = other.m_allocator;
+			}
+			copyNodes( other );
+			return *this;
+		}
+
+		RedBlackTree( RedBlackTree && other ) noexcept:
+			LessBase( other.LessBase::get() ),
+			m_root{ nullptr },
+			m_first{ nullptr },
+			m_last{ nullptr },
+			m_size{ 0 },
+			m_allocator{ std::move( other.m_allocator ) }
+		{
+			steal( other );
+		}
+
+		RedBlackTree & operator=( RedBlackTree && other )
+		{
+			if( this == &other )
+			{
+				return *this;
+			}
+			clear();
+			LessBase::get() = other.LessBase::get();
+
+			if constexpr( NodeAllocTraits::
+			              propagate_on_container_move_assignment::value )
+			{
+				m_allocator = std::move( other.m_allocator );
+			}
+			else if( !( m_allocator == other.m_allocator ) )
+			{
+				// Nodes cannot change allocator, move keys instead.
+				moveNodes( other );
+				return *this;
+			}
+			steal( other );
+			return *this;
+		}
+
+		~RedBlackTree()
+		{
+			clear();
+		}
+
+		bool add( KeyT const & key, Node * & node )
+		{
+			// Search for matching node.
+			Node * nearest = nullptr;
+			bool lessThan = false;
+
+			if( find( key, nearest, lessThan ) )
+			{
+				node = nearest;
+				return false;
+			}
+
+			// Matching node not found, create new node.
+			node = createNode( key );
+			insertNode( node, nearest, lessThan );
+			return true;
+		}
+
+		Node * add( KeyT const & key )
+		{
+			Node * node = nullptr;
+			add( key, node );
+			return node;
+		}
+
+		bool add( KeyT && key, Node * & node )
+		{
+			Node * nearest = nullptr;
+			bool lessThan = false;
+
+			if( find( key, nearest, lessThan ) )
+			{
+				node = nearest;
+				return false;
+			}
+			node = createNode( std::move( key ) );
+			insertNode( node, nearest, lessThan );
+			return true;
+		}
+
+		Node * add( KeyT && key )
+		{
+			Node * node = nullptr;
+			add( std::move( key ), node );
+			return node;
+		}
+
+		// Constructs a key in place, discarding it if already present.
+		template< class... _Args >
+		std::pair< Node *, bool > emplace( _Args && ... args )
+		{
+			return emplaceNode( std::forward< _Args >( args )... );
+		}
+
+		// Adds key as std::set::emplace_hint does, in amortised constant
+		// time when key belongs just before or after hint. Returns the
+		// position of the new or already present key.
+		iterator add( const_iterator hint, KeyT const & key )
+		{
+			Node * nearest = nullptr;
+			bool lessThan = false;
+
+			if( findHint( hint.m_node, key, nearest, lessThan ) )
+			{
+				return iterator( nearest, this );
+			}
+			Node * node = createNode( key );
+			insertNode( node, nearest, lessThan );
+			return iterator( node, this );
+		}
+
+		iterator add( const_iterator hint, KeyT && key )
+		{
+			Node * nearest = nullptr;
+			bool lessThan = false;
+
+			if( findHint( hint.m_node, key, nearest, lessThan ) )
+			{
+				return iterator( nearest, this );
+			}
+			Node * node = createNode( std::move( key ) );
+			insertNode( node, nearest, lessThan );
+			return iterator( node, this );
+		}
+
+		template< class... _Args >
+		iterator emplaceHint( const_iterator hint, _Args && ... args )
+		{
+			Node * node = createNode( std::forward< _Args >( args )... );
+			Node * nearest = nullptr;
+			bool lessThan = false;
+
+			if( findHint( hint.m_node, node->getKey(), nearest, lessThan ) )
+			{
+				destroyNode( node );
+				return iterator( nearest, this );
+			}
+			insertNode( node, nearest, lessThan );
+			return iterator( node, this );
+		}
+
+		// Adds a batch of keys, returning how many were new. The batch is
+		// sorted first, then either inserted with each search starting
+		// from the previous insertion or, when several times larger than the
+		// tree, merged with the existing nodes and rebuilt in linear time.
+		template< class _FirstIter, class _LastIter >
+		SizeT addMany( _FirstIter first, _LastIter last )
+		{
+			std::vector< KeyT > keys;
+
+			while( first != last )
+			{
+				keys.emplace_back( *first );
+				++first;
+			}
+			auto lessFunc = [ this ]( KeyT const & k1, KeyT const & k2 )
+			{
+				return less( k1, k2 );
+			};
+			std::sort( keys.begin(), keys.end(), lessFunc );
+			keys.erase( std::unique( keys.begin(), keys.end(),
+				[ this ]( KeyT const & k1, KeyT const & k2 )
+				{
+					return !less( k1, k2 );
+				} ), keys.end() );
+
+			if( keys.size() >= m_size * MERGE_RATIO )
+			{
+				return mergeSorted( keys );
+			}
+			return insertSorted( keys );
+		}
+
+		bool remove( KeyT const & key, Node * & next )
+		{
+			return removeKey( key, next );
+		}
+
+		template< class _K, class = IfTransparentT< _K > >
+		bool remove( _K const & key, Node * & next )
+		{
+			return removeKey( key, next );
+		}
+
+		bool remove( Node * node, Node * & next )
+		{
+			assert( node != nullptr );
+
+			m_size -= 1;
+
+			bool isFirst = ( node == m_first );
+			bool isLast = ( node == m_last );
+			Node * previous = nullptr;
+
+			if( isLast && m_size > 0 )
+			{
+				previous = node->getPrevious();
+			}
+
+			// Check for leaf node.
+			Node * successor = getNextLargestChild( node );
+			next = successor;
+
+			if( successor != nullptr )
+			{
+				// Node is not a leaf participant.
+				countStat( TreeStats::SWAPS );
+				swap( node, successor );
+
+				if( node == m_root )
+				{
+					m_root = successor;
+				}
+			}
+
+			// Node is a leaf participant.
+			Node * parent = node->getParent();
+			Node * left = node->getLeftChild();
+
+			if( parent != nullptr )
+			{
+				// Without a swap, next is the next largest parent of leaf.
+				if( successor == nullptr )
+				{
+					if( node->isLessThanParent() )
+					{
+						next = parent;
+					}
+					else
+					{
+						next = getNextLargestParent( parent );
+					}
+				}
+
+				// Check colour of node.
+				if( node->isBlack() )
+				{
+					if( left != nullptr && left->isRed() )
+					{
+						// Node is black participant in a leaf 3-node.
+						assert( left->getLeftChild() == nullptr );
+
+						setChild( parent, left, node->isLessThanParent() );
+						left->setBlack();
+						updateSizeToRoot( parent );
+						destroyNode( node );
+					}
+					else
+					{
+						// Node is leaf 2-node.
+						assert( node != m_root );
+
+						while( node != m_root )
+						{
+							node = rem( node );
+						}
+					}
+				}
+				else
+				{
+					// Node is red participant in a leaf 3-node.
+					assert( left == nullptr );
+					parent->setLeftChild( nullptr );
+					updateSizeToRoot( parent );
+					destroyNode( node );
+				}
+			}
+			else
+			{
+				// Node is both leaf and root.
+				assert( node->isBlack() );
+
+				if( left != nullptr && left->isRed() )
+				{
+					// Root node is a 3-node.
+					assert( m_size == 1 );
+					left->setParent( nullptr );
+					left->setBlack();
+				}
+				m_root = left;
+				destroyNode( node );
+			}
+
+			if( isFirst )
+			{
+				m_first = next;
+			}
+
+			if( isLast )
+			{
+				m_last = previous;
+			}
+			checkAfterChange();
+			return true;
+		}
+
+		// Removes the key at position, returning the position after it.
+		iterator erase( const_iterator position )
+		{
+			assert( position.m_node != nullptr );
+
+			Node * next = nullptr;
+			remove( const_cast< Node * >( position.m_node ), next );
+			return iterator( next, this );
+		}
+
+		bool remove( KeyT const & key )
+		{
+			Node * next = nullptr;
+			return removeKey( key, next );
+		}
+
+		template< class _K, class = IfTransparentT< _K > >
+		bool remove( _K const & key )
+		{
+			Node * next = nullptr;
+			return removeKey( key, next );
+		}
+
+		bool remove( Node * node )
+		{
+			Node * next = nullptr;
+			return remove( node, next );
+		}
+
+		Node * find( KeyT const & key )
+		{
+			return findNode( key );
+		}
+
+		Node const * find( KeyT const & key ) const
+		{
+			return const_cast< RedBlackTree * >( this )->findNode( key );
+		}
+
+		template< class _K, class = IfTransparentT< _K > >
+		Node * find( _K const & key )
+		{
+			return findNode( key );
+		}
+
+		template< class _K, class = IfTransparentT< _K > >
+		Node const * find( _K const & key ) const
+		{
+			return const_cast< RedBlackTree * >( this )->findNode( key );
+		}
+
+		bool contains( KeyT const & key ) const
+		{
+			return ( find( key ) != nullptr );
+		}
+
+		template< class _K, class = IfTransparentT< _K > >
+		bool contains( _K const & key ) const
+		{
+			return ( find( key ) != nullptr );
+		}
+
+		// Looks up every key of a forward range, writing the matching node
+		// or nullptr for each to results. Descents run interleaved so that
+		// their cache misses overlap.
+		template< class _FirstIter, class _LastIter, class _OutIter >
+		_OutIter findMany( _FirstIter first, _LastIter last, _OutIter results )
+		{
+			findEach( first, last, [ & ]( Node * node )
+			{
+				*results = node;
+				++results;
+			} );
+			return results;
+		}
+
+		template< class _FirstIter, class _LastIter, class _OutIter >
+		_OutIter findMany( _FirstIter first, _LastIter last,
+		                   _OutIter results ) const
+		{
+			findEach( first, last, [ & ]( Node const * node )
+			{
+				*results = node;
+				++results;
+			} );
+			return results;
+		}
+
+		template< class _FirstIter, class _LastIter, class _OutIter >
+		_OutIter containsMany( _FirstIter first, _LastIter last,
+		                       _OutIter results ) const
+		{
+			findEach( first, last, [ & ]( Node const * node )
+			{
+				*results = ( node != nullptr );
+				++results;
+			} );
+			return results;
+		}
+
+		SizeT getSize() const
+		{
+			return m_size;
+		}
+
+		// Returns the node holding the key at index in sorted order, or
+		// nullptr if index is out of range.
+		Node * select( SizeT index )
+		{
+			static_assert( ORDER_STATISTICS,
+			               "select() requires ORDER_STATISTICS" );
+
+			Node * node = m_root;
+
+			while( node != nullptr )
+			{
+				SizeT leftSize = getSubtreeSize( node->getLeftChild() );
+
+				if( index < leftSize )
+				{
+					node = node->getLeftChild();
+				}
+				else if( index > leftSize )
+				{
+					index -= leftSize + 1;
+					node = node->getRightChild();
+				}
+				else
+				{
+					break;
+				}
+			}
+			return node;
+		}
+
+		Node const * select( SizeT index ) const
+		{
+			return const_cast< RedBlackTree * >( this )->select( index );
+		}
+
+		// Returns the number of keys less than key.
+		SizeT rank( KeyT const & key ) const
+		{
+			return getRank( key );
+		}
+
+		template< class _K, class = IfTransparentT< _K > >
+		SizeT rank( _K const & key ) const
+		{
+			return getRank( key );
+		}
+
+		// Returns the index of node in sorted order.
+		SizeT getIndex( Node const * node ) const
+		{
+			static_assert( ORDER_STATISTICS,
+			               "getIndex() requires ORDER_STATISTICS" );
+			assert( node != nullptr );
+
+			SizeT index = getSubtreeSize( node->getLeftChild() );
+
+			for( Node const * parent = node->getParent(); parent != nullptr;
+			     parent = parent->getParent() )
+			{
+				if( node->isGreaterThanParent() )
+				{
+					index += getSubtreeSize( parent->getLeftChild() ) + 1;
+				}
+				node = parent;
+			}
+			return index;
+		}
+
+		// Returns the number of keys in the half-open range [low, high).
+		SizeT countRange( KeyT const & low, KeyT const & high ) const
+		{
+			return getRangeCount( low, high );
+		}
+
+		template< class _K1, class _K2,
+		          class = IfTransparentT< _K1 >, class = IfTransparentT< _K2 > >
+		SizeT countRange( _K1 const & low, _K2 const & high ) const
+		{
+			return getRangeCount( low, high );
+		}
+
+		// Returns the node holding the smallest key not less than key, or
+		// nullptr if there is none.
+		Node * lowerBound( KeyT const & key )
+		{
+			return findBound( key, false );
+		}
+
+		Node const * lowerBound( KeyT const & key ) const
+		{
+			return findBound( key, false );
+		}
+
+		template< class _K, class = IfTransparentT< _K > >
+		Node * lowerBound( _K const & key )
+		{
+			return findBound( key, false );
+		}
+
+		template< class _K, class = IfTransparentT< _K > >
+		Node const * lowerBound( _K const & key ) const
+		{
+			return findBound( key, false );
+		}
+
+		// Returns the node holding the smallest key greater than key, or
+		// nullptr if there is none.
+		Node * upperBound( KeyT const & key )
+		{
+			return findBound( key, true );
+		}
+
+		Node const * upperBound( KeyT const & key ) const
+		{
+			return findBound( key, true );
+		}
+
+		template< class _K, class = IfTransparentT< _K > >
+		Node * upperBound( _K const & key )
+		{
+			return findBound( key, true );
+		}
+
+		template< class _K, class = IfTransparentT< _K > >
+		Node const * upperBound( _K const & key ) const
+		{
+			return findBound( key, true );
+		}
+
+		// Returns the positions spanning the keys equivalent to key.
+		std::pair< iterator, iterator > equalRange( KeyT const & key )
+		{
+			return getEqualRange< iterator >( key );
+		}
+
+		std::pair< const_iterator, const_iterator >
+		equalRange( KeyT const & key ) const
+		{
+			return getEqualRange< const_iterator >( key );
+		}
+
+		template< class _K, class = IfTransparentT< _K > >
+		std::pair< iterator, iterator > equalRange( _K const & key )
+		{
+			return getEqualRange< iterator >( key );
+		}
+
+		template< class _K, class = IfTransparentT< _K > >
+		std::pair< const_iterator, const_iterator >
+		equalRange( _K const & key ) const
+		{
+			return getEqualRange< const_iterator >( key );
+		}
+
+		// Removes the keys in [low, high) and returns their number. The
+		// range is split off the tree and freed without rebalancing, which
+		// takes logarithmic time besides freeing the nodes.
+		SizeT removeRange( KeyT const & low, KeyT const & high )
+		{
+			return removeKeyRange( low, high );
+		}
+
+		template< class _K1, class _K2,
+		          class = IfTransparentT< _K1 >, class = IfTransparentT< _K2 > >
+		SizeT removeRange( _K1 const & low, _K2 const & high )
+		{
+			return removeKeyRange( low, high );
+		}
+
+		// Moves the keys not less than key into a new tree sharing this
+		// tree's comparator and allocator. Takes logarithmic time, plus
+		// counting the smaller part when ORDER_STATISTICS is off.
+		RedBlackTree split( KeyT const & key )
+		{
+			return splitKey( key );
+		}
+
+		template< class _K, class = IfTransparentT< _K > >
+		RedBlackTree split( _K const & key )
+		{
+			return splitKey( key );
+		}
+
+		// Appends every key of other, which must all be greater than the
+		// keys of this tree, leaving other empty. Takes logarithmic time
+		// when the allocators compare equal; otherwise the keys are moved
+		// into new nodes.
+		void join( RedBlackTree && other )
+		{
+			assert( this != &other );
+
+			if( other.m_root == nullptr )
+			{
+				return;
+			}
+			assert( m_root == nullptr ||
+			        less( m_last->getKey(), other.m_first->getKey() ) );
+
+			if( !( m_allocator == other.m_allocator ) )
+			{
+				for( Node * node = other.m_first; node != nullptr; )
+				{
+					Node * next = node->getNext();
+					add( end(), std::move( node->m_key ) );
+					node = ( next != node ? next : nullptr );
+				}
+				other.clear();
+				return;
+			}
+
+			if( m_root == nullptr )
+			{
+				steal( other );
+				return;
+			}
+
+			// Detach the smallest key of other to join the trees around.
+			Node * middle = nullptr;
+			Node * lower = nullptr;
+			Node * upper = nullptr;
+			splitTree( other.m_root, other.m_first->getKey(), lower, upper,
+			           middle );
+			assert( lower == nullptr && middle == other.m_first );
+
+			m_root = joinTrees( m_root, middle, upper );
+			m_last = other.m_last;
+			m_size += other.m_size;
+			other.m_root = nullptr;
+			other.m_first = nullptr;
+			other.m_last = nullptr;
+			other.m_size = 0;
+			checkAfterChange();
+		}
+
+		// Adds every key of other, leaving it empty. Keys present in both
+		// trees keep this tree's node. Splits and joins the trees around
+		// their roots, which takes O( m log( n / m + 1 ) ) time for sizes
+		// m <= n.
+		void unionWith( RedBlackTree && other )
+		{
+			mergeUnion( other, 0 );
+		}
+
+		// With parallel, large halves are merged on other threads, so the
+		// allocator must then be safe to share between threads. The
+		// parallel set operations are only offered with PARALLEL.
+		template< bool _Parallel = PARALLEL,
+		          class = typename std::enable_if< _Parallel >::type >
+		void unionWith( RedBlackTree && other, bool parallel )
+		{
+			mergeUnion( other, getForkDepth( parallel ) );
+		}
+
+		// Removes the keys absent from other, in the same time as unionWith.
+		void intersectWith( RedBlackTree const & other )
+		{
+			mergeIntersection( other, 0 );
+		}
+
+		template< bool _Parallel = PARALLEL,
+		          class = typename std::enable_if< _Parallel >::type >
+		void intersectWith( RedBlackTree const & other, bool parallel )
+		{
+			mergeIntersection( other, getForkDepth( parallel ) );
+		}
+
+		// Removes the keys present in other, in the same time as unionWith.
+		void differenceWith( RedBlackTree const & other )
+		{
+			mergeDifference( other, 0 );
+		}
+
+		template< bool _Parallel = PARALLEL,
+		          class = typename std::enable_if< _Parallel >::type >
+		void differenceWith( RedBlackTree const & other, bool parallel )
+		{
+			mergeDifference( other, getForkDepth( parallel ) );
+		}
+
+		// Calls func with every key, from several threads at once and in no
+		// particular order. The keys are split into runs of about equal
+		// length, exactly so with ORDER_STATISTICS, which idle threads take
+		// in turn.
+		template< class _Func >
+		void parallelForEach( _Func && func ) const
+		{
+			std::vector< Node const * > starts = getChunkStarts();
+
+			runChunks( starts, [ & ]( SizeT, Node const * node,
+			                          Node const * stop )
+			{
+				for( ; node != stop; node = getNextNode( node ) )
+				{
+					func( node->getKey() );
+				}
+			} );
+		}
+
+		// Returns init combined through reduce with transform of every key
+		// in ascending order, as std::transform_reduce does. Runs of keys
+		// are reduced on several threads as in parallelForEach, so reduce
+		// must be associative.
+		template< class _T, class _ReduceOp, class _TransformOp >
+		_T parallelReduce( _T init, _ReduceOp reduce,
+		                   _TransformOp transform ) const
+		{
+			std::vector< Node const * > starts = getChunkStarts();
+			std::vector< std::optional< _T > > partials( starts.size() );
+
+			runChunks( starts, [ & ]( SizeT index, Node const * node,
+			                          Node const * stop )
+			{
+				if( node == stop )
+				{
+					return;
+				}
+				std::optional< _T > & partial = partials[ index ];
+				partial.emplace( transform( node->getKey() ) );
+
+				while( ( node = getNextNode( node ) ) != stop )
+				{
+					*partial = reduce( std::move( *partial ),
+					                   transform( node->getKey() ) );
+				}
+			} );
+
+			for( auto & partial: partials )
+			{
+				if( partial )
+				{
+					init = reduce( std::move( init ), std::move( *partial ) );
+				}
+			}
+			return init;
+		}
+
+		// Copies the keys into an immutable tree whose lookups run several
+		// times faster, in linear time. Needs FrozenRedBlackTree.h.
+		FrozenRedBlackTree< KeyT, LessT, AllocT > freeze() const
+		{
+			return FrozenRedBlackTree< KeyT, LessT, AllocT >( *this );
+		}
+
+		// Bytes serialize() writes.
+		SizeT getSerializedSize() const
+		{
+			return detail::getSerialOffset< KeyT >() + m_size * sizeof( KeyT );
+		}
+
+		// Writes the keys in ascending order behind a header, for keys that
+		// are trivially copyable. Buffer takes getSerializedSize() bytes
+		// and must be aligned for KeyT to be read in place by a
+		// FrozenTreeView.
+		void serialize( void * buffer ) const
+		{
+			static_assert( std::is_trivially_copyable< KeyT >::value,
+			               "Keys are written as their bytes" );
+
+			char * bytes = static_cast< char * >( buffer );
+			writeSerialHeader( bytes );
+			bytes += detail::getSerialOffset< KeyT >();
+
+			for( Node const * node = m_first; node != nullptr;
+			     node = getNextNode( node ) )
+			{
+				std::memcpy( bytes, &node->getKey(), sizeof( KeyT ) );
+				bytes += sizeof( KeyT );
+			}
+		}
+
+		// Returns whether out took every byte.
+		bool serialize( std::ostream & out ) const
+		{
+			static_assert( std::is_trivially_copyable< KeyT >::value,
+			               "Keys are written as their bytes" );
+
+			char header[ detail::getSerialOffset< KeyT >() ];
+			writeSerialHeader( header );
+			out.write( header, sizeof( header ) );
+
+			for( Node const * node = m_first; node != nullptr && out;
+			     node = getNextNode( node ) )
+			{
+				out.write( reinterpret_cast< char const * >( &node->getKey() ),
+				           sizeof( KeyT ) );
+			}
+			return bool( out );
+		}
+
+		// Replaces the keys with those serialize() wrote to buffer, in
+		// linear time. Returns false and leaves the tree empty unless size
+		// bytes hold a serialized tree of KeyT with keys in order.
+		bool deserialize( void const * buffer, SizeT size )
+		{
+			static_assert( std::is_trivially_copyable< KeyT >::value,
+			               "Keys are read as their bytes" );
+
+			SizeT offset = detail::getSerialOffset< KeyT >();
+			std::uint64_t count = 0;
+			clear();
+
+			if( size < offset ||
+			    !detail::readSerialHeader< KeyT >( buffer, count ) ||
+			    count > ( size - offset ) / sizeof( KeyT ) )
+			{
+				return false;
+			}
+			char const * bytes = static_cast< char const * >( buffer ) + offset;
+
+			if( reinterpret_cast< std::uintptr_t >( bytes ) %
+			    alignof( KeyT ) == 0 )
+			{
+				return loadSorted( reinterpret_cast< KeyT const * >( bytes ),
+				                   SizeT( count ) );
+			}
+			std::vector< KeyT > keys;
+			keys.resize( SizeT( count ) );
+
+			// An empty vector may have no storage to copy to.
+			if( !keys.empty() )
+			{
+				std::memcpy( keys.data(), bytes, keys.size() * sizeof( KeyT ) );
+			}
+			return loadSorted( keys.data(), keys.size() );
+		}
+
+		// Reads keys serialize() wrote to in, as above. Keys are read in
+		// blocks, so that a damaged count fails at the end of the stream
+		// rather than by allocating for it.
+		bool deserialize( std::istream & in )
+		{
+			static_assert( std::is_trivially_copyable< KeyT >::value,
+			               "Keys are read as their bytes" );
+
+			char header[ detail::getSerialOffset< KeyT >() ];
+			std::uint64_t count = 0;
+			clear();
+
+			if( !in.read( header, sizeof( header ) ) ||
+			    !detail::readSerialHeader< KeyT >( header, count ) )
+			{
+				return false;
+			}
+			std::vector< KeyT > keys;
+
+			while( keys.size() < count )
+			{
+				SizeT done = keys.size();
+				SizeT block = SizeT( std::min< std::uint64_t >( count - done,
+				                                                 SERIAL_BLOCK ) );
+				keys.resize( done + block );
+
+				if( !in.read( reinterpret_cast< char * >( keys.data() + done ),
+				              std::streamsize( block * sizeof( KeyT ) ) ) )
+				{
+					return false;
+				}
+			}
+			return loadSorted( keys.data(), keys.size() );
+		}
+
+		iterator begin()
+		{
+			return iterator( m_first, this );
+		}
+
+		const_iterator begin() const
+		{
+			return const_iterator( m_first, this );
+		}
+
+		const_iterator cbegin() const
+		{
+			return begin();
+		}
+
+		iterator end()
+		{
+			return iterator( nullptr, this );
+		}
+
+		const_iterator end() const
+		{
+			return const_iterator( nullptr, this );
+		}
+
+		const_iterator cend() const
+		{
+			return end();
+		}
+
+		reverse_iterator rbegin()
+		{
+			return reverse_iterator( end() );
+		}
+
+		const_reverse_iterator rbegin() const
+		{
+			return const_reverse_iterator( end() );
+		}
+
+		reverse_iterator rend()
+		{
+			return reverse_iterator( begin() );
+		}
+
+		const_reverse_iterator rend() const
+		{
+			return const_reverse_iterator( begin() );
+		}
+
+		AllocT getAllocator() const
+		{
+			return AllocT( m_allocator );
+		}
+
+		LessT getLess() const
+		{
+			return LessBase::get();
+		}
+
+		void clear()
+		{
+			if( m_root == nullptr )
+			{
+				return;
+			}
+
+			// Drop the whole arena when no one else shares it.
+			if( releaseArena() )
+			{
+				m_root = nullptr;
+				m_first = nullptr;
+				m_last = nullptr;
+				m_size = 0;
+				return;
+			}
+
+			destroyTree( m_root );
+			m_root = nullptr;
+			m_first = nullptr;
+			m_last = nullptr;
+			m_size = 0;
+		}
+
+		// Snapshot of the counts since construction or resetStats(). Copies
+		// and moves of a tree start counting afresh.
+		TreeStats getStats() const
+		{
+			static_assert( STATISTICS, "Counting needs the STATISTICS option" );
+
+			TreeStats stats;
+
+			for( int i = 0; i < TreeStats::COUNTER_COUNT; ++i )
+			{
+				stats.counts[ i ] = StatsBase::m_counts[ i ].load(
+					std::memory_order_relaxed );
+			}
+			return stats;
+		}
+
+		void resetStats()
+		{
+			static_assert( STATISTICS, "Counting needs the STATISTICS option" );
+
+			for( auto & counter: StatsBase::m_counts )
+			{
+				counter.store( 0, std::memory_order_relaxed );
+			}
+		}
+
+		// First broken invariant check() finds, with the node it concerns
+		// if any.
+		struct Violation
+		{
+			char const *	message = nullptr;
+			Node const *	node = nullptr;
+
+			explicit operator bool() const
+			{
+				return ( message != nullptr );
+			}
+		};
+
+		// Checks the ordering, links, colours, black heights, subtree sizes
+		// and cached size and extremes in one in-order pass, in linear
+		// time.
+		Violation check() const
+		{
+			Violation violation;
+
+			if( m_root != nullptr && m_root->getParent() != nullptr )
+			{
+				return { "root has a parent", m_root };
+			}
+
+			if( m_root != nullptr && m_root->isRed() )
+			{
+				return { "root is red", m_root };
+			}
+			Node const * previous = nullptr;
+			SizeT count = 0;
+			checkTree( m_root, 0, previous, count, violation );
+
+			if( violation )
+			{
+				return violation;
+			}
+
+			if( previous != m_last )
+			{
+				return { "last node is not the largest", m_last };
+			}
+
+			if( count != m_size )
+			{
+				return { "size differs from the number of nodes", nullptr };
+			}
+			return violation;
+		}
+
+		bool validate() const
+		{
+			return !check();
+		}
+
+		template< class _K1, class _K2 >
+		bool less( _K1 const & k1, _K2 const & k2 ) const
+		{
+			return LessBase::get()( k1, k2 );
+		}
+
+		protected:
+
+		// Constructs a node in place and links it unless its key is taken.
+		template< class... _Args >
+		std::pair< Node *, bool > emplaceNode( _Args && ... args )
+		{
+			Node * node = createNode( std::forward< _Args >( args )... );
+			Node * nearest = nullptr;
+			bool lessThan = false;
+
+			if( find( node->getKey(), nearest, lessThan ) )
+			{
+				destroyNode( node );
+				return { nearest, false };
+			}
+			insertNode( node, nearest, lessThan );
+			return { node, true };
+		}
+
+		// Looks up key first and constructs a node only when it is absent.
+		template< class _K, class... _Args >
+		std::pair< Node *, bool > emplaceKey( _K const & key,
+		                                      _Args && ... args )
+		{
+			Node * nearest = nullptr;
+			bool lessThan = false;
+
+			if( find( key, nearest, lessThan ) )
+			{
+				return { nearest, false };
+			}
+			Node * node = createNode( std::forward< _Args >( args )... );
+			insertNode( node, nearest, lessThan );
+			return { node, true };
+		}
+
+		private:
+
+		void countStat( TreeStats::Counter counter, SizeT amount = 1 ) const
+		{
+			if constexpr( STATISTICS )
+			{
+				StatsBase::addCount( counter, amount );
+			}
+		}
+
+		void countSearch( SizeT depth, SizeT comparisons ) const
+		{
+			countStat( TreeStats::SEARCHES );
+			countStat( TreeStats::DEPTH, depth );
+			countStat( TreeStats::COMPARISONS, comparisons );
+		}
+
+		// Adds the counts of a tree that worked on this tree's behalf.
+		void addStats( RedBlackTree const & other ) const
+		{
+			if constexpr( STATISTICS )
+			{
+				TreeStats stats = other.getStats();
+
+				for( int i = 0; i < TreeStats::COUNTER_COUNT; ++i )
+				{
+					countStat( TreeStats::Counter( i ), stats.counts[ i ] );
+				}
+			}
+		}
+
+		// Returns the black height of the subtree at node, visiting its
+		// nodes in order after previous and counting them. Stops at the
+		// first violation, before a broken tree could be walked forever.
+		SizeT checkTree( Node const * node, SizeT depth, Node const * & previous,
+		                 SizeT & count, Violation & violation ) const
+		{
+			if( node == nullptr )
+			{
+				return 0;
+			}
+			Node const * left = node->getLeftChild();
+			Node const * right = node->getRightChild();
+
+			if( depth > 2 * std::numeric_limits< SizeT >::digits )
+			{
+				violation = { "tree deeper than any valid tree", node };
+			}
+			else if( left != nullptr && ( left->getParent() != node ||
+			                              !left->isLessThanParent() ) )
+			{
+				violation = { "left child not linked back as less", left };
+			}
+			else if( right != nullptr && ( right->getParent() != node ||
+			                               right->isLessThanParent() ) )
+			{
+				violation = { "right child not linked back as greater",
+				              right };
+			}
+			else if( right != nullptr && right->isRed() )
+			{
+				violation = { "right child is red", right };
+			}
+			else if( node->isRed() && left != nullptr && left->isRed() )
+			{
+				violation = { "red node has a red child", left };
+			}
+
+			if( violation )
+			{
+				return 0;
+			}
+			SizeT height = checkTree( left, depth + 1, previous, count,
+			                          violation );
+
+			if( violation )
+			{
+				return 0;
+			}
+
+			if( previous == nullptr ? node != m_first :
+			    !less( previous->getKey(), node->getKey() ) )
+			{
+				violation = { previous == nullptr ?
+				              "first node is not the smallest" :
+				              "keys out of order", node };
+				return 0;
+			}
+			previous = node;
+
+			if( ++count > m_size )
+			{
+				violation = { "more nodes than the size", node };
+				return 0;
+			}
+
+			if( checkTree( right, depth + 1, previous, count,
+			               violation ) != height && !violation )
+			{
+				violation = { "children differ in black height", node };
+			}
+
+			if constexpr( ORDER_STATISTICS )
+			{
+				if( !violation && node->m_subtreeSize != 1 +
+				    getSubtreeSize( left ) + getSubtreeSize( right ) )
+				{
+					violation = { "wrong subtree size", node };
+				}
+			}
+			return height + ( node->isBlack() ? 1 : 0 );
+		}
+
+		// With UTIL_REDBLACKTREE_CHECK_INVARIANTS defined, builds without
+		// NDEBUG check the whole tree after every change. That costs linear
+		// time per change, for canary builds and debugging only.
+		void checkAfterChange() const
+		{
+#if defined( UTIL_REDBLACKTREE_CHECK_INVARIANTS ) && !defined( NDEBUG )
+			assert( !check() );
+#endif
+		}
+
+		void insertNode( Node * node, Node * nearest, bool lessThan )
+		{
+			m_size += 1;
+
+			// Check for empty container.
+			if( nearest == nullptr )
+			{
+				assert( m_root == nullptr );
+				m_root = node;
+				m_first = node;
+				m_last = node;
+				checkAfterChange();
+				return;
+			}
+			node->setParent( nearest );
+			node->setLessThanParent( lessThan );
+
+			// Keep cached extremes current.
+			if( lessThan && nearest == m_first )
+			{
+				m_first = node;
+			}
+			else if( !lessThan && nearest == m_last )
+			{
+				m_last = node;
+			}
+
+			// Add node to tree.
+			Node * freeNode = node;
+
+			while( freeNode != m_root )
+			{
+				freeNode = add( freeNode );
+			}
+			checkAfterChange();
+		}
+
+		template< class... _Args >
+		Node * createNode( _Args && ... args )
+		{
+			Node * node = NodeAllocTraits::allocate( m_allocator, 1 );
+			countStat( TreeStats::ALLOCATIONS );
+
+			try
+			{
+				::new( static_cast< void * >( node ) )
+					Node( std::in_place, std::forward< _Args >( args )... );
+			}
+			catch( ... )
+			{
+				NodeAllocTraits::deallocate( m_allocator, node, 1 );
+				throw;
+			}
+			return node;
+		}
+
+		void destroyNode( Node * node )
+		{
+			node->~Node();
+			NodeAllocTraits::deallocate( m_allocator, node, 1 );
+			countStat( TreeStats::FREES );
+		}
+
+		// Clones every node of other. This tree must be empty.
+		void copyNodes( RedBlackTree const & other )
+		{
+			assert( m_root == nullptr );
+
+			if( other.m_root != nullptr )
+			{
+				m_root = cloneTree( other.m_root );
+				m_size = other.m_size;
+				updateExtremes();
+				checkAfterChange();
+			}
+		}
+
+		Node * cloneTree( Node const * source )
+		{
+			Node * node = createNode( source->getKey() );
+			node->setParent( nullptr );
+			node->setRed( source->isRed() );
+			node->setLessThanParent( source->isLessThanParent() );
+
+			try
+			{
+				for( bool left: { true, false } )
+				{
+					Node const * child = source->m_children[ !left ];
+
+					if( child != nullptr )
+					{
+						Node * copy = cloneTree( child );
+						copy->setParent( node );
+						node->setChild( left, copy );
+					}
+				}
+			}
+			catch( ... )
+			{
+				destroyTree( node );
+				throw;
+			}
+			updateSize( node );
+			return node;
+		}
+
+		// Takes over every node of other, which must be compatible with
+		// this tree's allocator. This tree must be empty.
+		void steal( RedBlackTree & other )
+		{
+			assert( m_root == nullptr );
+
+			m_root = other.m_root;
+			m_first = other.m_first;
+			m_last = other.m_last;
+			m_size = other.m_size;
+			other.m_root = nullptr;
+			other.m_first = nullptr;
+			other.m_last = nullptr;
+			other.m_size = 0;
+		}
+
+		// Rebuilds other's keys in nodes of this tree's allocator.
+		void moveNodes( RedBlackTree & other )
+		{
+			assert( m_root == nullptr );
+
+			Node * vine = nullptr;
+			Node * tail = nullptr;
+
+			try
+			{
+				for( Node * node = other.m_first; node != nullptr; )
+				{
+					Node * copy = createNode( std::move( node->m_key ) );
+					Node * next = node->getNext();
+
+					if( tail != nullptr )
+					{
+						tail->setRightChild( copy );
+					}
+					else
+					{
+						vine = copy;
+					}
+					tail = copy;
+					node = ( next != node ? next : nullptr );
+				}
+			}
+			catch( ... )
+			{
+				destroyVine( vine );
+				other.clear();
+				throw;
+			}
+			buildFromVine( vine, other.m_size );
+			other.clear();
+		}
+
+		bool releaseArena()
+		{
+			// Nodes too large or too aligned for the arena's size classes
+			// come from the global heap, which releasing the arena misses.
+			if constexpr( detail::IsPoolAllocator< NodeAllocT >::value &&
+			              std::is_trivially_destructible< KeyT >::value &&
+			              sizeof( Node ) <= PoolArena::MAX_BLOCK &&
+			              alignof( Node ) <= PoolArena::GRANULARITY )
+			{
+				std::shared_ptr< PoolArena > const & arena =
+					m_allocator.getArena();
+
+				if( arena.use_count() == 1 )
+				{
+					arena->release();
+					return true;
+				}
+			}
+			return false;
+		}
+
+		template< class _K >
+		Node * findBound( _K const & key, bool upper ) const
+		{
+			Node * node = m_root;
+			Node * bound = nullptr;
+			SizeT depth = 0;
+
+			while( node != nullptr )
+			{
+				++depth;
+
+				if( upper ? less( key, node->getKey() )
+				          : !less( node->getKey(), key ) )
+				{
+					bound = node;
+					node = node->getLeftChild();
+				}
+				else
+				{
+					node = node->getRightChild();
+				}
+			}
+			countSearch( depth, depth );
+			return bound;
+		}
+
+		template< class _IterT, class _K >
+		std::pair< _IterT, _IterT > getEqualRange( _K const & key ) const
+		{
+			Node * first = findBound( key, false );
+			Node * last = first;
+
+			if( first != nullptr && !less( key, first->getKey() ) )
+			{
+				Node * next = first->getNext();
+				last = ( next != first ? next : nullptr );
+			}
+			return { _IterT( first, this ), _IterT( last, this ) };
+		}
+
+		template< class _K >
+		RedBlackTree splitKey( _K const & key )
+		{
+			RedBlackTree result( LessBase::get(), AllocT( m_allocator ) );
+
+			if( m_root == nullptr )
+			{
+				return result;
+			}
+			Node * lower = nullptr;
+			Node * upper = nullptr;
+			Node * match = nullptr;
+			splitTree( m_root, key, lower, upper, match );
+
+			if( match != nullptr )
+			{
+				upper = joinTrees( nullptr, match, upper );
+			}
+			SizeT count = countUpper( lower, upper );
+			m_root = lower;
+			m_size -= count;
+			updateExtremes();
+			result.m_root = upper;
+			result.m_size = count;
+			result.updateExtremes();
+			checkAfterChange();
+			result.checkAfterChange();
+			return result;
+		}
+
+		// Number of keys in upper, the trees holding m_size keys together.
+		// Without subtree sizes both are walked in step, so that only the
+		// smaller one is covered.
+		SizeT countUpper( Node * lower, Node * upper ) const
+		{
+			if constexpr( ORDER_STATISTICS )
+			{
+				( void )lower;
+				return getSubtreeSize( upper );
+			}
+			else
+			{
+				auto getFirst = []( Node * node )
+				{
+					while( node != nullptr && node->getLeftChild() != nullptr )
+					{
+						node = node->getLeftChild();
+					}
+					return node;
+				};
+				auto getNext = []( Node * node )
+				{
+					Node * next = node->getNext();
+					return ( next != node ? next : nullptr );
+				};
+				lower = getFirst( lower );
+				upper = getFirst( upper );
+				SizeT count = 0;
+
+				while( true )
+				{
+					if( lower == nullptr )
+					{
+						return m_size - count;
+					}
+
+					if( upper == nullptr )
+					{
+						return count;
+					}
+					lower = getNext( lower );
+					upper = getNext( upper );
+					++count;
+				}
+			}
+		}
+
+		template< class _K1, class _K2 >
+		SizeT removeKeyRange( _K1 const & low, _K2 const & high )
+		{
+			if( m_root == nullptr || !less( low, high ) )
+			{
+				return 0;
+			}
+
+			// The first key kept above the range joins the pieces again.
+			Node * kept = findBound( high, false );
+			Node * tree = m_root;
+			Node * lower = nullptr;
+			Node * upper = nullptr;
+			Node * range = nullptr;
+			Node * match = nullptr;
+			m_root = nullptr;
+
+			if( kept != nullptr )
+			{
+				splitTree( tree, kept->getKey(), lower, upper, match );
+				assert( match == kept );
+				match = nullptr;
+			}
+			else
+			{
+				lower = tree;
+			}
+			splitTree( lower, low, lower, range, match );
+
+			// A key equal to low is split out on its own.
+			SizeT removed = destroyTree( range ) + destroyTree( match );
+
+			if( kept != nullptr )
+			{
+				m_root = joinTrees( lower, kept, upper );
+			}
+			else
+			{
+				m_root = lower;
+			}
+			m_size -= removed;
+			updateExtremes();
+			checkAfterChange();
+			return removed;
+		}
+
+		// Frees a detached subtree in post-order, no rebalancing required.
+		SizeT destroyTree( Node * node )
+		{
+			SizeT count = 0;
+
+			while( node != nullptr )
+			{
+				if( node->m_children[ 0 ] != nullptr )
+				{
+					// The right subtree is visited next, fetch it meanwhile.
+					if( node->m_children[ 1 ] != nullptr )
+					{
+						detail::prefetch( node->m_children[ 1 ] );
+					}
+					node = node->m_children[ 0 ];
+				}
+				else if( node->m_children[ 1 ] != nullptr )
+				{
+					node = node->m_children[ 1 ];
+				}
+				else
+				{
+					Node * parent = node->getParent();
+
+					if( parent != nullptr )
+					{
+						parent->setChild( node->isLessThanParent(), nullptr );
+					}
+					destroyNode( node );
+					node = parent;
+					++count;
+				}
+			}
+			return count;
+		}
+
+		// Splits the valid tree at root into the keys less than key, the
+		// keys greater than key and the node matching key, if any. The
+		// trees handed out have black roots and no parent.
+		template< class _K >
+		void splitTree( Node * root, _K const & key, Node * & low,
+		                Node * & high, Node * & match )
+		{
+			if( root == nullptr )
+			{
+				low = nullptr;
+				high = nullptr;
+				return;
+			}
+			Node * left = detachTree( root->getLeftChild() );
+			Node * right = detachTree( root->getRightChild() );
+			root->setLeftChild( nullptr );
+			root->setRightChild( nullptr );
+			detachTree( root );
+			updateSize( root );
+
+			if( less( key, root->getKey() ) )
+			{
+				Node * middle = nullptr;
+				splitTree( left, key, low, middle, match );
+				high = joinTrees( middle, root, right );
+			}
+			else if( less( root->getKey(), key ) )
+			{
+				Node * middle = nullptr;
+				splitTree( right, key, middle, high, match );
+				low = joinTrees( left, root, middle );
+			}
+			else
+			{
+				low = left;
+				high = right;
+				match = root;
+			}
+		}
+
+		// Makes a subtree a tree of its own. A red root turns black, which
+		// keeps it valid.
+		static Node * detachTree( Node * node )
+		{
+			if( node != nullptr )
+			{
+				node->setParent( nullptr );
+				node->setBlack();
+			}
+			return node;
+		}
+
+		static SizeT getBlackHeight( Node const * node )
+		{
+			SizeT height = 0;
+
+			for( ; node != nullptr; node = node->getLeftChild() )
+			{
+				height += node->isBlack();
+			}
+			return height;
+		}
+
+		// Joins two valid trees and an unlinked node, all keys of left
+		// being less than the key of middle and all of right greater.
+		// Middle is added to the taller tree as a free node at the height
+		// of the shorter one and the usual insertion fixup restores the
+		// balance. Uses m_root for the tree being fixed up.
+		Node * joinTrees( Node * left, Node * middle, Node * right )
+		{
+			SizeT leftHeight = getBlackHeight( left );
+			SizeT rightHeight = getBlackHeight( right );
+
+			if( leftHeight == rightHeight )
+			{
+				setLeftChild( middle, left );
+				setRightChild( middle, right );
+				updateSize( middle );
+				return middle;
+			}
+			Node * saved = m_root;
+
+			if( leftHeight > rightHeight )
+			{
+				// Walk down the right spine, which is all black.
+				Node * node = left;
+
+				for( SizeT height = leftHeight; height > rightHeight + 1;
+				     --height )
+				{
+					node = node->getRightChild();
+				}
+				setLeftChild( middle, node->getRightChild() );
+				setRightChild( middle, right );
+				node->setRightChild( nullptr );
+				middle->setParent( node );
+				middle->setGreaterThanParent();
+				m_root = left;
+			}
+			else
+			{
+				// Walk down the left spine, stepping over red nodes.
+				Node * node = right;
+
+				for( SizeT height = rightHeight; ; --height )
+				{
+					if( node->getLeftChild() != nullptr &&
+					    node->getLeftChild()->isRed() )
+					{
+						node = node->getLeftChild();
+					}
+
+					if( height == leftHeight + 1 )
+					{
+						break;
+					}
+					node = node->getLeftChild();
+				}
+				setLeftChild( middle, left );
+				setRightChild( middle, node->getLeftChild() );
+				node->setLeftChild( nullptr );
+				middle->setParent( node );
+				middle->setLessThanParent();
+				m_root = right;
+			}
+			updateSize( middle );
+			Node * freeNode = middle;
+
+			while( freeNode != m_root )
+			{
+				freeNode = add( freeNode );
+			}
+			Node * root = m_root;
+			m_root = saved;
+			return root;
+		}
+
+		// Joins two valid trees, all keys of left being less than those of
+		// right, around the smallest node of right.
+		Node * joinTrees( Node * left, Node * right )
+		{
+			if( left == nullptr || right == nullptr )
+			{
+				return ( left != nullptr ? left : right );
+			}
+			Node * first = right;
+
+			while( first->getLeftChild() != nullptr )
+			{
+				first = first->getLeftChild();
+			}
+			Node * lower = nullptr;
+			Node * upper = nullptr;
+			Node * match = nullptr;
+			splitTree( right, first->getKey(), lower, upper, match );
+			assert( lower == nullptr && match == first );
+			return joinTrees( left, first, upper );
+		}
+
+		// The set operations, forking to depth.
+		void mergeUnion( RedBlackTree & other, SizeT depth )
+		{
+			assert( this != &other );
+
+			if( !( m_allocator == other.m_allocator ) )
+			{
+				RedBlackTree moved( LessBase::get(), AllocT( m_allocator ) );
+				moved.moveNodes( other );
+				mergeUnion( moved, depth );
+				return;
+			}
+			SizeT duplicates = 0;
+			m_root = unionTrees( m_root, other.m_root, duplicates, depth );
+			m_size += other.m_size - duplicates;
+			other.m_root = nullptr;
+			other.m_first = nullptr;
+			other.m_last = nullptr;
+			other.m_size = 0;
+			updateExtremes();
+			checkAfterChange();
+		}
+
+		void mergeIntersection( RedBlackTree const & other, SizeT depth )
+		{
+			if( this == &other )
+			{
+				return;
+			}
+			SizeT removed = 0;
+			m_root = intersectTrees( m_root, other.m_root, removed, depth );
+			m_size -= removed;
+			updateExtremes();
+			checkAfterChange();
+		}
+
+		void mergeDifference( RedBlackTree const & other, SizeT depth )
+		{
+			if( this == &other )
+			{
+				clear();
+				return;
+			}
+			SizeT removed = 0;
+			m_root = differenceTrees( m_root, other.m_root, removed, depth );
+			m_size -= removed;
+			updateExtremes();
+			checkAfterChange();
+		}
+
+		// Set operations fork while both sides are at least this black
+		// height, about 2^height nodes.
+		static SizeT constexpr FORK_HEIGHT = 10;
+
+		static SizeT getForkDepth( bool parallel )
+		{
+			SizeT depth = 0;
+
+			if( parallel )
+			{
+				for( unsigned threads = std::thread::hardware_concurrency();
+				     threads > 1; threads = ( threads + 1 ) / 2 )
+				{
+					++depth;
+				}
+			}
+			return depth;
+		}
+
+		// Runs first on this tree and second on a tree of its own, which
+		// gives the fixup a root of its own. With depth left and large
+		// enough trees, second runs on another thread.
+		template< class _First, class _Second >
+		void runHalves( SizeT depth, Node const * node, _First && first,
+		                _Second && second )
+		{
+			if( depth == 0 || getBlackHeight( node ) < FORK_HEIGHT )
+			{
+				first( depth );
+				second( *this, depth );
+				return;
+			}
+			auto task = std::async( std::launch::async, [ & ]()
+			{
+				RedBlackTree worker( LessBase::get(), AllocT( m_allocator ) );
+				second( worker, depth - 1 );
+				addStats( worker );
+			} );
+			first( depth - 1 );
+			task.get();
+		}
+
+		// Parallel scans split the keys into about this many runs per
+		// thread, and runs into no fewer than CHUNK_MIN keys.
+		static SizeT constexpr CHUNKS_PER_THREAD = 8;
+		static SizeT constexpr CHUNK_MIN = SizeT( 1 ) << 14;
+
+		static SizeT getThreadCount()
+		{
+			return std::max( SizeT( std::thread::hardware_concurrency() ),
+			                 SizeT( 1 ) );
+		}
+
+		static Node const * getNextNode( Node const * node )
+		{
+			Node const * next = node->getNext();
+			return ( next != node ? next : nullptr );
+		}
+
+		// Returns the first node of each run of keys in ascending order,
+		// an empty tree giving a single empty run.
+		std::vector< Node const * > getChunkStarts() const
+		{
+			SizeT chunkCount = std::min( getThreadCount() * CHUNKS_PER_THREAD,
+			                             std::max( m_size / CHUNK_MIN,
+			                                       SizeT( 1 ) ) );
+			std::vector< Node const * > starts;
+
+			if constexpr( ORDER_STATISTICS )
+			{
+				starts.reserve( chunkCount );
+
+				for( SizeT i = 0; i < chunkCount; ++i )
+				{
+					starts.push_back( select( i * m_size / chunkCount ) );
+				}
+				return starts;
+			}
+			else
+			{
+				// Nodes above this depth split the keys into runs of at
+				// most one subtree each.
+				SizeT depth = 0;
+
+				while( ( SizeT( 1 ) << depth ) < chunkCount )
+				{
+					++depth;
+				}
+				starts.push_back( m_first );
+				collectStarts( m_root, depth, starts );
+				return starts;
+			}
+		}
+
+		static void collectStarts( Node const * node, SizeT depth,
+		                           std::vector< Node const * > & starts )
+		{
+			if( node == nullptr || depth == 0 )
+			{
+				return;
+			}
+			collectStarts( node->getLeftChild(), depth - 1, starts );
+
+			if( node != starts.front() )
+			{
+				starts.push_back( node );
+			}
+			collectStarts( node->getRightChild(), depth - 1, starts );
+		}
+
+		// Calls chunk with the index, first and end node of every run, the
+		// runs being claimed by the calling thread and as many others as
+		// there are cores.
+		template< class _Chunk >
+		static void runChunks( std::vector< Node const * > const & starts,
+		                       _Chunk && chunk )
+		{
+			std::atomic< SizeT > next{ 0 };
+
+			auto work = [ & ]()
+			{
+				for( SizeT i = next++; i < starts.size(); i = next++ )
+				{
+					chunk( i, starts[ i ], ( i + 1 < starts.size() ?
+					                         starts[ i + 1 ] : nullptr ) );
+				}
+			};
+			std::vector< std::future< void > > tasks;
+			SizeT threads = std::min( getThreadCount(), starts.size() );
+
+			for( SizeT i = 1; i < threads; ++i )
+			{
+				tasks.push_back( std::async( std::launch::async, work ) );
+			}
+			work();
+
+			for( auto & task: tasks )
+			{
+				task.get();
+			}
+		}
+
+		// Keys deserialize() reads from a stream at a time.
+		static SizeT constexpr SERIAL_BLOCK = 4096;
+
+		// Writes the header and the zero padding after it.
+		void writeSerialHeader( char * bytes ) const
+		{
+			detail::SerialHeader header{ detail::SerialHeader::MAGIC,
+			                             std::uint32_t( sizeof( KeyT ) ),
+			                             std::uint64_t( m_size ) };
+			std::memset( bytes, 0, detail::getSerialOffset< KeyT >() );
+			std::memcpy( bytes, &header, sizeof( header ) );
+		}
+
+		// Builds this empty tree from count keys, unless they are not
+		// strictly increasing.
+		bool loadSorted( KeyT const * keys, SizeT count )
+		{
+			if( std::adjacent_find( keys, keys + count,
+				[ this ]( KeyT const & k1, KeyT const & k2 )
+				{
+					return !less( k1, k2 );
+				} ) != keys + count )
+			{
+				return false;
+			}
+			buildSorted( keys, count, false );
+			return true;
+		}
+
+		// Builds the tree from count strictly increasing keys at first,
+		// with parallel the subtrees near the root on threads of their own.
+		// This tree must be empty.
+		template< class _Iter >
+		void buildSorted( _Iter first, SizeT count, bool parallel )
+		{
+			assert( m_root == nullptr );
+			assert( std::adjacent_find( first, first + count,
+				[ this ]( KeyT const & k1, KeyT const & k2 )
+				{
+					return !less( k1, k2 );
+				} ) == first + count );
+
+			m_root = buildRange( first, count, getBuildHeight( count ),
+			                     getForkDepth( parallel ) );
+			m_size = count;
+			updateExtremes();
+			checkAfterChange();
+		}
+
+		// Builds the same shape as build() from a random access range. The
+		// left subtree goes to another thread while depth is left and the
+		// subtree is worth it.
+		template< class _Iter >
+		Node * buildRange( _Iter first, SizeT count, SizeT height,
+		                   SizeT depth )
+		{
+			if( count == 0 )
+			{
+				assert( height == 0 );
+				return nullptr;
+			}
+			assert( height > 0 );
+
+			SizeT childMax = getMaxCount( height - 1 );
+			bool twoNode = ( count - 1 - ( count - 1 ) / 2 <= childMax );
+			SizeT leftCount = ( twoNode ? ( count - 1 ) / 2 : ( count - 2 ) / 3 );
+			SizeT middleCount = ( twoNode ? 0 :
+			                      ( count - 2 - leftCount ) / 2 );
+
+			// Left subtree, red node, middle subtree, node and right subtree
+			// in key order, the red node and middle subtree for 3-nodes only.
+			Node * parts[ 5 ] = {};
+			std::future< Node * > task;
+
+			try
+			{
+				if( depth > 0 && count >= CHUNK_MIN )
+				{
+					task = std::async( std::launch::async, [ = ]()
+					{
+						return buildRange( first, leftCount, height - 1,
+						                   depth - 1 );
+					} );
+				}
+				else
+				{
+					parts[ 0 ] = buildRange( first, leftCount, height - 1, 0 );
+				}
+				SizeT next = ( depth > 0 ? depth - 1 : 0 );
+				_Iter key = first + leftCount;
+
+				if( !twoNode )
+				{
+					parts[ 1 ] = createNode( *key );
+					++key;
+					parts[ 2 ] = buildRange( key, middleCount, height - 1,
+					                         next );
+					key += middleCount;
+				}
+				parts[ 3 ] = createNode( *key );
+				++key;
+				parts[ 4 ] = buildRange( key, count - SizeT( key - first ),
+				                         height - 1, next );
+
+				if( task.valid() )
+				{
+					parts[ 0 ] = task.get();
+				}
+			}
+			catch( ... )
+			{
+				if( task.valid() )
+				{
+					try
+					{
+						parts[ 0 ] = task.get();
+					}
+					catch( ... )
+					{}
+				}
+
+				for( Node * part: parts )
+				{
+					destroyTree( part );
+				}
+				throw;
+			}
+			Node * node = parts[ 3 ];
+
+			if( !twoNode )
+			{
+				Node * red = parts[ 1 ];
+				setLeftChild( red, parts[ 0 ] );
+				setRightChild( red, parts[ 2 ] );
+				red->setRed();
+				updateSize( red );
+				setLeftChild( node, red );
+			}
+			else
+			{
+				setLeftChild( node, parts[ 0 ] );
+			}
+			setRightChild( node, parts[ 4 ] );
+			updateSize( node );
+			return node;
+		}
+
+		Node * unionTrees( Node * tree, Node * other, SizeT & duplicates,
+		                   SizeT depth )
+		{
+			if( tree == nullptr || other == nullptr )
+			{
+				return ( tree != nullptr ? tree : other );
+			}
+			Node * left = detachTree( tree->getLeftChild() );
+			Node * right = detachTree( tree->getRightChild() );
+			tree->setLeftChild( nullptr );
+			tree->setRightChild( nullptr );
+			detachTree( tree );
+
+			Node * lower = nullptr;
+			Node * upper = nullptr;
+			Node * match = nullptr;
+			splitTree( other, tree->getKey(), lower, upper, match );
+
+			if( match != nullptr )
+			{
+				destroyNode( match );
+				++duplicates;
+			}
+			SizeT rightDuplicates = 0;
+			runHalves( depth, left,
+				[ & ]( SizeT next )
+				{
+					left = unionTrees( left, lower, duplicates, next );
+				},
+				[ & ]( RedBlackTree & worker, SizeT next )
+				{
+					right = worker.unionTrees( right, upper, rightDuplicates,
+					                           next );
+				} );
+			duplicates += rightDuplicates;
+			return joinTrees( left, tree, right );
+		}
+
+		// Set operations below keep the nodes of tree whose key is or is
+		// not in other, which is only read.
+		Node * intersectTrees( Node * tree, Node const * other,
+		                       SizeT & removed, SizeT depth )
+		{
+			if( tree == nullptr || other == nullptr )
+			{
+				removed += destroyTree( tree );
+				return nullptr;
+			}
+			Node * lower = nullptr;
+			Node * upper = nullptr;
+			Node * match = nullptr;
+			splitTree( tree, other->getKey(), lower, upper, match );
+
+			SizeT rightRemoved = 0;
+			runHalves( depth, lower,
+				[ & ]( SizeT next )
+				{
+					lower = intersectTrees( lower, other->getLeftChild(),
+					                        removed, next );
+				},
+				[ & ]( RedBlackTree & worker, SizeT next )
+				{
+					upper = worker.intersectTrees( upper,
+						other->getRightChild(), rightRemoved, next );
+				} );
+			removed += rightRemoved;
+
+			if( match != nullptr )
+			{
+				return joinTrees( lower, match, upper );
+			}
+			return joinTrees( lower, upper );
+		}
+
+		Node * differenceTrees( Node * tree, Node const * other,
+		                        SizeT & removed, SizeT depth )
+		{
+			if( tree == nullptr || other == nullptr )
+			{
+				return tree;
+			}
+			Node * lower = nullptr;
+			Node * upper = nullptr;
+			Node * match = nullptr;
+			splitTree( tree, other->getKey(), lower, upper, match );
+
+			if( match != nullptr )
+			{
+				destroyNode( match );
+				++removed;
+			}
+			SizeT rightRemoved = 0;
+			runHalves( depth, lower,
+				[ & ]( SizeT next )
+				{
+					lower = differenceTrees( lower, other->getLeftChild(),
+					                         removed, next );
+				},
+				[ & ]( RedBlackTree & worker, SizeT next )
+				{
+					upper = worker.differenceTrees( upper,
+						other->getRightChild(), rightRemoved, next );
+				} );
+			removed += rightRemoved;
+			return joinTrees( lower, upper );
+		}
+
+		// Batches at least this many times the size of the tree are merged.
+		// Below that, walking scattered nodes costs more than searching.
+		static SizeT constexpr MERGE_RATIO = 4;
+
+		// Adds strictly increasing keys, starting each search from the
+		// lowest ancestor of the previous key whose subtree spans the next.
+		SizeT insertSorted( std::vector< KeyT > & keys )
+		{
+			SizeT added = 0;
+			Node * finger = nullptr;
+
+			for( auto & key: keys )
+			{
+				Node * start = finger;
+
+				if( start == nullptr )
+				{
+					start = m_root;
+				}
+				else
+				{
+					while( start->getParent() != nullptr &&
+					       !( start->isLessThanParent() &&
+					          less( key, start->getParent()->getKey() ) ) )
+					{
+						start = start->getParent();
+					}
+				}
+				Node * nearest = nullptr;
+				bool lessThan = false;
+
+				if( descend( start, key, nearest, lessThan ) )
+				{
+					finger = nearest;
+					continue;
+				}
+				finger = createNode( std::move( key ) );
+				insertNode( finger, nearest, lessThan );
+				added += 1;
+			}
+			return added;
+		}
+
+		// Threads the existing nodes and new nodes for keys, which must be
+		// strictly increasing, into one vine and rebuilds the tree from it.
+		SizeT mergeSorted( std::vector< KeyT > & keys )
+		{
+			Node * node = m_first;
+			Node * vine = nullptr;
+			Node * tail = nullptr;
+			SizeT count = 0;
+			SizeT added = 0;
+
+			auto append = [ & ]( Node * next )
+			{
+				if( tail != nullptr )
+				{
+					tail->setRightChild( next );
+				}
+				else
+				{
+					vine = next;
+				}
+				tail = next;
+				++count;
+			};
+
+			// Step past a node before relinking it, its successor is
+			// found through its right child.
+			auto appendExisting = [ & ]()
+			{
+				Node * current = node;
+				Node * next = node->getNext();
+				node = ( next != node ? next : nullptr );
+				append( current );
+			};
+
+			auto rebuild = [ & ]()
+			{
+				while( node != nullptr )
+				{
+					appendExisting();
+				}
+
+				if( tail != nullptr )
+				{
+					tail->setRightChild( nullptr );
+				}
+				m_root = nullptr;
+				buildFromVine( vine, count );
+			};
+
+			try
+			{
+				for( auto & key: keys )
+				{
+					while( node != nullptr && less( node->getKey(), key ) )
+					{
+						appendExisting();
+					}
+
+					if( node != nullptr && !less( key, node->getKey() ) )
+					{
+						continue;
+					}
+					append( createNode( std::move( key ) ) );
+					added += 1;
+				}
+			}
+			catch( ... )
+			{
+				// Keep the tree whole with the keys added so far.
+				rebuild();
+				throw;
+			}
+			rebuild();
+			return added;
+		}
+
+		// Finds where key goes when it belongs next to hint, which may be
+		// nullptr for the end, and searches from the root otherwise.
+		template< class _K >
+		bool findHint( Node const * hint, _K const & key, Node * & nearest,
+		               bool & lessThan )
+		{
+			if( m_root == nullptr )
+			{
+				nearest = nullptr;
+				return false;
+			}
+
+			if( hint == nullptr )
+			{
+				if( less( m_last->getKey(), key ) )
+				{
+					nearest = m_last;
+					lessThan = false;
+					return false;
+				}
+				return find( key, nearest, lessThan );
+			}
+			Node * node = const_cast< Node * >( hint );
+
+			if( less( key, node->getKey() ) )
+			{
+				Node * previous = ( node != m_first ? node->getPrevious()
+				                                    : nullptr );
+
+				if( previous == nullptr || less( previous->getKey(), key ) )
+				{
+					// Key falls between previous and node, the empty child
+					// between them is where a search would end.
+					lessThan = ( node->getLeftChild() == nullptr );
+					nearest = ( lessThan ? node : previous );
+					return false;
+				}
+			}
+			else if( less( node->getKey(), key ) )
+			{
+				Node * next = ( node != m_last ? node->getNext() : nullptr );
+
+				if( next == nullptr || less( key, next->getKey() ) )
+				{
+					lessThan = ( node->getRightChild() != nullptr );
+					nearest = ( lessThan ? next : node );
+					return false;
+				}
+			}
+			else
+			{
+				nearest = node;
+				lessThan = true;
+				return true;
+			}
+			return find( key, nearest, lessThan );
+		}
+
+		// Searches for key in the subtree of start, which must span it.
+		template< class _K >
+		bool descend( Node * start, _K const & key, Node * & nearest,
+		              bool & lessThan )
+		{
+			Node * nextNode = start;
+			nearest = nullptr;
+			SizeT depth = 0;
+			SizeT comparisons = 0;
+
+			while( nextNode != nullptr )
+			{
+				nearest = nextNode;
+				++depth;
+				++comparisons;
+
+				if( less( key, nextNode->getKey() ) )
+				{
+					nextNode = nextNode->getLeftChild();
+					lessThan = true;
+				}
+				else if( less( nextNode->getKey(), key ) )
+				{
+					++comparisons;
+					nextNode = nextNode->getRightChild();
+					lessThan = false;
+				}
+				else
+				{
+					++comparisons;
+					lessThan = true;
+					countSearch( depth, comparisons );
+					return true;
+				}
+			}
+			countSearch( depth, comparisons );
+			return false;
+		}
+
+		// A vine is an in-order list of unlinked nodes chained through their
+		// right child pointers.
+		void destroyVine( Node * vine )
 		{
-			for( auto & key: keys )
+			while( vine != nullptr )
 			{
-				add( key );
+				Node * next = vine->getRightChild();
+				destroyNode( vine );
+				vine = next;
 			}
 		}
 
-		template< class _FirstIter, class _LastIter >
-		RedBlackTree( _FirstIter first, _LastIter last ):
-			RedBlackTree()
+		void buildFromVine( Node * vine, SizeT count )
 		{
-			while( first != last )
-			{
-				add( *first );
-				++first;
-			}
+			assert( m_root == nullptr );
+
+			m_root = build( count, getBuildHeight( count ), vine );
+			m_size = count;
+			assert( vine == nullptr );
+			updateExtremes();
+			checkAfterChange();
 		}
 
-		bool add( KeyT const & key, Node * & node )
+		void updateExtremes()
 		{
-			// Check for empty container.
+			m_first = m_root;
+			m_last = m_root;
+
 			if( m_root == nullptr )
 			{
-				m_root = new Node( key );
-				m_size = 1;
-				node = m_root;
-				return true;
+				return;
 			}
 
-			// Search for matching node.
-			Node * nearest = nullptr;
-			bool lessThan = false;
-
-			if( find( key, nearest, lessThan ) )
+			while( m_first->getLeftChild() != nullptr )
 			{
-				node = nearest;
-				return false;
+				m_first = m_first->getLeftChild();
 			}
 
-			// Matching node not found, create new node.
-			node = new Node( key );
-			node->setParent( nearest );
-			node->setLessThanParent( lessThan );
-			m_size += 1;
-
-			// Add node to tree.
-			Node * freeNode = node;
-
-			while( freeNode != m_root )
+			while( m_last->getRightChild() != nullptr )
 			{
-				freeNode = add( freeNode );
+				m_last = m_last->getRightChild();
 			}
-			return true;
-		}
-
-		Node * add( KeyT const & key )
-		{
-			Node * node = nullptr;
-			add( key, node );
-			return node;
 		}
 
-		bool remove( KeyT const & key, Node * & next )
+		static SizeT getBuildHeight( SizeT count )
 		{
-			Node * node = find( key );
+			// Tallest 2-3 tree that still holds count keys using 2-nodes.
+			SizeT height = 0;
 
-			if( node == nullptr )
+			while( height + 1 < std::numeric_limits< SizeT >::digits &&
+			       ( SizeT( 2 ) << height ) - 1 <= count )
 			{
-				return false;
+				++height;
 			}
-			return remove( node, next );
+			return height;
 		}
 
-		bool remove( Node * node, Node * & next )
+		static SizeT getMaxCount( SizeT height )
 		{
-			assert( node != nullptr );
-
-			m_size -= 1;
-
-			// Check for leaf node.
-			next = getNextLargestChild( node );
+			// Keys held by a 2-3 tree of all 3-nodes, saturated on overflow.
+			SizeT count = 1;
 
-			if( next != nullptr )
+			for( SizeT i = 0; i < height; ++i )
 			{
-				// Node is not a leaf participant.
-				swap( node, next );
-
-				if( node == m_root )
+				if( count > std::numeric_limits< SizeT >::max() / 3 )
 				{
-					m_root = next;
+					return std::numeric_limits< SizeT >::max();
 				}
+				count *= 3;
 			}
+			return count - 1;
+		}
 
-			// Node is a leaf participant.
-			Node * parent = node->getParent();
-			Node * left = node->getLeftChild();
-
-			if( parent != nullptr )
+		Node * build( SizeT count, SizeT height, Node * & vine )
+		{
+			if( count == 0 )
 			{
-				// Set next pointer to next largest parent of leaf.
-				if( node->isLessThanParent() )
-				{
-					next = parent;
-				}
-				else
-				{
-					next = getNextLargestParent( parent );
-				}
-
-				// Check colour of node.
-				if( node->isBlack() )
-				{
-					if( left != nullptr && left->isRed() )
-					{
-						// Node is black participant in a leaf 3-node.
-						assert( left->getLeftChild() == nullptr );
+				assert( height == 0 );
+				return nullptr;
+			}
+			assert( height > 0 );
 
-						setChild( parent, left, node->isLessThanParent() );
-						left->setBlack();
-						delete node;
-					}
-					else
-					{
-						// Node is leaf 2-node.
-						assert( node != m_root );
+			SizeT childMax = getMaxCount( height - 1 );
 
-						while( node != m_root )
-						{
-							node = rem( node );
-						}
-					}
-				}
-				else
-				{
-					// Node is red participant in a leaf 3-node.
-					assert( left == nullptr );
-					parent->setLeftChild( nullptr );
-					delete node;
-				}
-			}
-			else
+			if( count - 1 - ( count - 1 ) / 2 <= childMax )
 			{
-				// Node is both leaf and root.
-				assert( node->isBlack() );
-
-				if( left != nullptr && left->isRed() )
-				{
-					// Root node is a 3-node.
-					assert( m_size == 1 );
-					left->setParent( nullptr );
-					left->setBlack();
-				}
-				m_root = left;
-				delete node;
+				// Subtree root is a 2-node.
+				SizeT leftCount = ( count - 1 ) / 2;
+				Node * left = build( leftCount, height - 1, vine );
+				Node * node = takeVine( vine );
+				Node * right = build( count - 1 - leftCount, height - 1, vine );
+
+				setLeftChild( node, left );
+				setRightChild( node, right );
+				updateSize( node );
+				return node;
 			}
-			return true;
-		}
 
-		bool remove( KeyT const & key )
-		{
-			Node * next = nullptr;
-			return remove( key, next );
+			// Subtree root is a 3-node.
+			SizeT rest = count - 2;
+			SizeT leftCount = rest / 3;
+			SizeT middleCount = ( rest - leftCount ) / 2;
+			Node * left = build( leftCount, height - 1, vine );
+			Node * red = takeVine( vine );
+			Node * middle = build( middleCount, height - 1, vine );
+			Node * node = takeVine( vine );
+			Node * right =
+				build( rest - leftCount - middleCount, height - 1, vine );
+
+			setLeftChild( red, left );
+			setRightChild( red, middle );
+			red->setRed();
+			setLeftChild( node, red );
+			setRightChild( node, right );
+			updateSize( red );
+			updateSize( node );
+			return node;
 		}
 
-		bool remove( Node * node )
+		static Node * takeVine( Node * & vine )
 		{
-			Node * next = nullptr;
-			return remove( node, next );
+			assert( vine != nullptr );
+
+			Node * node = vine;
+			vine = node->getRightChild();
+			node->setRightChild( nullptr );
+			node->setParent( nullptr );
+			node->setBlack();
+			return node;
 		}
 
-		Node * find( KeyT const & key )
+		template< class _K >
+		Node * findNode( _K const & key )
 		{
 			Node * node = m_root;
+			SizeT depth = 0;
+			SizeT comparisons = 0;
 
 			while( node != nullptr )
 			{
+				++depth;
+				++comparisons;
+
 				if( less( key, node->getKey() ) )
 				{
 					node = node->getLeftChild();
 				}
 				else if( less( node->getKey(), key ) )
 				{
+					++comparisons;
 					node = node->getRightChild();
 				}
 				else
 				{
+					++comparisons;
 					break;
 				}
 			}
+			countSearch( depth, comparisons );
 			return node;
 		}
 
-		Node const * find( KeyT const & key ) const
-		{
-			return const_cast< RedBlackTree * >( this )->find( key );
-		}
-
-		SizeT getSize() const
-		{
-			return m_size;
-		}
+		// Number of descents findEach() keeps in flight.
+		static SizeT constexpr BATCH_SIZE = 16;
 
-		bool validate() const
+		// Steps a group of descents one level per round, prefetching each
+		// next node while the other searches of the group proceed.
+		template< class _FirstIter, class _LastIter, class _F >
+		void findEach( _FirstIter first, _LastIter last, _F report ) const
 		{
-			Node * node = m_root;
-			Node * next = nullptr;
+			_FirstIter keys[ BATCH_SIZE ];
+			Node * nodes[ BATCH_SIZE ];
+			SizeT pending[ BATCH_SIZE ];
 
-			if( node != nullptr )
+			while( first != last )
 			{
-				// Ensure root is black.
-				if( !( node->isBlack() ) )
+				SizeT count = 0;
+
+				for( ; count < BATCH_SIZE && first != last; ++count, ++first )
 				{
-					return false;
+					keys[ count ] = first;
+					nodes[ count ] = m_root;
+					pending[ count ] = count;
 				}
-				next = node->getPrevious();
-			}
-			else
-			{
-				return true;
-			}
-
-			// Go to smallest value node.
-			while( node != next )
-			{
-				node = next;
-				next = node->getPrevious();
-			}
-			// Iterate through all nodes.
-			next = node->getNext();
-
-			while( node != next )
-			{
-				Node * parent = node->getParent();
-				Node * left = node->getLeftChild();
-				Node * right = node->getRightChild();
-				bool lessThan = node->isLessThanParent();
-				bool black = node->isBlack();
+				SizeT active = ( m_root != nullptr ? count : 0 );
 
-				if( parent != nullptr )
+				while( active > 0 )
 				{
-					if( lessThan )
+					SizeT kept = 0;
+
+					for( SizeT i = 0; i < active; ++i )
 					{
-						if( !( less( node->getKey(), parent->getKey() ) ) )
+						SizeT lane = pending[ i ];
+						Node * node = nodes[ lane ];
+						auto const & key = *keys[ lane ];
+
+						if( less( key, node->getKey() ) )
 						{
-							return false;
+							node = node->getLeftChild();
 						}
-					}
-					else
-					{
-						if( less( node->getKey(), parent->getKey() ) )
+						else if( less( node->getKey(), key ) )
 						{
-							return false;
+							node = node->getRightChild();
 						}
-					}
-				}
-
-				if( !black )
-				{
-					if( parent == nullptr )
-					{
-						return false;
-					}
-
-					if( !( parent->isBlack() ) )
-					{
-						return false;
-					}
-
-					if( !lessThan )
-					{
-						return false;
-					}
-					
-					if( !( less( node->getKey(), parent->getKey() ) ) )
-					{
-						return false;
-					}
-				}
+						else
+						{
+							// Found, the lane keeps its node.
+							continue;
+						}
+						nodes[ lane ] = node;
 
-				if( left != nullptr )
-				{
-					if( left->isRed() )
-					{
-						if( right != nullptr )
+						if( node != nullptr )
 						{
-							if( left->getLeftChild() == nullptr )
-							{
-								return false;
-							}
-							else if( left->getRightChild() == nullptr )
-							{
-								return false;
-							}
+							detail::prefetch( node );
+							pending[ kept++ ] = lane;
 						}
 					}
-					else if( right == nullptr )
-					{
-						return false;
-					}
+					active = kept;
 				}
 
-				if( right != nullptr && left == nullptr )
+				for( SizeT i = 0; i < count; ++i )
 				{
-					return false;
+					report( nodes[ i ] );
 				}
-				node = next;
-				next = node->getNext();
 			}
-			return true;
 		}
 
-		static bool less( KeyT const & k1, KeyT const & k2 )
+		template< class _K >
+		SizeT getRank( _K const & key ) const
 		{
-			static LessT lessFunc;
-			return lessFunc( k1, k2 );
-		}
-
-		private:
+			static_assert( ORDER_STATISTICS,
+			               "rank() requires ORDER_STATISTICS" );
 
-		bool find( KeyT const & key, Node * & nearest, bool & lessThan )
-		{
-			Node * nextNode = m_root;
-			nearest = nullptr;
+			Node const * node = m_root;
+			SizeT count = 0;
 
-			while( nextNode != nullptr )
+			while( node != nullptr )
 			{
-				nearest = nextNode;
-				
-				if( less( key, nextNode->getKey() ) )
-				{
-					nextNode = nextNode->getLeftChild();
-					lessThan = true;
-				}
-				else if( less( nextNode->getKey(), key ) )
+				if( less( node->getKey(), key ) )
 				{
-					nextNode = nextNode->getRightChild();
-					lessThan = false;
+					count += getSubtreeSize( node->getLeftChild() ) + 1;
+					node = node->getRightChild();
 				}
 				else
 				{
-					lessThan = true;
-					return true;
+					node = node->getLeftChild();
 				}
 			}
-			return false;
+			return count;
+		}
+
+		template< class _K1, class _K2 >
+		SizeT getRangeCount( _K1 const & low, _K2 const & high ) const
+		{
+			if( !less( low, high ) )
+			{
+				return 0;
+			}
+			return getRank( high ) - getRank( low );
+		}
+
+		template< class _K >
+		bool removeKey( _K const & key, Node * & next )
+		{
+			Node * node = findNode( key );
+
+			if( node == nullptr )
+			{
+				return false;
+			}
+			return remove( node, next );
+		}
+
+		template< class _K >
+		bool find( _K const & key, Node * & nearest, bool & lessThan )
+		{
+			return descend( m_root, key, nearest, lessThan );
 		}
 		
 		Node * getNextLargestParent( Node * node )
@@ -700,6 +3719,11 @@ namespace util
 			flag = first->isLessThanParent();
 			first->setLessThanParent( second->isLessThanParent() );
 			second->setLessThanParent( flag );
+
+			if constexpr( ORDER_STATISTICS )
+			{
+				std::swap( first->m_subtreeSize, second->m_subtreeSize );
+			}
 		}
 
 		void setChild( Node * parent, Node * child, bool lessThan )
@@ -738,6 +3762,37 @@ namespace util
 			parent->setRightChild( child );
 		}
 
+		static SizeT getSubtreeSize( Node const * node )
+		{
+			if constexpr( ORDER_STATISTICS )
+			{
+				return ( node != nullptr ? node->m_subtreeSize : 0 );
+			}
+			return 0;
+		}
+
+		static void updateSize( Node * node )
+		{
+			if constexpr( ORDER_STATISTICS )
+			{
+				node->m_subtreeSize = 1 +
+					getSubtreeSize( node->getLeftChild() ) +
+					getSubtreeSize( node->getRightChild() );
+			}
+		}
+
+		static void updateSizeToRoot( Node * node )
+		{
+			if constexpr( ORDER_STATISTICS )
+			{
+				while( node != nullptr )
+				{
+					updateSize( node );
+					node = node->getParent();
+				}
+			}
+		}
+
 		Node * add( Node * node )
 		{
 			Node * target = node->getParent();
@@ -781,6 +3836,8 @@ namespace util
 
 		Node * addTwoLeft( Node * node )
 		{
+			countStat( TreeStats::ADD_TWO_LEFT );
+
 			assert( node != nullptr );
 			assert( node->isBlack() );
 			assert( node->isLessThanParent() );
@@ -793,11 +3850,14 @@ namespace util
 			right->setLeftChild( node );
 			node->setLessThanParent();
 			node->setRed();
+			updateSizeToRoot( right );
 			return m_root;
 		}
 
 		Node * addTwoRight( Node * node )
 		{
+			countStat( TreeStats::ADD_TWO_RIGHT );
+
 			assert( node != nullptr );
 			assert( node->isBlack() );
 			assert( node->isGreaterThanParent() );
@@ -832,11 +3892,15 @@ namespace util
 			left->setParent( node );
 			left->setLessThanParent();
 			left->setRed();
+			updateSize( left );
+			updateSizeToRoot( node );
 			return m_root;
 		}
 
 		Node * addThreeLeft( Node * node )
 		{
+			countStat( TreeStats::ADD_THREE_LEFT );
+
 			assert( node != nullptr );
 			assert( node->isBlack() );
 			assert( node->isLessThanParent() );
@@ -877,11 +3941,15 @@ namespace util
 			middle->setRightChild( right );
 			middle->setLeftChild( node );
 			middle->setBlack();
+			updateSize( right );
+			updateSize( middle );
 			return middle;
 		}
 
 		Node * addThreeMiddle( Node * node )
 		{
+			countStat( TreeStats::ADD_THREE_MIDDLE );
+
 			assert( node != nullptr );
 			assert( node->isBlack() );
 			assert( node->isGreaterThanParent() );
@@ -932,11 +4000,16 @@ namespace util
 			left->setLessThanParent();
 			right->setGreaterThanParent();
 			left->setBlack();
+			updateSize( left );
+			updateSize( right );
+			updateSize( node );
 			return node;
 		}
 
 		Node * addThreeRight( Node * node )
 		{
+			countStat( TreeStats::ADD_THREE_RIGHT );
+
 			assert( node != nullptr );
 			assert( node->isBlack() );
 			assert( node->isGreaterThanParent() );
@@ -953,6 +4026,7 @@ namespace util
 
 			left->setBlack();
 			middle->setRightChild( node );
+			updateSize( middle );
 			Node * parent = middle->getParent();
 			bool lessThan = middle->isLessThanParent();
 
@@ -1017,6 +4091,8 @@ namespace util
 
 		Node * remTwoLeft_Two( Node * node )
 		{
+			countStat( TreeStats::REM_TWO_LEFT_TWO );
+
 			Node * a = node->getParent();
 			assert( a != nullptr && a->isBlack() );
 
@@ -1029,6 +4105,8 @@ namespace util
 			setRightChild( a, b->getLeftChild() );
 			setLeftChild( b, a );
 			a->setRed();
+			updateSize( a );
+			updateSize( b );
 
 			if( x != nullptr )
 			{
@@ -1039,12 +4117,14 @@ namespace util
 			}
 			b->setParent( nullptr );
 			m_root = b;
-			delete node;
+			destroyNode( node );
 			return m_root;
 		}
 
 		Node * remTwoLeft_Three( Node * node )
 		{
+			countStat( TreeStats::REM_TWO_LEFT_THREE );
+
 			Node * a = node->getParent();
 			assert( a != nullptr && a->isBlack() );
 
@@ -1062,6 +4142,8 @@ namespace util
 			setLeftChild( b, a );
 			setRightChild( b, c );
 			b->setBlack();
+			updateSize( a );
+			updateSize( c );
 
 			if( x != nullptr )
 			{
@@ -1072,7 +4154,8 @@ namespace util
 				b->setParent( nullptr );
 				m_root = b;
 			}
-			delete node;
+			updateSizeToRoot( b );
+			destroyNode( node );
 			return m_root;
 		}
 
@@ -1094,6 +4177,8 @@ namespace util
 
 		Node * remTwoRight_Two( Node * node )
 		{
+			countStat( TreeStats::REM_TWO_RIGHT_TWO );
+
 			Node * a = node->getParent();
 			assert( a != nullptr && a->isBlack() );
 
@@ -1104,6 +4189,7 @@ namespace util
 			bool xLess = a->isLessThanParent();
 			setRightChild( a, node->getLeftChild() );
 			b->setRed();
+			updateSize( a );
 
 			if( x != nullptr )
 			{
@@ -1114,12 +4200,14 @@ namespace util
 			}
 			a->setParent( nullptr );
 			m_root = a;
-			delete node;
+			destroyNode( node );
 			return m_root;
 		}
 
 		Node * remTwoRight_Three( Node * node )
 		{
+			countStat( TreeStats::REM_TWO_RIGHT_THREE );
+
 			Node * a = node->getParent();
 			assert( a != nullptr && a->isBlack() );
 
@@ -1135,6 +4223,7 @@ namespace util
 			setLeftChild( a, c->getRightChild() );
 			setRightChild( c, a );
 			b->setBlack();
+			updateSize( a );
 
 			if( x != nullptr )
 			{
@@ -1145,7 +4234,8 @@ namespace util
 				c->setParent( nullptr );
 				m_root = c;
 			}
-			delete node;
+			updateSizeToRoot( c );
+			destroyNode( node );
 			return m_root;
 		}
 
@@ -1170,6 +4260,8 @@ namespace util
 		
 		Node * remThreeLeft_Two_X( Node * node )
 		{
+			countStat( TreeStats::REM_THREE_LEFT_TWO_X );
+
 			Node * a = node->getParent();
 			assert( a != nullptr && a->isRed() );
 
@@ -1183,13 +4275,17 @@ namespace util
 			setRightChild( a, c->getLeftChild() );
 			setLeftChild( c, a );
 			setLeftChild( b, c );
+			updateSize( a );
+			updateSizeToRoot( c );
 
-			delete node;
+			destroyNode( node );
 			return m_root;
 		}
 
 		Node * remThreeLeft_Three_X( Node * node )
 		{
+			countStat( TreeStats::REM_THREE_LEFT_THREE_X );
+
 			Node * a = node->getParent();
 			assert( a != nullptr && a->isRed() );
 
@@ -1209,8 +4305,11 @@ namespace util
 			setRightChild( c, d );
 			setLeftChild( b, c );
 			a->setBlack();
+			updateSize( a );
+			updateSize( d );
+			updateSizeToRoot( c );
 
-			delete node;
+			destroyNode( node );
 			return m_root;
 		}
 		
@@ -1235,10 +4334,12 @@ namespace util
 
 		Node * remThreeMiddle_Two_X( Node * node )
 		{
+			countStat( TreeStats::REM_THREE_MIDDLE_TWO_X );
+
 			Node * a = node->getParent();
 			assert( a != nullptr && a->isRed() );
 
-			Node * b = a->getParent();
+			[[maybe_unused]] Node * b = a->getParent();
 			assert( b != nullptr && b->isBlack() );
 
 			Node * c = a->getLeftChild();
@@ -1247,13 +4348,16 @@ namespace util
 			setRightChild( a, node->getLeftChild() );
 			a->setBlack();
 			c->setRed();
+			updateSizeToRoot( a );
 
-			delete node;
+			destroyNode( node );
 			return m_root;
 		}
 
 		Node * remThreeMiddle_Three_X( Node * node )
 		{
+			countStat( TreeStats::REM_THREE_MIDDLE_THREE_X );
+
 			Node * a = node->getParent();
 			assert( a != nullptr && a->isRed() );
 
@@ -1273,8 +4377,10 @@ namespace util
 			a->setBlack();
 			c->setBlack();
 			d->setRed();
+			updateSize( a );
+			updateSizeToRoot( d );
 
-			delete node;
+			destroyNode( node );
 			return m_root;
 		}
 
@@ -1302,6 +4408,8 @@ namespace util
 
 		Node * remThreeRight_X_Two( Node * node )
 		{
+			countStat( TreeStats::REM_THREE_RIGHT_X_TWO );
+
 			Node * b = node->getParent();
 			assert( b != nullptr && b->isBlack() );
 
@@ -1320,6 +4428,7 @@ namespace util
 			setRightChild( a, b );
 			a->setBlack();
 			c->setRed();
+			updateSize( b );
 
 			if( x != nullptr )
 			{
@@ -1330,12 +4439,15 @@ namespace util
 				a->setParent( nullptr );
 				m_root = a;
 			}
-			delete node;
+			updateSizeToRoot( a );
+			destroyNode( node );
 			return m_root;
 		}
 
 		Node * remThreeRight_X_Three( Node * node )
 		{
+			countStat( TreeStats::REM_THREE_RIGHT_X_THREE );
+
 			Node * b = node->getParent();
 			assert( b != nullptr && b->isBlack() );
 
@@ -1356,6 +4468,8 @@ namespace util
 			setLeftChild( d, a );
 			setRightChild( d, b );
 			c->setBlack();
+			updateSize( a );
+			updateSize( b );
 
 			if( x != nullptr )
 			{
@@ -1366,12 +4480,17 @@ namespace util
 				d->setParent( nullptr );
 				m_root = d;
 			}
-			delete node;
+			updateSizeToRoot( d );
+			destroyNode( node );
 			return m_root;
 		}
-		Node *	m_root;
-		SizeT	m_size;
+
+		Node *		m_root;
+		Node *		m_first;
+		Node *		m_last;
+		SizeT		m_size;
+		NodeAllocT	m_allocator;
 	};
 }
 
-#endif
\ No newline at end of file
+#endif
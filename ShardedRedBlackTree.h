@@ -0,0 +1,546 @@
+#ifndef UTIL_SHARDEDREDBLACKTREE_H
+#define UTIL_SHARDEDREDBLACKTREE_H
+
+#include <functional>
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <exception>
+#include <future>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "PoolAllocator.h"
+#include "RedBlackTree.h"
+
+namespace util
+{
+	// Ordered set split by key range into shards, each a RedBlackTree with
+	// its own lock and pool arena, so that writers to different ranges run
+	// in parallel. The ranges follow the keys: once a shard grows well past
+	// its share, the shards are split and joined back to even sizes.
+	template< class _KeyT,
+	          class _LessT = std::less< _KeyT >,
+	          class _TraitsT = TreeTraits >
+	class ShardedRedBlackTree: private detail::Compressed< _LessT >
+	{
+		using LessBase = detail::Compressed< _LessT >;
+
+		template< class _K >
+		using IfTransparentT = typename std::enable_if<
+			detail::IsTransparent< _LessT >::value, _K >::type;
+
+		public:
+
+		using KeyT = _KeyT;
+		using LessT = _LessT;
+		using TraitsT = _TraitsT;
+		using SizeT = std::size_t;
+		using AllocT = PoolAllocator< KeyT >;
+		using TreeT = RedBlackTree< KeyT, LessT, AllocT, TraitsT >;
+
+		// Shards smaller than this are not worth splitting further.
+		static SizeT constexpr MIN_SHARD_SIZE = 1024;
+
+		// Shards are rebalanced once one holds this many times its share.
+		static SizeT constexpr DRIFT_RATIO = 2;
+
+		explicit ShardedRedBlackTree( SizeT shardCount =
+		                                  std::thread::hardware_concurrency(),
+		                              LessT const & lessFunc = LessT{} ):
+			LessBase( lessFunc ),
+			m_limit{ DRIFT_RATIO * MIN_SHARD_SIZE }
+		{
+			shardCount = std::max( shardCount, SizeT( 1 ) );
+			m_shards.reserve( shardCount );
+			m_bounds.reserve( shardCount - 1 );
+
+			for( SizeT i = 0; i < shardCount; ++i )
+			{
+				m_shards.emplace_back( new Shard( lessFunc ) );
+			}
+		}
+
+		ShardedRedBlackTree( ShardedRedBlackTree const & ) = delete;
+		ShardedRedBlackTree & operator=( ShardedRedBlackTree const & ) = delete;
+
+		bool add( KeyT const & key )
+		{
+			return addKey( key );
+		}
+
+		bool add( KeyT && key )
+		{
+			return addKey( std::move( key ) );
+		}
+
+		// Adds a batch of keys, returning how many were new. The batch is
+		// sorted into shards first and each shard locked once. With
+		// parallel, the shards are filled on threads of their own.
+		template< class _FirstIter, class _LastIter >
+		SizeT addMany( _FirstIter first, _LastIter last, bool parallel = false )
+		{
+			SizeT count = 0;
+			{
+				std::shared_lock< std::shared_mutex > layout( m_layout );
+				std::vector< std::vector< KeyT > > batches( m_shards.size() );
+
+				while( first != last )
+				{
+					batches[ getIndex( *first ) ].emplace_back( *first );
+					++first;
+				}
+				auto addBatch = [ this, &batches ]( SizeT index ) -> SizeT
+				{
+					Shard & shard = *m_shards[ index ];
+					std::vector< KeyT > & batch = batches[ index ];
+					std::lock_guard< std::mutex > lock( shard.m_lock );
+
+					SizeT added = shard.m_tree.addMany(
+						std::make_move_iterator( batch.begin() ),
+						std::make_move_iterator( batch.end() ) );
+					shard.m_size.store( shard.m_tree.getSize(),
+					                    std::memory_order_relaxed );
+					return added;
+				};
+				std::vector< std::future< SizeT > > tasks;
+
+				for( SizeT index = 0; index < batches.size(); ++index )
+				{
+					if( batches[ index ].empty() )
+					{
+						continue;
+					}
+
+					if( parallel )
+					{
+						tasks.push_back( std::async( std::launch::async,
+						                             addBatch, index ) );
+					}
+					else
+					{
+						count += addBatch( index );
+					}
+				}
+
+				for( auto & task: tasks )
+				{
+					count += task.get();
+				}
+			}
+			rebalanceDrifted();
+			return count;
+		}
+
+		bool remove( KeyT const & key )
+		{
+			return removeKey( key );
+		}
+
+		template< class _K, class = IfTransparentT< _K > >
+		bool remove( _K const & key )
+		{
+			return removeKey( key );
+		}
+
+		bool contains( KeyT const & key ) const
+		{
+			return containsKey( key );
+		}
+
+		template< class _K, class = IfTransparentT< _K > >
+		bool contains( _K const & key ) const
+		{
+			return containsKey( key );
+		}
+
+		// Calls func with every key in ascending order. The shards hold
+		// consecutive ranges, so they are visited one after the other,
+		// each locked while visited; func must not modify the tree.
+		template< class _Func >
+		void forEach( _Func && func ) const
+		{
+			std::shared_lock< std::shared_mutex > layout( m_layout );
+
+			for( auto & shard: m_shards )
+			{
+				std::lock_guard< std::mutex > lock( shard->m_lock );
+
+				for( KeyT const & key: shard->m_tree )
+				{
+					func( key );
+				}
+			}
+		}
+
+		void clear()
+		{
+			std::unique_lock< std::shared_mutex > layout( m_layout );
+
+			for( auto & shard: m_shards )
+			{
+				shard->m_tree.clear();
+				shard->m_size.store( 0, std::memory_order_relaxed );
+			}
+			m_bounds.clear();
+			m_limit.store( DRIFT_RATIO * MIN_SHARD_SIZE,
+			               std::memory_order_relaxed );
+		}
+
+		// Splits the keys evenly across the shards now, rather than once a
+		// shard has drifted.
+		void rebalance()
+		{
+			std::unique_lock< std::shared_mutex > layout( m_layout );
+			balanceShards();
+		}
+
+		// Size as of the latest writes.
+		SizeT getSize() const
+		{
+			SizeT size = 0;
+
+			for( auto & shard: m_shards )
+			{
+				size += shard->m_size.load( std::memory_order_relaxed );
+			}
+			return size;
+		}
+
+		SizeT getShardCount() const
+		{
+			return m_shards.size();
+		}
+
+		// Checks every shard and that its keys lie within its range. Call
+		// it with no writer running.
+		bool validate() const
+		{
+			std::shared_lock< std::shared_mutex > layout( m_layout );
+
+			for( SizeT i = 0; i < m_shards.size(); ++i )
+			{
+				Shard const & shard = *m_shards[ i ];
+				std::lock_guard< std::mutex > lock( shard.m_lock );
+				TreeT const & tree = shard.m_tree;
+
+				if( !tree.validate() ||
+				    shard.m_size.load( std::memory_order_relaxed ) !=
+				        tree.getSize() )
+				{
+					return false;
+				}
+
+				if( tree.getSize() == 0 )
+				{
+					continue;
+				}
+
+				// Shards past the last bound are unused.
+				if( i > m_bounds.size() )
+				{
+					return false;
+				}
+
+				if( i > 0 && less( *tree.begin(), m_bounds[ i - 1 ] ) )
+				{
+					return false;
+				}
+
+				if( i < m_bounds.size() && !less( *tree.rbegin(), m_bounds[ i ] ) )
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+
+		LessT getLess() const
+		{
+			return LessBase::get();
+		}
+
+		template< class _K1, class _K2 >
+		bool less( _K1 const & k1, _K2 const & k2 ) const
+		{
+			return LessBase::get()( k1, k2 );
+		}
+
+		private:
+
+		struct alignas( 64 ) Shard
+		{
+			explicit Shard( LessT const & lessFunc ):
+				m_tree( lessFunc, AllocT{} ),
+				m_size{ 0 }
+			{}
+
+			mutable std::mutex		m_lock;
+			TreeT					m_tree;
+			std::atomic< SizeT >	m_size;
+		};
+
+		// Key range of a shard, together with the shard it came from.
+		using PieceT = std::pair< SizeT, TreeT >;
+
+		// Shard i holds the keys from m_bounds[ i - 1 ] up to m_bounds[ i ],
+		// the shards past the last bound are empty.
+		template< class _K >
+		SizeT getIndex( _K const & key ) const
+		{
+			return SizeT( std::upper_bound( m_bounds.begin(), m_bounds.end(),
+				key, [ this ]( _K const & k, KeyT const & bound )
+				{
+					return less( k, bound );
+				} ) - m_bounds.begin() );
+		}
+
+		template< class _K >
+		bool addKey( _K && key )
+		{
+			bool added = false;
+			SizeT size = 0;
+			{
+				std::shared_lock< std::shared_mutex > layout( m_layout );
+				Shard & shard = *m_shards[ getIndex( key ) ];
+				std::lock_guard< std::mutex > lock( shard.m_lock );
+
+				typename TreeT::Node * node = nullptr;
+				added = shard.m_tree.add( std::forward< _K >( key ), node );
+				size = shard.m_tree.getSize();
+				shard.m_size.store( size, std::memory_order_relaxed );
+			}
+
+			if( size > m_limit.load( std::memory_order_relaxed ) )
+			{
+				rebalanceDrifted();
+			}
+			return added;
+		}
+
+		template< class _K >
+		bool removeKey( _K const & key )
+		{
+			std::shared_lock< std::shared_mutex > layout( m_layout );
+			Shard & shard = *m_shards[ getIndex( key ) ];
+			std::lock_guard< std::mutex > lock( shard.m_lock );
+
+			if( !shard.m_tree.remove( key ) )
+			{
+				return false;
+			}
+			shard.m_size.store( shard.m_tree.getSize(),
+			                    std::memory_order_relaxed );
+			return true;
+		}
+
+		template< class _K >
+		bool containsKey( _K const & key ) const
+		{
+			std::shared_lock< std::shared_mutex > layout( m_layout );
+			Shard const & shard = *m_shards[ getIndex( key ) ];
+			std::lock_guard< std::mutex > lock( shard.m_lock );
+
+			return shard.m_tree.contains( key );
+		}
+
+		// Rebalances unless another writer has done so meanwhile.
+		void rebalanceDrifted()
+		{
+			SizeT limit = m_limit.load( std::memory_order_relaxed );
+
+			for( auto & shard: m_shards )
+			{
+				if( shard->m_size.load( std::memory_order_relaxed ) > limit )
+				{
+					std::unique_lock< std::shared_mutex > layout( m_layout );
+
+					if( isDrifted() )
+					{
+						balanceShards();
+					}
+					return;
+				}
+			}
+		}
+
+		bool isDrifted() const
+		{
+			for( auto & shard: m_shards )
+			{
+				if( shard->m_tree.getSize() > m_limit.load(
+					std::memory_order_relaxed ) )
+				{
+					return true;
+				}
+			}
+			return false;
+		}
+
+		// Points at the key ranked offset in tree, stepping from position,
+		// the key ranked from, unless ORDER_STATISTICS selects it directly.
+		static KeyT const * findKey( TreeT const & tree,
+		                             typename TreeT::const_iterator & position,
+		                             SizeT from, SizeT offset )
+		{
+			if constexpr( TreeT::ORDER_STATISTICS )
+			{
+				return &tree.select( offset )->getKey();
+			}
+			else
+			{
+				std::advance( position, offset - from );
+				return &*position;
+			}
+		}
+
+		// Spreads the keys evenly over as many shards as have at least
+		// MIN_SHARD_SIZE keys. Each shard is split at the new bounds into
+		// pieces, which are joined onto their new shards. Pieces staying
+		// in their shard are joined in logarithmic time; the others are
+		// moved into new nodes from the arena of their new shard. Should an
+		// allocation fail, the keys of the pieces not yet moved are lost,
+		// but the shards stay valid.
+		void balanceShards()
+		{
+			SizeT shardCount = m_shards.size();
+			SizeT total = 0;
+
+			for( auto & shard: m_shards )
+			{
+				total += shard->m_tree.getSize();
+			}
+			SizeT used = std::min( std::max( total / MIN_SHARD_SIZE,
+			                                 SizeT( 1 ) ), shardCount );
+
+			// Shards get at most one piece from each shard. Reserving them
+			// up front and splitting at keys left in their nodes leaves
+			// nothing to allocate or copy while splitting.
+			std::vector< std::vector< PieceT > > pieces( shardCount );
+
+			for( auto & shardPieces: pieces )
+			{
+				shardPieces.reserve( shardCount );
+			}
+			std::vector< SizeT > targets;
+			std::vector< KeyT const * > starts;
+			targets.reserve( shardCount );
+			starts.reserve( shardCount );
+			SizeT rank = 0;
+			SizeT target = 0;
+			SizeT end = total / used;
+
+			for( SizeT i = 0; i < shardCount; ++i )
+			{
+				TreeT & tree = m_shards[ i ]->m_tree;
+				SizeT size = tree.getSize();
+				typename TreeT::const_iterator position = tree.begin();
+				SizeT from = 0;
+				targets.clear();
+				starts.clear();
+
+				// Finds where each piece starts in one in-order pass.
+				for( SizeT offset = 0; offset < size; )
+				{
+					while( rank >= end )
+					{
+						++target;
+						end = total * ( target + 1 ) / used;
+					}
+					targets.push_back( target );
+					starts.push_back( findKey( tree, position, from, offset ) );
+					from = offset;
+					SizeT count = std::min( size - offset, end - rank );
+					offset += count;
+					rank += count;
+				}
+
+				// Splits off the pieces from the last, leaving the first in
+				// tree.
+				for( SizeT j = targets.size(); j-- > 1; )
+				{
+					pieces[ targets[ j ] ].emplace_back( i,
+						tree.split( *starts[ j ] ) );
+				}
+
+				if( size > 0 )
+				{
+					pieces[ targets[ 0 ] ].emplace_back( i, std::move( tree ) );
+				}
+			}
+			std::exception_ptr error;
+
+			for( SizeT i = 0; i < shardCount; ++i )
+			{
+				Shard & shard = *m_shards[ i ];
+
+				for( auto & piece: pieces[ i ] )
+				{
+					// After a failure only pieces of the shard's own arena
+					// are taken back, which cannot fail.
+					if( error != nullptr && piece.first != i )
+					{
+						continue;
+					}
+
+					try
+					{
+						shard.m_tree.join( std::move( piece.second ) );
+					}
+					catch( ... )
+					{
+						error = std::current_exception();
+					}
+				}
+				shard.m_size.store( shard.m_tree.getSize(),
+				                    std::memory_order_relaxed );
+			}
+			updateBounds();
+			m_limit.store( DRIFT_RATIO * std::max( MIN_SHARD_SIZE,
+				total / shardCount ), std::memory_order_relaxed );
+
+			if( error != nullptr )
+			{
+				std::rethrow_exception( error );
+			}
+		}
+
+		// Bounds each shard by the smallest key of the next shard holding
+		// any, so that empty shards get empty ranges.
+		void updateBounds()
+		{
+			SizeT used = m_shards.size();
+
+			while( used > 1 && m_shards[ used - 1 ]->m_tree.getSize() == 0 )
+			{
+				--used;
+			}
+			m_bounds.clear();
+
+			for( SizeT i = 1; i < used; ++i )
+			{
+				SizeT next = i;
+
+				while( m_shards[ next ]->m_tree.getSize() == 0 )
+				{
+					++next;
+				}
+				m_bounds.push_back( *m_shards[ next ]->m_tree.begin() );
+			}
+		}
+
+		std::vector< std::unique_ptr< Shard > >	m_shards;
+		std::vector< KeyT >						m_bounds;
+		std::atomic< SizeT >					m_limit;
+		mutable std::shared_mutex				m_layout;
+	};
+}
+
+#endif
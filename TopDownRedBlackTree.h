@@ -0,0 +1,1051 @@
+#ifndef UTIL_TOPDOWNREDBLACKTREE_H
+#define UTIL_TOPDOWNREDBLACKTREE_H
+
+#include <functional>
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+#include <cstddef>
+#include <initializer_list>
+#include <limits>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "RedBlackTree.h"
+
+namespace util
+{
+	// Red-black tree whose nodes hold no parent link. Insertion and removal
+	// rebalance on the way down in a single pass, so they never climb back
+	// up, and iterators keep the path from the root in a small fixed-size
+	// stack. Removal moves the predecessor key into the removed key's node,
+	// so keys must be move-assignable. This is a container of its own
+	// rather than a RedBlackTree option because every RedBlackTree
+	// operation, from the fixup cases to split and join, walks parent
+	// links.
+	template< class _KeyT,
+	          class _LessT = std::less< _KeyT >,
+	          class _AllocT = std::allocator< _KeyT > >
+	class TopDownRedBlackTree: private detail::Compressed< _LessT >
+	{
+		using LessBase = detail::Compressed< _LessT >;
+
+		public:
+
+		using KeyT = _KeyT;
+		using LessT = _LessT;
+		using AllocT = _AllocT;
+		using SizeT = std::size_t;
+
+		// A tree of n nodes is at most 2 log2( n + 1 ) high, so capping the
+		// size at 2^32 - 1 keys, over 64 GB of nodes, caps the path every
+		// iterator holds at 64 pointers, 512 bytes with 64-bit pointers.
+		static SizeT constexpr MAX_HEIGHT =
+			2 * std::min( std::numeric_limits< SizeT >::digits, 32 );
+		static SizeT constexpr MAX_SIZE =
+			std::numeric_limits< SizeT >::max() >>
+			( std::numeric_limits< SizeT >::digits - MAX_HEIGHT / 2 );
+
+		private:
+
+		struct Node;
+
+		// The part of a node the rebalancing steps link to, which a false
+		// root above the tree provides as well.
+		struct Links
+		{
+			Node *	m_children[ 2 ];
+		};
+
+		struct Node: Links
+		{
+			template< class... _Args >
+			explicit Node( std::in_place_t, _Args && ... args ):
+				Links{ { nullptr, nullptr } },
+				m_key( std::forward< _Args >( args )... ),
+				m_red{ true }
+			{}
+
+			KeyT	m_key;
+			bool	m_red;
+		};
+
+		template< class _K >
+		using IfTransparentT = typename std::enable_if<
+			detail::IsTransparent< LessT >::value, _K >::type;
+
+		public:
+
+		// Iterators are invalidated by any change to the tree.
+		class const_iterator
+		{
+			public:
+
+			friend TopDownRedBlackTree;
+
+			using iterator_category = std::bidirectional_iterator_tag;
+			using value_type = KeyT;
+			using difference_type = std::ptrdiff_t;
+			using reference = KeyT const &;
+			using pointer = KeyT const *;
+
+			const_iterator():
+				m_tree{ nullptr },
+				m_depth{ 0 }
+			{}
+
+			// Only the occupied part of the path is copied.
+			const_iterator( const_iterator const & other ):
+				m_tree{ other.m_tree },
+				m_depth{ other.m_depth }
+			{
+				std::copy( other.m_path, other.m_path + m_depth, m_path );
+			}
+
+			const_iterator & operator=( const_iterator const & other )
+			{
+				m_tree = other.m_tree;
+				m_depth = other.m_depth;
+				std::copy( other.m_path, other.m_path + m_depth, m_path );
+				return *this;
+			}
+
+			reference operator*() const
+			{
+				return getNode()->m_key;
+			}
+
+			pointer operator->() const
+			{
+				return &( getNode()->m_key );
+			}
+
+			const_iterator & operator++()
+			{
+				assert( m_depth > 0 );
+
+				Node const * node = m_path[ m_depth - 1 ];
+
+				if( node->m_children[ 1 ] != nullptr )
+				{
+					pushEnd( node->m_children[ 1 ], 0 );
+				}
+				else
+				{
+					// Climb out of right subtrees.
+					do
+					{
+						node = m_path[ --m_depth ];
+					}
+					while( m_depth > 0 &&
+					       m_path[ m_depth - 1 ]->m_children[ 1 ] == node );
+				}
+				return *this;
+			}
+
+			const_iterator operator++( int )
+			{
+				const_iterator result = *this;
+				++( *this );
+				return result;
+			}
+
+			const_iterator & operator--()
+			{
+				if( m_depth == 0 )
+				{
+					// Step back from end.
+					pushEnd( m_tree->m_root, 1 );
+					return *this;
+				}
+				Node const * node = m_path[ m_depth - 1 ];
+
+				if( node->m_children[ 0 ] != nullptr )
+				{
+					pushEnd( node->m_children[ 0 ], 1 );
+				}
+				else
+				{
+					// Climb out of left subtrees.
+					do
+					{
+						node = m_path[ --m_depth ];
+					}
+					while( m_depth > 0 &&
+					       m_path[ m_depth - 1 ]->m_children[ 0 ] == node );
+				}
+				return *this;
+			}
+
+			const_iterator operator--( int )
+			{
+				const_iterator result = *this;
+				--( *this );
+				return result;
+			}
+
+			bool operator==( const_iterator const & other ) const
+			{
+				return ( getNode() == other.getNode() );
+			}
+
+			bool operator!=( const_iterator const & other ) const
+			{
+				return !( *this == other );
+			}
+
+			private:
+
+			explicit const_iterator( TopDownRedBlackTree const * tree ):
+				m_tree{ tree },
+				m_depth{ 0 }
+			{}
+
+			Node const * getNode() const
+			{
+				return ( m_depth > 0 ? m_path[ m_depth - 1 ] : nullptr );
+			}
+
+			void push( Node const * node )
+			{
+				assert( m_depth < MAX_HEIGHT );
+				m_path[ m_depth++ ] = node;
+			}
+
+			// Pushes node and the nodes down its side.
+			void pushEnd( Node const * node, SizeT side )
+			{
+				for( ; node != nullptr; node = node->m_children[ side ] )
+				{
+					push( node );
+				}
+			}
+
+			TopDownRedBlackTree const *	m_tree;
+			SizeT						m_depth;
+			Node const *				m_path[ MAX_HEIGHT ];
+		};
+
+		using iterator = const_iterator;
+		using const_reverse_iterator = std::reverse_iterator< const_iterator >;
+		using reverse_iterator = const_reverse_iterator;
+
+		using NodeAllocT = typename std::allocator_traits< AllocT >::
+			template rebind_alloc< Node >;
+		using NodeAllocTraits = std::allocator_traits< NodeAllocT >;
+
+		TopDownRedBlackTree():
+			TopDownRedBlackTree( LessT{} )
+		{}
+
+		explicit TopDownRedBlackTree( LessT const & lessFunc,
+		                              AllocT const & allocator = AllocT{} ):
+			LessBase( lessFunc ),
+			m_root{ nullptr },
+			m_size{ 0 },
+			m_allocator{ allocator }
+		{}
+
+		explicit TopDownRedBlackTree( AllocT const & allocator ):
+			TopDownRedBlackTree( LessT{}, allocator )
+		{}
+
+		TopDownRedBlackTree( std::initializer_list< KeyT > keys,
+		                     LessT const & lessFunc = LessT{},
+		                     AllocT const & allocator = AllocT{} ):
+			TopDownRedBlackTree( lessFunc, allocator )
+		{
+			for( auto & key: keys )
+			{
+				add( key );
+			}
+		}
+
+		template< class _FirstIter, class _LastIter >
+		TopDownRedBlackTree( _FirstIter first, _LastIter last,
+		                     LessT const & lessFunc = LessT{},
+		                     AllocT const & allocator = AllocT{} ):
+			TopDownRedBlackTree( lessFunc, allocator )
+		{
+			for( ; first != last; ++first )
+			{
+				add( *first );
+			}
+		}
+
+		// Builds the tree in linear time from a forward range of strictly
+		// increasing keys.
+		template< class _Iter >
+		TopDownRedBlackTree( SortedUniqueT, _Iter first, _Iter last,
+		                     LessT const & lessFunc = LessT{},
+		                     AllocT const & allocator = AllocT{} ):
+			TopDownRedBlackTree( lessFunc, allocator )
+		{
+			buildSorted( first, SizeT( std::distance( first, last ) ) );
+		}
+
+		template< class _Iter >
+		TopDownRedBlackTree( SortedUniqueT, _Iter first, _Iter last,
+		                     AllocT const & allocator ):
+			TopDownRedBlackTree( SORTED_UNIQUE, first, last, LessT{},
+			                     allocator )
+		{}
+
+		// Copies clone the node shape and colours of other.
+		TopDownRedBlackTree( TopDownRedBlackTree const & other ):
+			LessBase( other.LessBase::get() ),
+			m_root{ nullptr },
+			m_size{ 0 },
+			m_allocator{ NodeAllocTraits::
+			             select_on_container_copy_construction(
+			                 other.m_allocator ) }
+		{
+			copyNodes( other );
+		}
+
+		TopDownRedBlackTree( TopDownRedBlackTree && other ) noexcept:
+			LessBase( other.LessBase::get() ),
+			m_root{ nullptr },
+			m_size{ 0 },
+			m_allocator{ std::move( other.m_allocator ) }
+		{
+			steal( other );
+		}
+
+		TopDownRedBlackTree & operator=( TopDownRedBlackTree const & other )
+		{
+			if( this == &other )
+			{
+				return *this;
+			}
+			clear();
+			LessBase::get() = other.LessBase::get();
+
+			if constexpr( NodeAllocTraits::
+			              propagate_on_container_copy_assignment::value )
+			{
+				m_allocator = other.m_allocator;
+			}
+			copyNodes( other );
+			return *this;
+		}
+
+		TopDownRedBlackTree & operator=( TopDownRedBlackTree && other )
+		{
+			if( this == &other )
+			{
+				return *this;
+			}
+			clear();
+			LessBase::get() = other.LessBase::get();
+
+			if constexpr( NodeAllocTraits::
+			              propagate_on_container_move_assignment::value )
+			{
+				m_allocator = std::move( other.m_allocator );
+			}
+			else if( !( m_allocator == other.m_allocator ) )
+			{
+				// Nodes cannot change allocator, so the keys go through a
+				// buffer and are built into a tree here in linear time.
+				// Keys whose move may throw are copied, which leaves other
+				// intact if one fails.
+				std::vector< KeyT > keys;
+				keys.reserve( other.m_size );
+
+				for( KeyT const & key: other )
+				{
+					keys.push_back( std::move_if_noexcept(
+						const_cast< KeyT & >( key ) ) );
+				}
+				other.clear();
+				buildSorted( std::make_move_iterator( keys.begin() ),
+				             keys.size() );
+				return *this;
+			}
+			steal( other );
+			return *this;
+		}
+
+		~TopDownRedBlackTree()
+		{
+			clear();
+		}
+
+		bool add( KeyT const & key )
+		{
+			return insert( key, [ & ]{ return createNode( key ); } ).second;
+		}
+
+		bool add( KeyT && key )
+		{
+			return insert( key,
+				[ & ]{ return createNode( std::move( key ) ); } ).second;
+		}
+
+		// Constructs the key first, which is dropped if already present.
+		template< class... _Args >
+		std::pair< const_iterator, bool > emplace( _Args && ... args )
+		{
+			Node * node = createNode( std::forward< _Args >( args )... );
+
+			try
+			{
+				std::pair< const_iterator, bool > result =
+					insert( node->m_key, [ node ]{ return node; } );
+
+				if( !result.second )
+				{
+					destroyNode( node );
+				}
+				return result;
+			}
+			catch( ... )
+			{
+				destroyNode( node );
+				throw;
+			}
+		}
+
+		bool remove( KeyT const & key )
+		{
+			return removeKey( key );
+		}
+
+		template< class _K, class = IfTransparentT< _K > >
+		bool remove( _K const & key )
+		{
+			return removeKey( key );
+		}
+
+		const_iterator find( KeyT const & key ) const
+		{
+			return findKey( key );
+		}
+
+		template< class _K, class = IfTransparentT< _K > >
+		const_iterator find( _K const & key ) const
+		{
+			return findKey( key );
+		}
+
+		bool contains( KeyT const & key ) const
+		{
+			return ( findNode( key ) != nullptr );
+		}
+
+		template< class _K, class = IfTransparentT< _K > >
+		bool contains( _K const & key ) const
+		{
+			return ( findNode( key ) != nullptr );
+		}
+
+		// First key not less than key.
+		const_iterator lowerBound( KeyT const & key ) const
+		{
+			return findBound( key, false );
+		}
+
+		template< class _K, class = IfTransparentT< _K > >
+		const_iterator lowerBound( _K const & key ) const
+		{
+			return findBound( key, false );
+		}
+
+		// First key greater than key.
+		const_iterator upperBound( KeyT const & key ) const
+		{
+			return findBound( key, true );
+		}
+
+		template< class _K, class = IfTransparentT< _K > >
+		const_iterator upperBound( _K const & key ) const
+		{
+			return findBound( key, true );
+		}
+
+		// Range of the keys equal to key, empty or holding one key.
+		std::pair< const_iterator, const_iterator >
+		equalRange( KeyT const & key ) const
+		{
+			return getEqualRange( key );
+		}
+
+		template< class _K, class = IfTransparentT< _K > >
+		std::pair< const_iterator, const_iterator >
+		equalRange( _K const & key ) const
+		{
+			return getEqualRange( key );
+		}
+
+		const_iterator begin() const
+		{
+			const_iterator result( this );
+			result.pushEnd( m_root, 0 );
+			return result;
+		}
+
+		const_iterator end() const
+		{
+			return const_iterator( this );
+		}
+
+		const_reverse_iterator rbegin() const
+		{
+			return const_reverse_iterator( end() );
+		}
+
+		const_reverse_iterator rend() const
+		{
+			return const_reverse_iterator( begin() );
+		}
+
+		SizeT getSize() const
+		{
+			return m_size;
+		}
+
+		AllocT getAllocator() const
+		{
+			return AllocT( m_allocator );
+		}
+
+		LessT getLess() const
+		{
+			return LessBase::get();
+		}
+
+		void clear()
+		{
+			destroyTree( m_root );
+			m_root = nullptr;
+			m_size = 0;
+		}
+
+		// Checks ordering, colours, black heights and the size.
+		bool validate() const
+		{
+			SizeT count = 0;
+			return ( !isRed( m_root ) &&
+			         getValidHeight( m_root, nullptr, nullptr, count ) !=
+			             INVALID &&
+			         count == m_size );
+		}
+
+		template< class _K1, class _K2 >
+		bool less( _K1 const & k1, _K2 const & k2 ) const
+		{
+			return LessBase::get()( k1, k2 );
+		}
+
+		private:
+
+		static SizeT constexpr INVALID = ~SizeT( 0 );
+
+		static bool isRed( Node const * node )
+		{
+			return ( node != nullptr && node->m_red );
+		}
+
+		static Node * getNode( Links * links )
+		{
+			return static_cast< Node * >( links );
+		}
+
+		// Rotates node in direction side, the child taking its place.
+		static Node * rotate( Node * node, bool side )
+		{
+			Node * child = node->m_children[ !side ];
+			node->m_children[ !side ] = child->m_children[ side ];
+			child->m_children[ side ] = node;
+			node->m_red = true;
+			child->m_red = false;
+			return child;
+		}
+
+		static Node * rotateTwice( Node * node, bool side )
+		{
+			node->m_children[ !side ] = rotate( node->m_children[ !side ],
+			                                    !side );
+			return rotate( node, side );
+		}
+
+		// Adds the node make returns unless key is present, splitting
+		// 4-nodes on the way down. Returns the position of key, its path
+		// kept up to date through the rotations on the way.
+		template< class _Make >
+		std::pair< const_iterator, bool > insert( KeyT const & key,
+		                                          _Make && make )
+		{
+			std::pair< const_iterator, bool > result( const_iterator( this ),
+			                                          false );
+			const_iterator & path = result.first;
+
+			if( m_root == nullptr )
+			{
+				m_root = make();
+				m_root->m_red = false;
+				++m_size;
+				path.push( m_root );
+				result.second = true;
+				return result;
+			}
+			Links head{ { nullptr, m_root } };
+			Links * top = &head;
+			Node * grandparent = nullptr;
+			Node * parent = nullptr;
+			Node * node = m_root;
+			Node * added = nullptr;
+			bool side = false;
+			bool last = false;
+
+			try
+			{
+				while( true )
+				{
+					if( node == nullptr )
+					{
+						assert( m_size < MAX_SIZE );
+						node = make();
+						parent->m_children[ side ] = node;
+						added = node;
+					}
+					else if( isRed( node->m_children[ 0 ] ) &&
+					         isRed( node->m_children[ 1 ] ) )
+					{
+						node->m_red = true;
+						node->m_children[ 0 ]->m_red = false;
+						node->m_children[ 1 ]->m_red = false;
+					}
+					path.push( node );
+
+					// Fix two reds in a row. The path ends in grandparent,
+					// parent and node, and loses whichever the rotations
+					// move below node.
+					if( isRed( node ) && isRed( parent ) )
+					{
+						bool topSide = ( top->m_children[ 1 ] == grandparent );
+						Node const * * end = path.m_path + path.m_depth;
+
+						if( node == parent->m_children[ last ] )
+						{
+							top->m_children[ topSide ] =
+								rotate( grandparent, !last );
+							end[ -3 ] = parent;
+							end[ -2 ] = node;
+							path.m_depth -= 1;
+						}
+						else
+						{
+							top->m_children[ topSide ] =
+								rotateTwice( grandparent, !last );
+							end[ -3 ] = node;
+							path.m_depth -= 2;
+						}
+					}
+
+					if( added != nullptr )
+					{
+						break;
+					}
+					bool greater = less( node->m_key, key );
+
+					if( !greater && !less( key, node->m_key ) )
+					{
+						break;
+					}
+					last = side;
+					side = greater;
+
+					if( grandparent != nullptr )
+					{
+						top = grandparent;
+					}
+					grandparent = parent;
+					parent = node;
+					node = node->m_children[ side ];
+				}
+			}
+			catch( ... )
+			{
+				// Each step leaves a valid tree but for a red root.
+				m_root = head.m_children[ 1 ];
+				m_root->m_red = false;
+				throw;
+			}
+			m_root = head.m_children[ 1 ];
+			m_root->m_red = false;
+
+			if( added != nullptr )
+			{
+				++m_size;
+				result.second = true;
+			}
+			return result;
+		}
+
+		// Pushes a red node down the search path, so that the node finally
+		// unlinked is red. The key found is replaced by its predecessor.
+		template< class _K >
+		bool removeKey( _K const & key )
+		{
+			if( m_root == nullptr )
+			{
+				return false;
+			}
+			Links head{ { nullptr, m_root } };
+			Links * grandparent = nullptr;
+			Links * parent = nullptr;
+			Links * links = &head;
+			Node * found = nullptr;
+			Node * node = nullptr;
+			bool side = true;
+
+			while( links->m_children[ side ] != nullptr )
+			{
+				bool last = side;
+				grandparent = parent;
+				parent = links;
+				node = links->m_children[ side ];
+				links = node;
+				side = less( node->m_key, key );
+
+				if( !side && !less( key, node->m_key ) )
+				{
+					found = node;
+				}
+
+				if( isRed( node ) || isRed( node->m_children[ side ] ) )
+				{
+					continue;
+				}
+
+				if( isRed( node->m_children[ !side ] ) )
+				{
+					parent->m_children[ last ] = rotate( node, side );
+					parent = parent->m_children[ last ];
+					continue;
+				}
+				Node * sibling = parent->m_children[ !last ];
+
+				if( sibling == nullptr )
+				{
+					continue;
+				}
+
+				if( !isRed( sibling->m_children[ 0 ] ) &&
+				    !isRed( sibling->m_children[ 1 ] ) )
+				{
+					// Merge into a 4-node.
+					getNode( parent )->m_red = false;
+					sibling->m_red = true;
+					node->m_red = true;
+				}
+				else
+				{
+					// Borrow from the sibling.
+					bool topSide = ( grandparent->m_children[ 1 ] == parent );
+
+					if( isRed( sibling->m_children[ last ] ) )
+					{
+						grandparent->m_children[ topSide ] =
+							rotateTwice( getNode( parent ), last );
+					}
+					else
+					{
+						grandparent->m_children[ topSide ] =
+							rotate( getNode( parent ), last );
+					}
+					Node * top = grandparent->m_children[ topSide ];
+					node->m_red = true;
+					top->m_red = true;
+					top->m_children[ 0 ]->m_red = false;
+					top->m_children[ 1 ]->m_red = false;
+				}
+			}
+
+			if( found != nullptr )
+			{
+				if( found != node )
+				{
+					found->m_key = std::move( node->m_key );
+				}
+				parent->m_children[ parent->m_children[ 1 ] == node ] =
+					node->m_children[ node->m_children[ 0 ] == nullptr ];
+				destroyNode( node );
+				--m_size;
+			}
+			m_root = head.m_children[ 1 ];
+
+			if( m_root != nullptr )
+			{
+				m_root->m_red = false;
+			}
+			return ( found != nullptr );
+		}
+
+		template< class _K >
+		Node const * findNode( _K const & key ) const
+		{
+			Node const * node = m_root;
+
+			while( node != nullptr )
+			{
+				if( less( key, node->m_key ) )
+				{
+					node = node->m_children[ 0 ];
+				}
+				else if( less( node->m_key, key ) )
+				{
+					node = node->m_children[ 1 ];
+				}
+				else
+				{
+					return node;
+				}
+			}
+			return nullptr;
+		}
+
+		template< class _K >
+		const_iterator findKey( _K const & key ) const
+		{
+			const_iterator result( this );
+
+			for( Node const * node = m_root; node != nullptr; )
+			{
+				result.push( node );
+
+				if( less( key, node->m_key ) )
+				{
+					node = node->m_children[ 0 ];
+				}
+				else if( less( node->m_key, key ) )
+				{
+					node = node->m_children[ 1 ];
+				}
+				else
+				{
+					return result;
+				}
+			}
+			result.m_depth = 0;
+			return result;
+		}
+
+		// The bound is the last node left from, so the path to it is a
+		// prefix of the search path.
+		template< class _K >
+		const_iterator findBound( _K const & key, bool upper ) const
+		{
+			const_iterator result( this );
+			SizeT depth = 0;
+
+			for( Node const * node = m_root; node != nullptr; )
+			{
+				result.push( node );
+
+				if( upper ? less( key, node->m_key ) :
+				            !less( node->m_key, key ) )
+				{
+					depth = result.m_depth;
+					node = node->m_children[ 0 ];
+				}
+				else
+				{
+					node = node->m_children[ 1 ];
+				}
+			}
+			result.m_depth = depth;
+			return result;
+		}
+
+		template< class _K >
+		std::pair< const_iterator, const_iterator >
+		getEqualRange( _K const & key ) const
+		{
+			const_iterator first = findBound( key, false );
+			const_iterator last = first;
+			Node const * node = first.getNode();
+
+			if( node != nullptr && !less( key, node->m_key ) )
+			{
+				++last;
+			}
+			return { first, last };
+		}
+
+		template< class... _Args >
+		Node * createNode( _Args && ... args )
+		{
+			Node * node = NodeAllocTraits::allocate( m_allocator, 1 );
+
+			try
+			{
+				::new( static_cast< void * >( node ) )
+					Node( std::in_place, std::forward< _Args >( args )... );
+			}
+			catch( ... )
+			{
+				NodeAllocTraits::deallocate( m_allocator, node, 1 );
+				throw;
+			}
+			return node;
+		}
+
+		// Builds the tree from count strictly increasing keys at first.
+		// Splitting each range in half fills every level but the last,
+		// whose nodes are red. This tree must be empty.
+		template< class _Iter >
+		void buildSorted( _Iter first, SizeT count )
+		{
+			assert( m_root == nullptr && count <= MAX_SIZE );
+
+			SizeT fullLevels = 0;
+
+			while( ( SizeT( 2 ) << fullLevels ) - 1 <= count )
+			{
+				++fullLevels;
+			}
+			m_root = buildRange( first, count, 0, fullLevels );
+			m_size = count;
+			assert( validate() );
+		}
+
+		// Builds a subtree of the count keys from first at depth, advancing
+		// first past them.
+		template< class _Iter >
+		Node * buildRange( _Iter & first, SizeT count, SizeT depth,
+		                   SizeT redDepth )
+		{
+			if( count == 0 )
+			{
+				return nullptr;
+			}
+			SizeT leftCount = ( count - 1 ) / 2;
+			Node * left = buildRange( first, leftCount, depth + 1, redDepth );
+			Node * node = nullptr;
+
+			try
+			{
+				node = createNode( *first );
+			}
+			catch( ... )
+			{
+				destroyTree( left );
+				throw;
+			}
+			++first;
+			node->m_red = ( depth == redDepth );
+			node->m_children[ 0 ] = left;
+
+			try
+			{
+				node->m_children[ 1 ] = buildRange( first, count - 1 - leftCount,
+				                                    depth + 1, redDepth );
+			}
+			catch( ... )
+			{
+				destroyTree( node );
+				throw;
+			}
+			return node;
+		}
+
+		void destroyNode( Node * node )
+		{
+			node->~Node();
+			NodeAllocTraits::deallocate( m_allocator, node, 1 );
+		}
+
+		void destroyTree( Node * node )
+		{
+			while( node != nullptr )
+			{
+				destroyTree( node->m_children[ 0 ] );
+				Node * right = node->m_children[ 1 ];
+				destroyNode( node );
+				node = right;
+			}
+		}
+
+		void steal( TopDownRedBlackTree & other )
+		{
+			assert( m_root == nullptr );
+
+			m_root = other.m_root;
+			m_size = other.m_size;
+			other.m_root = nullptr;
+			other.m_size = 0;
+		}
+
+		void copyNodes( TopDownRedBlackTree const & other )
+		{
+			assert( m_root == nullptr );
+
+			m_root = cloneTree( other.m_root );
+			m_size = other.m_size;
+		}
+
+		Node * cloneTree( Node const * source )
+		{
+			if( source == nullptr )
+			{
+				return nullptr;
+			}
+			Node * node = createNode( source->m_key );
+			node->m_red = source->m_red;
+
+			try
+			{
+				node->m_children[ 0 ] = cloneTree( source->m_children[ 0 ] );
+				node->m_children[ 1 ] = cloneTree( source->m_children[ 1 ] );
+			}
+			catch( ... )
+			{
+				destroyTree( node );
+				throw;
+			}
+			return node;
+		}
+
+		// Black height of the subtree between the optional bounds, or
+		// INVALID. Counts the nodes into count.
+		SizeT getValidHeight( Node const * node, Node const * low,
+		                      Node const * high, SizeT & count ) const
+		{
+			if( node == nullptr )
+			{
+				return 0;
+			}
+			++count;
+
+			if( ( low != nullptr && !less( low->m_key, node->m_key ) ) ||
+			    ( high != nullptr && !less( node->m_key, high->m_key ) ) ||
+			    ( node->m_red && ( isRed( node->m_children[ 0 ] ) ||
+			                       isRed( node->m_children[ 1 ] ) ) ) )
+			{
+				return INVALID;
+			}
+			SizeT left = getValidHeight( node->m_children[ 0 ], low, node,
+			                             count );
+			SizeT right = getValidHeight( node->m_children[ 1 ], node, high,
+			                              count );
+
+			if( left == INVALID || left != right )
+			{
+				return INVALID;
+			}
+			return left + !node->m_red;
+		}
+
+		Node *		m_root;
+		SizeT		m_size;
+		NodeAllocT	m_allocator;
+	};
+}
+
+#endif
@@ -0,0 +1,670 @@
+// Standalone benchmark comparing util::RedBlackTree against std::set,
+// util::TopDownRedBlackTree and util::BTree.
+//
+//   cmake -S benchmark -B bench && cmake --build bench
+//   ./bench/RedBlackTreeBenchmark [--max N] [--min N] [--strings]
+//
+// Reports nanoseconds per operation, node bytes per key for the containers
+// using the counting allocator and, on Linux when perf events are
+// available, cache misses per operation.
+
+#include "BTree.h"
+#include "RedBlackTree.h"
+#include "PoolAllocator.h"
+#include "TopDownRedBlackTree.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <numeric>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#if defined( __linux__ )
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	using SizeT = std::size_t;
+
+	// Live bytes handed out through CountingAllocator.
+	SizeT g_liveBytes = 0;
+
+	template< class _T >
+	class CountingAllocator
+	{
+		public:
+
+		using value_type = _T;
+
+		CountingAllocator() = default;
+
+		template< class _U >
+		CountingAllocator( CountingAllocator< _U > const & )
+		{}
+
+		_T * allocate( SizeT count )
+		{
+			g_liveBytes += count * sizeof( _T );
+			return std::allocator< _T >().allocate( count );
+		}
+
+		void deallocate( _T * block, SizeT count )
+		{
+			g_liveBytes -= count * sizeof( _T );
+			std::allocator< _T >().deallocate( block, count );
+		}
+
+		template< class _U >
+		bool operator==( CountingAllocator< _U > const & ) const
+		{
+			return true;
+		}
+
+		template< class _U >
+		bool operator!=( CountingAllocator< _U > const & ) const
+		{
+			return false;
+		}
+	};
+
+	class CacheMissCounter
+	{
+		public:
+
+		CacheMissCounter():
+			m_fd{ -1 }
+		{
+#if defined( __linux__ )
+			perf_event_attr attr;
+			std::memset( &attr, 0, sizeof( attr ) );
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.size = sizeof( attr );
+			attr.config = PERF_COUNT_HW_CACHE_MISSES;
+			attr.disabled = 1;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			m_fd = int( syscall( SYS_perf_event_open, &attr, 0, -1, -1, 0 ) );
+#endif
+		}
+
+		~CacheMissCounter()
+		{
+#if defined( __linux__ )
+			if( m_fd >= 0 )
+			{
+				close( m_fd );
+			}
+#endif
+		}
+
+		bool isAvailable() const
+		{
+			return m_fd >= 0;
+		}
+
+		void start()
+		{
+#if defined( __linux__ )
+			if( m_fd >= 0 )
+			{
+				ioctl( m_fd, PERF_EVENT_IOC_RESET, 0 );
+				ioctl( m_fd, PERF_EVENT_IOC_ENABLE, 0 );
+			}
+#endif
+		}
+
+		std::uint64_t stop()
+		{
+			std::uint64_t count = 0;
+#if defined( __linux__ )
+			if( m_fd >= 0 )
+			{
+				ioctl( m_fd, PERF_EVENT_IOC_DISABLE, 0 );
+
+				if( read( m_fd, &count, sizeof( count ) ) != sizeof( count ) )
+				{
+					count = 0;
+				}
+			}
+#endif
+			return count;
+		}
+
+		private:
+
+		int m_fd;
+	};
+
+	CacheMissCounter g_misses;
+
+	// Uniform interface over the containers under test.
+	template< class _KeyT >
+	struct StdSet
+	{
+		static char const * getName()
+		{
+			return "std::set";
+		}
+
+		std::set< _KeyT, std::less< _KeyT >,
+		          CountingAllocator< _KeyT > > m_set;
+
+		void add( _KeyT const & key )
+		{
+			m_set.insert( key );
+		}
+
+		bool contains( _KeyT const & key ) const
+		{
+			return m_set.find( key ) != m_set.end();
+		}
+
+		void containsMany( std::vector< _KeyT > const & keys,
+		                   std::vector< char > & results ) const
+		{
+			for( SizeT i = 0; i < keys.size(); ++i )
+			{
+				results[ i ] = contains( keys[ i ] );
+			}
+		}
+
+		void remove( _KeyT const & key )
+		{
+			m_set.erase( key );
+		}
+
+		template< class _F >
+		void forEach( _F f ) const
+		{
+			for( auto const & key: m_set )
+			{
+				f( key );
+			}
+		}
+	};
+
+	template< class _KeyT, class _TraitsT = util::TreeTraits >
+	struct RbTree
+	{
+		static char const * getName()
+		{
+			return ( _TraitsT::COMPACT_NODES ? "RedBlackTree+Compact"
+			                                 : "RedBlackTree" );
+		}
+
+		util::RedBlackTree< _KeyT, std::less< _KeyT >,
+		                    CountingAllocator< _KeyT >, _TraitsT > m_tree;
+
+		void add( _KeyT const & key )
+		{
+			m_tree.add( key );
+		}
+
+		bool contains( _KeyT const & key ) const
+		{
+			return m_tree.contains( key );
+		}
+
+		void containsMany( std::vector< _KeyT > const & keys,
+		                   std::vector< char > & results ) const
+		{
+			m_tree.containsMany( keys.begin(), keys.end(), results.begin() );
+		}
+
+		void remove( _KeyT const & key )
+		{
+			m_tree.remove( key );
+		}
+
+		template< class _F >
+		void forEach( _F f ) const
+		{
+			for( auto const & key: m_tree )
+			{
+				f( key );
+			}
+		}
+	};
+
+	template< class _KeyT >
+	struct PooledRbTree
+	{
+		static char const * getName()
+		{
+			return "RedBlackTree+Pool";
+		}
+
+		util::RedBlackTree< _KeyT, std::less< _KeyT >,
+		                    util::PoolAllocator< _KeyT > > m_tree;
+
+		void add( _KeyT const & key )
+		{
+			m_tree.add( key );
+		}
+
+		bool contains( _KeyT const & key ) const
+		{
+			return m_tree.contains( key );
+		}
+
+		void containsMany( std::vector< _KeyT > const & keys,
+		                   std::vector< char > & results ) const
+		{
+			m_tree.containsMany( keys.begin(), keys.end(), results.begin() );
+		}
+
+		void remove( _KeyT const & key )
+		{
+			m_tree.remove( key );
+		}
+
+		template< class _F >
+		void forEach( _F f ) const
+		{
+			for( auto const & key: m_tree )
+			{
+				f( key );
+			}
+		}
+	};
+
+	template< class _KeyT >
+	struct TopDownTree
+	{
+		static char const * getName()
+		{
+			return "TopDownTree";
+		}
+
+		util::TopDownRedBlackTree< _KeyT, std::less< _KeyT >,
+		                           CountingAllocator< _KeyT > > m_tree;
+
+		void add( _KeyT const & key )
+		{
+			m_tree.add( key );
+		}
+
+		bool contains( _KeyT const & key ) const
+		{
+			return m_tree.contains( key );
+		}
+
+		void containsMany( std::vector< _KeyT > const & keys,
+		                   std::vector< char > & results ) const
+		{
+			for( SizeT i = 0; i < keys.size(); ++i )
+			{
+				results[ i ] = contains( keys[ i ] );
+			}
+		}
+
+		void remove( _KeyT const & key )
+		{
+			m_tree.remove( key );
+		}
+
+		template< class _F >
+		void forEach( _F f ) const
+		{
+			for( auto const & key: m_tree )
+			{
+				f( key );
+			}
+		}
+	};
+
+	template< class _KeyT >
+	struct WideTree
+	{
+		static char const * getName()
+		{
+			return "BTree";
+		}
+
+		util::BTree< _KeyT, std::less< _KeyT >,
+		             CountingAllocator< _KeyT > > m_tree;
+
+		void add( _KeyT const & key )
+		{
+			m_tree.add( key );
+		}
+
+		bool contains( _KeyT const & key ) const
+		{
+			return m_tree.contains( key );
+		}
+
+		void containsMany( std::vector< _KeyT > const & keys,
+		                   std::vector< char > & results ) const
+		{
+			m_tree.containsMany( keys.begin(), keys.end(), results.begin() );
+		}
+
+		void remove( _KeyT const & key )
+		{
+			m_tree.remove( key );
+		}
+
+		template< class _F >
+		void forEach( _F f ) const
+		{
+			for( auto const & key: m_tree )
+			{
+				f( key );
+			}
+		}
+	};
+
+	template< class _KeyT >
+	_KeyT makeKey( std::uint64_t value );
+
+	template<>
+	std::uint64_t makeKey< std::uint64_t >( std::uint64_t value )
+	{
+		return value;
+	}
+
+	template<>
+	std::string makeKey< std::string >( std::uint64_t value )
+	{
+		// Fixed-width keys beyond the small string buffer.
+		char buffer[ 32 ];
+		std::snprintf( buffer, sizeof( buffer ), "key-%020llu",
+		               static_cast< unsigned long long >( value ) );
+		return buffer;
+	}
+
+	template< class _KeyT >
+	std::vector< _KeyT > makeKeys( std::vector< std::uint64_t > const & values )
+	{
+		std::vector< _KeyT > keys;
+		keys.reserve( values.size() );
+
+		for( std::uint64_t value: values )
+		{
+			keys.push_back( makeKey< _KeyT >( value ) );
+		}
+		return keys;
+	}
+
+	volatile SizeT g_sink = 0;
+
+	void report( char const * container, char const * workload, SizeT count,
+	             SizeT operations, double seconds, std::uint64_t misses,
+	             double bytesPerKey )
+	{
+		std::printf( "%-20s %-15s %10zu %10.1f", container, workload, count,
+		             seconds * 1e9 / double( operations ) );
+
+		if( bytesPerKey > 0 )
+		{
+			std::printf( " %10.1f", bytesPerKey );
+		}
+		else
+		{
+			std::printf( " %10s", "-" );
+		}
+
+		if( g_misses.isAvailable() )
+		{
+			std::printf( " %10.2f", double( misses ) / double( operations ) );
+		}
+		else
+		{
+			std::printf( " %10s", "n/a" );
+		}
+		std::printf( "\n" );
+	}
+
+	template< class _F >
+	double measure( _F f, std::uint64_t & misses )
+	{
+		auto start = std::chrono::steady_clock::now();
+		g_misses.start();
+		f();
+		misses = g_misses.stop();
+		auto stop = std::chrono::steady_clock::now();
+		return std::chrono::duration< double >( stop - start ).count();
+	}
+
+	template< class _ContainerT, class _KeyT >
+	void runInsert( char const * workload, std::vector< _KeyT > const & keys )
+	{
+		std::uint64_t misses = 0;
+		SizeT before = g_liveBytes;
+		double bytes = 0;
+		double seconds = 0;
+		{
+			_ContainerT container;
+			seconds = measure( [ & ]()
+			{
+				for( auto const & key: keys )
+				{
+					container.add( key );
+				}
+			}, misses );
+			bytes = double( g_liveBytes - before ) / double( keys.size() );
+		}
+		report( _ContainerT::getName(), workload, keys.size(), keys.size(),
+		        seconds, misses, bytes );
+	}
+
+	template< class _ContainerT, class _KeyT >
+	void runQueries( std::vector< _KeyT > const & keys,
+	                 std::vector< _KeyT > const & misses,
+	                 std::mt19937_64 & random )
+	{
+		_ContainerT container;
+
+		for( auto const & key: keys )
+		{
+			container.add( key );
+		}
+		std::vector< _KeyT > hits = keys;
+		std::shuffle( hits.begin(), hits.end(), random );
+		std::uint64_t missCount = 0;
+		SizeT found = 0;
+
+		double seconds = measure( [ & ]()
+		{
+			for( auto const & key: hits )
+			{
+				found += container.contains( key );
+			}
+		}, missCount );
+		report( _ContainerT::getName(), "find-hit", keys.size(), hits.size(),
+		        seconds, missCount, 0 );
+
+		std::vector< char > results( hits.size() );
+
+		seconds = measure( [ & ]()
+		{
+			container.containsMany( hits, results );
+		}, missCount );
+		found += SizeT( std::count( results.begin(), results.end(), 1 ) );
+		report( _ContainerT::getName(), "find-batch", keys.size(),
+		        hits.size(), seconds, missCount, 0 );
+
+		seconds = measure( [ & ]()
+		{
+			for( auto const & key: misses )
+			{
+				found += container.contains( key );
+			}
+		}, missCount );
+		report( _ContainerT::getName(), "find-miss", keys.size(),
+		        misses.size(), seconds, missCount, 0 );
+
+		seconds = measure( [ & ]()
+		{
+			container.forEach( [ & ]( _KeyT const & key )
+			{
+				found += sizeof( key );
+			} );
+		}, missCount );
+		report( _ContainerT::getName(), "iterate", keys.size(), keys.size(),
+		        seconds, missCount, 0 );
+
+		// Erase a random key and insert a fresh one, keeping size constant.
+		SizeT churn = std::min< SizeT >( keys.size(), 1000000 );
+
+		seconds = measure( [ & ]()
+		{
+			for( SizeT i = 0; i < churn; ++i )
+			{
+				container.remove( hits[ i ] );
+				container.add( misses[ i % misses.size() ] );
+				container.remove( misses[ i % misses.size() ] );
+				container.add( hits[ i ] );
+			}
+		}, missCount );
+		report( _ContainerT::getName(), "erase-churn", keys.size(),
+		        churn * 4, seconds, missCount, 0 );
+
+		// 80% lookups, 10% inserts, 10% erases.
+		SizeT operations = std::min< SizeT >( keys.size() * 2, 4000000 );
+		std::vector< std::uint32_t > choices( operations );
+
+		for( auto & choice: choices )
+		{
+			choice = std::uint32_t( random() );
+		}
+
+		seconds = measure( [ & ]()
+		{
+			for( SizeT i = 0; i < operations; ++i )
+			{
+				std::uint32_t choice = choices[ i ];
+				_KeyT const & hit = hits[ choice % hits.size() ];
+				_KeyT const & miss = misses[ choice % misses.size() ];
+
+				switch( ( choice >> 24 ) % 10 )
+				{
+					case 0:
+						container.add( miss );
+						break;
+
+					case 1:
+						container.remove( miss );
+						break;
+
+					default:
+						found += container.contains( hit );
+						break;
+				}
+			}
+		}, missCount );
+		report( _ContainerT::getName(), "mixed", keys.size(), operations,
+		        seconds, missCount, 0 );
+
+		g_sink = g_sink + found;
+	}
+
+	template< class _ContainerT, class _KeyT >
+	void runAll( std::vector< _KeyT > const & random,
+	             std::vector< _KeyT > const & sorted,
+	             std::vector< _KeyT > const & misses,
+	             std::mt19937_64 & generator )
+	{
+		runInsert< _ContainerT >( "insert-random", random );
+		runInsert< _ContainerT >( "insert-sorted", sorted );
+		std::vector< _KeyT > reversed( sorted.rbegin(), sorted.rend() );
+		runInsert< _ContainerT >( "insert-reverse", reversed );
+		runQueries< _ContainerT >( random, misses, generator );
+	}
+
+	template< class _KeyT >
+	void runSize( SizeT count, std::mt19937_64 & generator )
+	{
+		// Even values are stored, odd values are guaranteed misses.
+		std::vector< std::uint64_t > values( count );
+		std::iota( values.begin(), values.end(), std::uint64_t( 0 ) );
+
+		for( auto & value: values )
+		{
+			value *= 2;
+		}
+		std::vector< _KeyT > sorted = makeKeys< _KeyT >( values );
+		std::shuffle( values.begin(), values.end(), generator );
+		std::vector< _KeyT > random = makeKeys< _KeyT >( values );
+
+		for( auto & value: values )
+		{
+			value += 1;
+		}
+		values.resize( std::min< SizeT >( count, 1000000 ) );
+		std::vector< _KeyT > misses = makeKeys< _KeyT >( values );
+
+		if( std::is_same< _KeyT, std::string >::value )
+		{
+			// String order differs from numeric order.
+			std::sort( sorted.begin(), sorted.end() );
+		}
+
+		runAll< StdSet< _KeyT > >( random, sorted, misses, generator );
+		runAll< RbTree< _KeyT > >( random, sorted, misses, generator );
+		runAll< RbTree< _KeyT, util::CompactTraits > >( random, sorted, misses,
+		                                                 generator );
+		runAll< PooledRbTree< _KeyT > >( random, sorted, misses, generator );
+		runAll< TopDownTree< _KeyT > >( random, sorted, misses, generator );
+		runAll< WideTree< _KeyT > >( random, sorted, misses, generator );
+	}
+}
+
+int main( int argc, char ** argv )
+{
+	SizeT minCount = 1000;
+	SizeT maxCount = 1000000;
+	bool strings = false;
+
+	for( int i = 1; i < argc; ++i )
+	{
+		if( std::strcmp( argv[ i ], "--max" ) == 0 && i + 1 < argc )
+		{
+			maxCount = SizeT( std::strtoull( argv[ ++i ], nullptr, 10 ) );
+		}
+		else if( std::strcmp( argv[ i ], "--min" ) == 0 && i + 1 < argc )
+		{
+			minCount = SizeT( std::strtoull( argv[ ++i ], nullptr, 10 ) );
+		}
+		else if( std::strcmp( argv[ i ], "--strings" ) == 0 )
+		{
+			strings = true;
+		}
+		else
+		{
+			std::fprintf( stderr,
+			              "usage: %s [--min N] [--max N] [--strings]\n",
+			              argv[ 0 ] );
+			return 1;
+		}
+	}
+
+	std::printf( "%-20s %-15s %10s %10s %10s %10s\n", "container", "workload",
+	             "keys", "ns/op", "bytes/key", "misses/op" );
+	std::mt19937_64 generator( 42 );
+
+	for( SizeT count = minCount; count <= maxCount; count *= 10 )
+	{
+		if( strings )
+		{
+			runSize< std::string >( count, generator );
+		}
+		else
+		{
+			runSize< std::uint64_t >( count, generator );
+		}
+	}
+	return 0;
+}
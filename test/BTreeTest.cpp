@@ -0,0 +1,231 @@
+// Differential test of util::BTree against std::set, for keys searched
+// with vector compares and for keys that are not, and for nodes small
+// enough that every change splits or merges.
+
+#include "BTree.h"
+#include "TestUtil.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace
+{
+	struct SmallNodeTraits: util::BTreeTraits
+	{
+		static std::size_t constexpr NODE_BYTES = 64;
+	};
+
+	// Blocks held through every FailingAllocator, and allocations left
+	// before the next one throws, or -1 for no failure.
+	std::size_t g_live = 0;
+	int g_countdown = -1;
+
+	template< class _T >
+	struct FailingAllocator
+	{
+		using value_type = _T;
+
+		FailingAllocator() = default;
+
+		template< class _U >
+		FailingAllocator( FailingAllocator< _U > const & )
+		{}
+
+		_T * allocate( std::size_t count )
+		{
+			if( g_countdown >= 0 && g_countdown-- == 0 )
+			{
+				throw std::bad_alloc();
+			}
+			g_live += count;
+			return std::allocator< _T >{}.allocate( count );
+		}
+
+		void deallocate( _T * block, std::size_t count )
+		{
+			g_live -= count;
+			std::allocator< _T >{}.deallocate( block, count );
+		}
+
+		template< class _U >
+		bool operator==( FailingAllocator< _U > const & ) const
+		{
+			return true;
+		}
+
+		template< class _U >
+		bool operator!=( FailingAllocator< _U > const & ) const
+		{
+			return false;
+		}
+	};
+
+	// Keys spread over the whole range of _T, negative ones included, and
+	// keys either side of the sign bit, where lanes compared as signed and
+	// as unsigned disagree.
+	template< class _T >
+	_T makeNumber( int i )
+	{
+		if constexpr( std::is_floating_point< _T >::value )
+		{
+			return _T( i % 2 == 0 ? i : -i ) * _T( 0.25 );
+		}
+		else
+		{
+			using UnsignedT = typename std::make_unsigned< _T >::type;
+
+			UnsignedT signBit = UnsignedT( 1 ) << ( sizeof( _T ) * 8 - 1 );
+			UnsignedT value = ( i % 2 == 0 ?
+				UnsignedT( UnsignedT( i ) * UnsignedT( 0x9E3779B97F4A7C15u ) ) :
+				UnsignedT( signBit + UnsignedT( i / 2 ) - 500u ) );
+			return _T( value );
+		}
+	}
+
+	template< class _T >
+	void testNumbers( unsigned seed )
+	{
+		util::BTree< _T > tree;
+		test::testIteratorSet( tree, makeNumber< _T >, 4000, 50000, seed );
+	}
+
+	std::string makeString( int i )
+	{
+		return "key" + std::to_string( i );
+	}
+
+	void testSorted()
+	{
+		std::vector< int > keys;
+
+		for( int i = 0; i < 100000; i += 3 )
+		{
+			keys.push_back( i );
+		}
+		auto tree = util::BTree< int >::fromSorted( keys.begin(), keys.end() );
+		CHECK( tree.validate() );
+		CHECK( test::isEqual( tree, keys ) );
+
+		// Built trees take changes like any other.
+		CHECK( tree.add( 1 ) && tree.remove( 3 ) && !tree.remove( 4 ) );
+		CHECK( tree.validate() && tree.getSize() == keys.size() );
+
+		// Lookups in bulk match single lookups.
+		std::vector< int > probes;
+
+		for( int i = 0; i < 1000; ++i )
+		{
+			probes.push_back( i * 97 % 100000 );
+		}
+		std::vector< util::BTree< int >::const_iterator > found;
+		tree.findMany( probes.begin(), probes.end(),
+		               std::back_inserter( found ) );
+		std::vector< bool > contained;
+		tree.containsMany( probes.begin(), probes.end(),
+		                   std::back_inserter( contained ) );
+		CHECK( found.size() == probes.size() );
+		CHECK( contained.size() == probes.size() );
+
+		for( std::size_t i = 0; i < probes.size(); ++i )
+		{
+			CHECK( found[ i ] == tree.find( probes[ i ] ) );
+			CHECK( contained[ i ] == ( found[ i ] != tree.end() ) );
+		}
+
+		util::BTree< int > moved( std::move( tree ) );
+		CHECK( moved.validate() && moved.getSize() == keys.size() );
+		CHECK( tree.getSize() == 0 && tree.begin() == tree.end() );
+	}
+
+	// Additions whose splits fail to allocate leave the tree as it was,
+	// whichever node of a cascade fails, and leak nothing.
+	void testFailedSplit()
+	{
+		using FailingTree = util::BTree< int, std::less< int >,
+			FailingAllocator< int >, SmallNodeTraits >;
+
+		{
+			FailingTree tree;
+			std::vector< int > keys;
+
+			for( int i = 0; i < 3000; ++i )
+			{
+				int key = i * 7919 % 3000;
+
+				for( int countdown = 0; ; ++countdown )
+				{
+					std::size_t live = g_live;
+					g_countdown = countdown;
+
+					try
+					{
+						tree.add( key );
+						break;
+					}
+					catch( std::bad_alloc const & )
+					{
+						g_countdown = -1;
+						CHECK( g_live == live );
+						CHECK( tree.validate() && !tree.contains( key ) );
+						CHECK( tree.getSize() == keys.size() );
+					}
+				}
+				g_countdown = -1;
+				keys.insert( std::lower_bound( keys.begin(), keys.end(), key ),
+				             key );
+			}
+			CHECK( tree.validate() && test::isEqual( tree, keys ) );
+
+			for( int countdown: { 0, 1, 10, 100 } )
+			{
+				bool failed = false;
+				g_countdown = countdown;
+
+				try
+				{
+					FailingTree built( util::SORTED_UNIQUE, keys.begin(),
+					                   keys.end() );
+				}
+				catch( std::bad_alloc const & )
+				{
+					failed = true;
+				}
+				g_countdown = -1;
+				CHECK( failed );
+			}
+		}
+		CHECK( g_live == 0 );
+	}
+}
+
+int main()
+{
+	util::BTree< int > ints;
+	test::testIteratorSet( ints, []( int i ) { return i; }, 5000, 100000, 1 );
+
+	testNumbers< std::int32_t >( 10 );
+	testNumbers< std::uint32_t >( 11 );
+	testNumbers< std::int64_t >( 12 );
+	testNumbers< std::uint64_t >( 13 );
+	testNumbers< float >( 14 );
+	testNumbers< double >( 15 );
+
+	util::BTree< int, std::less< int >, std::allocator< int >,
+	             SmallNodeTraits > small;
+	test::testIteratorSet( small, []( int i ) { return i; }, 500, 50000, 3 );
+
+	util::BTree< std::string > strings;
+	test::testIteratorSet( strings, makeString, 3000, 50000, 4 );
+
+	testSorted();
+	testFailedSplit();
+	test::pass( "BTree" );
+	return 0;
+}
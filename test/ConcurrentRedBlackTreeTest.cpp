@@ -0,0 +1,270 @@
+// Differential test of util::ConcurrentRedBlackTree against std::set, and
+// a stress test of lock-free readers against concurrent writers, meant to
+// be run under ThreadSanitizer as well.
+//
+// The writers keep two invariants that every version satisfies. The
+// sliding writer owns the keys from WINDOW_BASE up: it adds key n and then
+// removes key n - WINDOW, so each version holds a run of WINDOW or
+// WINDOW + 1 consecutive keys there. The random writers own the keys
+// below WINDOW_BASE, each a residue class of its own, which they change at
+// random while tracking them in a std::set. Readers check the run in every
+// version they see.
+
+#include "ConcurrentRedBlackTree.h"
+#include "TestUtil.h"
+
+#include <atomic>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	using TreeT = util::ConcurrentRedBlackTree< int >;
+
+	int constexpr WINDOW = 64;
+	int constexpr WINDOW_BASE = 1 << 20;
+	int constexpr WRITERS = 2;
+	int constexpr READERS = 4;
+
+	void checkSame( TreeT const & tree, std::set< int > const & expected )
+	{
+		CHECK( tree.validate() );
+		CHECK( tree.getSize() == expected.size() );
+		CHECK( test::collect< int >( tree.read() ) ==
+		       std::vector< int >( expected.begin(), expected.end() ) );
+	}
+
+	// Steps through the keys both ways, turning around at every key once,
+	// and from copies of the keys, which the reader cannot have stepped to.
+	void checkSteps( TreeT const & tree, std::set< int > const & expected )
+	{
+		TreeT::Reader reader = tree.read();
+		std::vector< int > keys( expected.begin(), expected.end() );
+		std::vector< int > forward;
+		std::vector< int > backward;
+
+		for( int const * key = reader.getFirst(); key != nullptr;
+		     key = reader.getNext( *key ) )
+		{
+			forward.push_back( *key );
+		}
+
+		for( int const * key = reader.getLast(); key != nullptr;
+		     key = reader.getPrevious( *key ) )
+		{
+			backward.push_back( *key );
+		}
+		CHECK( forward == keys );
+		CHECK( backward == std::vector< int >( keys.rbegin(), keys.rend() ) );
+		int const * key = reader.getFirst();
+
+		for( std::size_t i = 0; key != nullptr; ++i )
+		{
+			int const * previous = reader.getPrevious( *key );
+			CHECK( test::isSameKey( previous, expected,
+			                        i > 0 ? expected.find( keys[ i - 1 ] ) :
+			                                expected.end() ) );
+
+			if( previous != nullptr )
+			{
+				CHECK( reader.getNext( *previous ) == key );
+			}
+			int copy = *key;
+			key = reader.getNext( copy );
+			CHECK( test::isSameKey( key, expected,
+			                        expected.upper_bound( copy ) ) );
+		}
+	}
+
+	void testSingleThread( unsigned seed )
+	{
+		test::Random random( seed );
+		TreeT tree;
+		std::set< int > expected;
+
+		for( int step = 0; step < 50000; ++step )
+		{
+			int key = random.next( 3000 );
+
+			if( random.chance( 50 ) )
+			{
+				CHECK( tree.add( key ) == expected.insert( key ).second );
+			}
+			else if( random.chance( 70 ) )
+			{
+				CHECK( tree.remove( key ) == ( expected.erase( key ) > 0 ) );
+			}
+			else
+			{
+				TreeT::Reader reader = tree.read();
+				CHECK( test::isSameKey( reader.find( key ), expected,
+				                        expected.find( key ) ) );
+				CHECK( test::isSameKey( reader.lowerBound( key ), expected,
+				                        expected.lower_bound( key ) ) );
+				CHECK( test::isSameKey( reader.upperBound( key ), expected,
+				                        expected.upper_bound( key ) ) );
+			}
+
+			if( step % 1000 == 0 )
+			{
+				checkSame( tree, expected );
+				checkSteps( tree, expected );
+			}
+		}
+		checkSame( tree, expected );
+		tree.clear();
+		checkSame( tree, {} );
+	}
+
+	// A tree with a single reader slot, stepped through by a reader that
+	// is moved halfway.
+	void testOneSlot()
+	{
+		util::ConcurrentRedBlackTree< int, std::less< int >,
+		                              std::allocator< int >, 1 > tree;
+
+		for( int key = 0; key < 100; ++key )
+		{
+			CHECK( tree.add( key * 2 ) );
+		}
+
+		for( int round = 0; round < 2; ++round )
+		{
+			auto reader = tree.read();
+			int const * key = reader.getFirst();
+
+			for( int i = 0; i < 50; ++i )
+			{
+				key = reader.getNext( *key );
+			}
+			auto moved = std::move( reader );
+			int count = 51;
+
+			for( ; key != nullptr; key = moved.getNext( *key ) )
+			{
+				CHECK( *key == ( count - 1 ) * 2 );
+				++count;
+			}
+			CHECK( count == 101 );
+		}
+		CHECK( tree.contains( 198 ) && !tree.contains( 199 ) );
+	}
+
+	// Checks the run of consecutive keys from WINDOW_BASE up in the
+	// version reader holds, looked up twice to see it does not change.
+	void checkWindow( TreeT::Reader const & reader )
+	{
+		int const * first = reader.lowerBound( WINDOW_BASE );
+
+		if( first == nullptr )
+		{
+			return;
+		}
+		int count = 0;
+
+		for( int const * key = first; key != nullptr;
+		     key = reader.getNext( *key ) )
+		{
+			CHECK( *key == *first + count );
+			++count;
+		}
+		CHECK( count == WINDOW || count == WINDOW + 1 || *first == WINDOW_BASE );
+		CHECK( reader.getLast() != nullptr &&
+		       *reader.getLast() == *first + count - 1 );
+		CHECK( reader.lowerBound( WINDOW_BASE ) == first );
+	}
+
+	void testStress()
+	{
+		TreeT tree;
+		std::atomic< bool > done{ false };
+		std::vector< std::set< int > > owned( WRITERS );
+		std::vector< std::thread > threads;
+
+		// The sliding writer.
+		threads.emplace_back( [ & ]()
+		{
+			for( int n = 0; n < 40000; ++n )
+			{
+				CHECK( tree.add( WINDOW_BASE + n ) );
+
+				if( n >= WINDOW )
+				{
+					CHECK( tree.remove( WINDOW_BASE + n - WINDOW ) );
+				}
+			}
+			done = true;
+		} );
+
+		for( int w = 0; w < WRITERS; ++w )
+		{
+			threads.emplace_back( [ &, w ]()
+			{
+				test::Random random( unsigned( 10 + w ) );
+				std::set< int > & expected = owned[ w ];
+
+				while( !done )
+				{
+					int key = random.next( 5000 ) * WRITERS + w;
+
+					if( random.chance( 55 ) )
+					{
+						CHECK( tree.add( key ) == expected.insert( key ).second );
+					}
+					else
+					{
+						CHECK( tree.remove( key ) ==
+						       ( expected.erase( key ) > 0 ) );
+					}
+				}
+			} );
+		}
+
+		for( int r = 0; r < READERS; ++r )
+		{
+			threads.emplace_back( [ & ]()
+			{
+				while( !done )
+				{
+					TreeT::Reader reader = tree.read();
+					checkWindow( reader );
+
+					// Every version visits its keys in increasing order.
+					int previous = -1;
+					reader.forEach( [ & ]( int key )
+					{
+						CHECK( key > previous );
+						previous = key;
+					} );
+				}
+			} );
+		}
+
+		for( auto & thread: threads )
+		{
+			thread.join();
+		}
+		std::set< int > expected;
+
+		for( auto & keys: owned )
+		{
+			expected.insert( keys.begin(), keys.end() );
+		}
+
+		for( int n = 40000 - WINDOW; n < 40000; ++n )
+		{
+			expected.insert( WINDOW_BASE + n );
+		}
+		checkSame( tree, expected );
+	}
+}
+
+int main()
+{
+	testSingleThread( 1 );
+	testOneSlot();
+	testStress();
+	test::pass( "ConcurrentRedBlackTree" );
+	return 0;
+}
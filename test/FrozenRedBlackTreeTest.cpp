@@ -0,0 +1,119 @@
+// Differential test of util::FrozenRedBlackTree against std::set, for
+// every size up to a few complete trees and for larger ones.
+
+#include "FrozenRedBlackTree.h"
+#include "PoolAllocator.h"
+#include "TestUtil.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace
+{
+	using test::SizeT;
+
+	template< class _Tree, class _MakeKey >
+	void checkFrozen( _Tree const & tree, _MakeKey makeKey, int range,
+	                  test::Random & random )
+	{
+		using KeyT = typename _Tree::KeyT;
+
+		auto frozen = tree.freeze();
+		std::set< KeyT, typename _Tree::LessT > expected( tree.begin(),
+		                                                  tree.end() );
+		CHECK( frozen.validate() );
+		CHECK( frozen.getSize() == expected.size() );
+		CHECK( test::isEqual( frozen, expected ) );
+		CHECK( test::collect< KeyT >( frozen ) ==
+		       std::vector< KeyT >( expected.begin(), expected.end() ) );
+
+		for( int i = 0; i < 200; ++i )
+		{
+			KeyT key = makeKey( random.next( range + 2 ) - 1 );
+			CHECK( test::isSameKey( frozen.find( key ), expected,
+			                        expected.find( key ) ) );
+			CHECK( frozen.contains( key ) == ( expected.count( key ) > 0 ) );
+			CHECK( test::isSameKey( frozen.lowerBound( key ), expected,
+			                        expected.lower_bound( key ) ) );
+			CHECK( test::isSameKey( frozen.upperBound( key ), expected,
+			                        expected.upper_bound( key ) ) );
+		}
+
+		// The root, lowest in memory, follows one unused key from the
+		// start of a cache line.
+		if( !expected.empty() )
+		{
+			KeyT const * root = &*std::min_element( frozen.begin(),
+				frozen.end(), []( KeyT const & k1, KeyT const & k2 )
+				{
+					return &k1 < &k2;
+				} );
+			CHECK( ( reinterpret_cast< std::uintptr_t >( root ) -
+			         sizeof( KeyT ) ) % 64 == 0 );
+		}
+
+		// Copies and moves keep the keys.
+		auto copy = frozen;
+		CHECK( test::isEqual( copy, expected ) );
+		auto moved = std::move( copy );
+		CHECK( copy.getSize() == 0 && test::isEqual( moved, expected ) );
+		copy = moved;
+		CHECK( test::isEqual( copy, expected ) );
+		moved = std::move( copy );
+		CHECK( copy.getSize() == 0 && moved.validate() );
+		CHECK( test::isEqual( moved, expected ) );
+
+		auto thawed = frozen.thaw();
+		CHECK( thawed.validate() );
+		CHECK( test::isEqual( thawed, expected ) );
+		thawed.add( makeKey( range ) );
+		CHECK( thawed.getSize() == expected.size() + 1 );
+	}
+
+	template< class _Tree, class _MakeKey >
+	void testFrozen( _MakeKey makeKey, unsigned seed )
+	{
+		test::Random random( seed );
+		_Tree tree;
+
+		// Every shape of the last level up to four levels.
+		for( int i = 0; i < 40; ++i )
+		{
+			checkFrozen( tree, makeKey, 200, random );
+			tree.add( makeKey( 5 * i ) );
+		}
+
+		for( int size: { 1000, 30000 } )
+		{
+			tree.clear();
+
+			for( int i = 0; i < size; ++i )
+			{
+				tree.add( makeKey( random.next( 4 * size ) ) );
+			}
+			checkFrozen( tree, makeKey, 4 * size, random );
+		}
+	}
+}
+
+int main()
+{
+	auto makeInt = []( int i ) { return i; };
+	testFrozen< util::RedBlackTree< int > >( makeInt, 1 );
+	testFrozen< util::RedBlackTree< int, std::less< int >,
+		util::PoolAllocator< int > > >( makeInt, 2 );
+	testFrozen< util::RedBlackTree< std::string > >(
+		[]( int i ) { return std::to_string( i ); }, 3 );
+
+	// Transparent lookups.
+	util::RedBlackTree< std::string, std::less<> > strings{ "a", "b", "c" };
+	auto frozen = strings.freeze();
+	CHECK( frozen.contains( "b" ) && !frozen.contains( "d" ) );
+	CHECK( *frozen.lowerBound( "bb" ) == "c" );
+
+	test::pass( "FrozenRedBlackTree" );
+	return 0;
+}
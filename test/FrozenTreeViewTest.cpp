@@ -0,0 +1,110 @@
+// Differential test of util::FrozenTreeView over serialized trees against
+// std::set.
+
+#include "FrozenTreeView.h"
+#include "TestUtil.h"
+
+#include <cstdint>
+#include <set>
+#include <vector>
+
+namespace
+{
+	using test::SizeT;
+
+	// Heterogeneous lookups by the low half of wide keys.
+	struct WideLess
+	{
+		using is_transparent = void;
+
+		bool operator()( std::int64_t k1, std::int64_t k2 ) const
+		{
+			return k1 < k2;
+		}
+
+		bool operator()( std::int64_t k1, int k2 ) const
+		{
+			return k1 < k2;
+		}
+
+		bool operator()( int k1, std::int64_t k2 ) const
+		{
+			return k1 < k2;
+		}
+	};
+
+	void testLookups( unsigned seed )
+	{
+		test::Random random( seed );
+
+		for( int size: { 0, 1, 1000, 20000 } )
+		{
+			util::RedBlackTree< std::int64_t, WideLess > tree;
+			std::set< std::int64_t > expected;
+
+			for( int i = 0; i < size; ++i )
+			{
+				std::int64_t key = random.next( 4 * size );
+				tree.add( key );
+				expected.insert( key );
+			}
+
+			// Words keep the keys aligned, as a mapped file would.
+			std::vector< std::uint64_t > buffer(
+				( tree.getSerializedSize() + 7 ) / 8 );
+			tree.serialize( buffer.data() );
+
+			util::FrozenTreeView< std::int64_t, WideLess > view;
+			CHECK( view.open( buffer.data(), tree.getSerializedSize() ) );
+			CHECK( view.validate() );
+			CHECK( view.getSize() == expected.size() );
+			CHECK( test::isEqual( view, expected ) );
+
+			for( int i = 0; i < 2000; ++i )
+			{
+				int key = random.next( 4 * size + 2 ) - 1;
+				CHECK( test::isSameKey( view.find( std::int64_t( key ) ),
+				                        expected, expected.find( key ) ) );
+				CHECK( view.contains( key ) == ( expected.count( key ) > 0 ) );
+				CHECK( test::isSameKey( view.lowerBound( key ), expected,
+				                        expected.lower_bound( key ) ) );
+				CHECK( test::isSameKey( view.upperBound( key ), expected,
+				                        expected.upper_bound( key ) ) );
+
+				SizeT rank = view.rank( key );
+				CHECK( rank == SizeT( std::distance( expected.begin(),
+					expected.lower_bound( key ) ) ) );
+				CHECK( test::isSameKey( view.select( rank ), expected,
+				                        expected.lower_bound( key ) ) );
+			}
+
+			// Cut short or misaligned.
+			CHECK( !view.open( buffer.data(), tree.getSerializedSize() - 1 ) );
+			CHECK( view.getSize() == 0 && view.begin() == view.end() );
+			std::vector< char > shifted( tree.getSerializedSize() + 1 );
+			tree.serialize( shifted.data() + 1 );
+			CHECK( !view.open( shifted.data() + 1, shifted.size() - 1 ) ||
+			       reinterpret_cast< std::uintptr_t >( shifted.data() + 1 ) %
+			       alignof( std::int64_t ) == 0 );
+		}
+
+		// Keys of another size.
+		util::RedBlackTree< int > ints{ 1, 2, 3 };
+		std::vector< std::uint64_t > buffer(
+			( ints.getSerializedSize() + 7 ) / 8 );
+		ints.serialize( buffer.data() );
+		util::FrozenTreeView< std::int64_t > view;
+		CHECK( !view.open( buffer.data(), ints.getSerializedSize() ) );
+		util::FrozenTreeView< int > intView;
+		CHECK( intView.open( buffer.data(), ints.getSerializedSize() ) );
+		CHECK( intView.getSize() == 3 && intView.contains( 2 ) );
+	}
+}
+
+int main()
+{
+	testLookups( 1 );
+
+	test::pass( "FrozenTreeView" );
+	return 0;
+}
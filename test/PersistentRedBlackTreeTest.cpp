@@ -0,0 +1,149 @@
+// Differential test of util::PersistentRedBlackTree against std::set,
+// checking that every snapshot keeps the keys it was taken with while
+// later versions change, also when versions change on several threads.
+
+#include "PersistentRedBlackTree.h"
+#include "TestUtil.h"
+
+#include <set>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace
+{
+	using TreeT = util::PersistentRedBlackTree< int >;
+
+	void checkSame( TreeT const & tree, std::set< int > const & expected )
+	{
+		CHECK( tree.validate() );
+		CHECK( tree.getSize() == expected.size() );
+		CHECK( test::collect< int >( tree ) ==
+		       std::vector< int >( expected.begin(), expected.end() ) );
+		CHECK( test::isSameKey( tree.getFirst(), expected,
+		                        expected.begin() ) );
+	}
+
+	void checkLookups( TreeT const & tree, std::set< int > const & expected,
+	                   int key )
+	{
+		CHECK( test::isSameKey( tree.find( key ), expected,
+		                        expected.find( key ) ) );
+		CHECK( test::isSameKey( tree.lowerBound( key ), expected,
+		                        expected.lower_bound( key ) ) );
+		CHECK( test::isSameKey( tree.upperBound( key ), expected,
+		                        expected.upper_bound( key ) ) );
+
+		auto lower = expected.lower_bound( key );
+		CHECK( test::isSameKey( tree.getPrevious( key ), expected,
+			( lower == expected.begin() ? expected.end() :
+			  std::prev( lower ) ) ) );
+	}
+
+	void testSnapshots( unsigned seed )
+	{
+		test::Random random( seed );
+		TreeT tree;
+		std::set< int > expected;
+		std::vector< std::pair< TreeT, std::set< int > > > versions;
+
+		for( int step = 0; step < 50000; ++step )
+		{
+			int key = random.next( 3000 );
+
+			if( random.chance( 60 ) )
+			{
+				CHECK( tree.add( key ) == expected.insert( key ).second );
+			}
+			else if( random.chance( 80 ) )
+			{
+				CHECK( tree.remove( key ) == ( expected.erase( key ) > 0 ) );
+			}
+			else
+			{
+				checkLookups( tree, expected, key );
+			}
+
+			if( step % 500 == 0 )
+			{
+				versions.emplace_back( tree.snapshot(), expected );
+			}
+		}
+		checkSame( tree, expected );
+
+		for( auto & version: versions )
+		{
+			checkSame( version.first, version.second );
+			checkLookups( version.first, version.second, random.next( 3000 ) );
+		}
+
+		// Dropping versions frees only what no other version holds.
+		versions.erase( versions.begin(), versions.begin() +
+		                versions.size() / 2 );
+		tree.clear();
+		checkSame( tree, {} );
+
+		for( auto & version: versions )
+		{
+			checkSame( version.first, version.second );
+		}
+	}
+
+	// Threads change copies of one version at the same time. The nodes
+	// they share count their links atomically.
+	void testThreads()
+	{
+		TreeT base;
+
+		for( int i = 0; i < 20000; ++i )
+		{
+			base.add( i );
+		}
+		std::vector< std::thread > threads;
+
+		for( int t = 0; t < 4; ++t )
+		{
+			threads.emplace_back( [ t, base ]() mutable
+			{
+				test::Random random( unsigned( 100 + t ) );
+				std::set< int > expected;
+
+				for( int i = 0; i < 20000; ++i )
+				{
+					expected.insert( i );
+				}
+
+				for( int step = 0; step < 20000; ++step )
+				{
+					int key = random.next( 40000 );
+
+					if( random.chance( 50 ) )
+					{
+						CHECK( base.add( key ) ==
+						       expected.insert( key ).second );
+					}
+					else
+					{
+						CHECK( base.remove( key ) ==
+						       ( expected.erase( key ) > 0 ) );
+					}
+				}
+				checkSame( base, expected );
+			} );
+		}
+
+		for( auto & thread: threads )
+		{
+			thread.join();
+		}
+		CHECK( base.validate() && base.getSize() == 20000 );
+	}
+}
+
+int main()
+{
+	testSnapshots( 1 );
+	testThreads();
+	test::pass( "PersistentRedBlackTree" );
+	return 0;
+}
@@ -0,0 +1,142 @@
+// Differential test of util::RedBlackMap against std::map.
+
+#include "RedBlackMap.h"
+#include "TestUtil.h"
+
+#include <map>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+	using MapT = util::RedBlackMap< int, std::string >;
+
+	void checkSame( MapT const & map,
+	                std::map< int, std::string > const & expected )
+	{
+		CHECK( map.validate() );
+		CHECK( map.getSize() == expected.size() );
+		CHECK( test::isEqual( map, expected ) );
+	}
+
+	void testMap()
+	{
+		test::Random random( 1 );
+		MapT map;
+		std::map< int, std::string > expected;
+
+		for( int step = 0; step < 50000; ++step )
+		{
+			int key = random.next( 2000 );
+			std::string value = std::to_string( step );
+			int operation = random.next( 10 );
+
+			if( operation < 3 )
+			{
+				map[ key ] = value;
+				expected[ key ] = value;
+			}
+			else if( operation < 5 )
+			{
+				auto result = map.tryEmplace( key, value );
+				auto expectedResult = expected.try_emplace( key, value );
+				CHECK( result.second == expectedResult.second );
+				CHECK( result.first->getKey().second ==
+				       expectedResult.first->second );
+			}
+			else if( operation < 6 )
+			{
+				auto result = map.emplace( key, value );
+				auto expectedResult = expected.emplace( key, value );
+				CHECK( result.second == expectedResult.second );
+				CHECK( result.first->getKey().second ==
+				       expectedResult.first->second );
+			}
+			else if( operation < 8 )
+			{
+				CHECK( map.remove( key ) == ( expected.erase( key ) > 0 ) );
+			}
+			else
+			{
+				auto position = expected.find( key );
+
+				try
+				{
+					CHECK( map.at( key ) == position->second );
+				}
+				catch( std::out_of_range const & )
+				{
+					CHECK( position == expected.end() );
+				}
+
+				auto lower = map.lowerBound( key );
+				auto expectedLower = expected.lower_bound( key );
+				CHECK( expectedLower == expected.end() ? lower == nullptr :
+				       lower != nullptr && lower->getKey() == *expectedLower );
+			}
+
+			if( step % 1000 == 0 )
+			{
+				checkSame( map, expected );
+			}
+		}
+		checkSame( map, expected );
+
+		// Values are changed in place.
+		for( auto & element: expected )
+		{
+			element.second += "!";
+			map.at( element.first ) += "!";
+		}
+		checkSame( map, expected );
+
+		MapT copy( map );
+		map.clear();
+		checkSame( copy, expected );
+		checkSame( map, {} );
+	}
+
+	// Value constructed in place, counting how often that happens.
+	int g_made = 0;
+
+	struct Counted
+	{
+		explicit Counted( int value ):
+			m_value{ value }
+		{
+			++g_made;
+		}
+
+		Counted( Counted const & ) = delete;
+		Counted & operator=( Counted const & ) = delete;
+
+		int m_value;
+	};
+
+	// tryEmplace() constructs no value for a key already present.
+	void testInPlace()
+	{
+		util::RedBlackMap< int, Counted > map;
+
+		for( int i = 0; i < 100; ++i )
+		{
+			CHECK( map.tryEmplace( i, i ).second );
+		}
+		CHECK( g_made == 100 );
+
+		for( int i = 0; i < 100; ++i )
+		{
+			auto result = map.tryEmplace( i, -1 );
+			CHECK( !result.second && result.first->getKey().second.m_value == i );
+		}
+		CHECK( g_made == 100 && map.getSize() == 100 && map.validate() );
+	}
+}
+
+int main()
+{
+	testMap();
+	testInPlace();
+	test::pass( "RedBlackMap" );
+	return 0;
+}
@@ -0,0 +1,136 @@
+// Differential test of util::RedBlackMultiset against std::multiset.
+
+#include "RedBlackMultiset.h"
+#include "PoolAllocator.h"
+#include "TestUtil.h"
+
+#include <iterator>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace
+{
+	using test::SizeT;
+
+	template< class _Set >
+	void checkSame( _Set const & set,
+	                std::multiset< typename _Set::KeyT > const & expected )
+	{
+		using KeyT = typename _Set::KeyT;
+
+		CHECK( set.validate() );
+		CHECK( set.getSize() == expected.size() );
+		CHECK( test::collect< KeyT >( set ) ==
+		       std::vector< KeyT >( expected.begin(), expected.end() ) );
+
+		SizeT distinct = 0;
+
+		for( auto position = expected.begin(); position != expected.end();
+		     position = expected.upper_bound( *position ) )
+		{
+			++distinct;
+		}
+		CHECK( set.getDistinctSize() == distinct );
+	}
+
+	template< class _Set, class _MakeKey >
+	void testMultiset( _MakeKey makeKey, unsigned seed )
+	{
+		using KeyT = typename _Set::KeyT;
+
+		test::Random random( seed );
+		_Set set;
+		std::multiset< KeyT > expected;
+
+		for( int step = 0; step < 30000; ++step )
+		{
+			KeyT key = makeKey( random.next( 300 ) );
+			int operation = random.next( 10 );
+
+			if( operation < 4 )
+			{
+				expected.insert( key );
+				CHECK( set.add( key ) == expected.count( key ) );
+			}
+			else if( operation < 5 )
+			{
+				SizeT count = SizeT( random.next( 4 ) );
+
+				for( SizeT i = 0; i < count; ++i )
+				{
+					expected.insert( key );
+				}
+				CHECK( set.add( key, count ) == expected.count( key ) );
+			}
+			else if( operation < 7 )
+			{
+				auto position = expected.find( key );
+				CHECK( set.removeOne( key ) == ( position != expected.end() ) );
+
+				if( position != expected.end() )
+				{
+					expected.erase( position );
+				}
+			}
+			else if( operation < 8 )
+			{
+				CHECK( set.removeAll( key ) == expected.erase( key ) );
+			}
+			else
+			{
+				SizeT count = expected.count( key );
+				CHECK( set.count( key ) == count );
+				CHECK( set.contains( key ) == ( count > 0 ) );
+
+				auto range = set.equalRange( key );
+				CHECK( SizeT( std::distance( range.first, range.second ) ) ==
+				       ( count > 0 ? 1 : 0 ) );
+				CHECK( count == 0 || range.first->second == count );
+
+				auto lower = set.lowerBound( key );
+				auto expectedLower = expected.lower_bound( key );
+				CHECK( expectedLower == expected.end() ? lower == nullptr :
+				       lower != nullptr && lower->getKey().first == *expectedLower &&
+				       lower->getKey().second == expected.count( *expectedLower ) );
+
+				auto upper = set.upperBound( key );
+				auto expectedUpper = expected.upper_bound( key );
+				CHECK( expectedUpper == expected.end() ? upper == nullptr :
+				       upper != nullptr && upper->getKey().first == *expectedUpper );
+			}
+
+			if( step % 1000 == 0 )
+			{
+				checkSame( set, expected );
+			}
+		}
+		checkSame( set, expected );
+
+		_Set copy( set );
+		_Set moved( std::move( set ) );
+		checkSame( copy, expected );
+		checkSame( moved, expected );
+		moved.clear();
+		checkSame( moved, {} );
+	}
+}
+
+int main()
+{
+	auto makeInt = []( int i ) { return i; };
+	testMultiset< util::RedBlackMultiset< int > >( makeInt, 1 );
+	testMultiset< util::RedBlackMultiset< int, std::less< int >,
+		util::PoolAllocator< int > > >( makeInt, 2 );
+	testMultiset< util::RedBlackMultiset< std::string > >(
+		[]( int i ) { return std::to_string( i ); }, 3 );
+
+	// Keys given in bulk are counted.
+	std::vector< int > keys{ 3, 1, 3, 2, 3, 1 };
+	util::RedBlackMultiset< int > set( keys.begin(), keys.end() );
+	CHECK( set.getSize() == 6 && set.getDistinctSize() == 3 );
+	CHECK( set.count( 3 ) == 3 && set.count( 1 ) == 2 && set.count( 4 ) == 0 );
+
+	test::pass( "RedBlackMultiset" );
+	return 0;
+}
@@ -0,0 +1,1121 @@
+// Differential test of util::RedBlackTree against std::set, with the
+// default allocator and the pool allocator.
+
+#include "RedBlackTree.h"
+#include "PoolAllocator.h"
+#include "TestUtil.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace
+{
+	using test::SizeT;
+
+	template< class _Traits >
+	using IntTree = util::RedBlackTree< int, std::less< int >,
+		std::allocator< int >, _Traits >;
+
+	struct CompactOrderTraits: util::TreeTraits
+	{
+		static bool constexpr ORDER_STATISTICS = true;
+		static bool constexpr COMPACT_NODES = true;
+	};
+
+	static_assert( sizeof( IntTree< util::CompactTraits >::Node ) <
+	               sizeof( IntTree< util::TreeTraits >::Node ),
+	               "Compact nodes save the type byte and its padding" );
+
+	using PoolTree = util::RedBlackTree< int, std::less< int >,
+		util::PoolAllocator< int > >;
+
+	// Blocks held through every CountingAllocator.
+	SizeT g_live = 0;
+
+	template< class _T >
+	struct CountingAllocator
+	{
+		using value_type = _T;
+
+		CountingAllocator() = default;
+
+		template< class _U >
+		CountingAllocator( CountingAllocator< _U > const & )
+		{}
+
+		_T * allocate( SizeT count )
+		{
+			g_live += count;
+			return std::allocator< _T >{}.allocate( count );
+		}
+
+		void deallocate( _T * block, SizeT count )
+		{
+			g_live -= count;
+			std::allocator< _T >{}.deallocate( block, count );
+		}
+
+		template< class _U >
+		bool operator==( CountingAllocator< _U > const & ) const
+		{
+			return true;
+		}
+
+		template< class _U >
+		bool operator!=( CountingAllocator< _U > const & ) const
+		{
+			return false;
+		}
+	};
+
+	using CountingTree = util::RedBlackTree< int, std::less< int >,
+		CountingAllocator< int > >;
+
+	template< class _Tree >
+	void checkSame( _Tree const & tree, std::set< int > const & expected )
+	{
+		CHECK( tree.validate() );
+		CHECK( tree.getSize() == expected.size() );
+		CHECK( test::isEqual( tree, expected ) );
+		CHECK( std::equal( tree.rbegin(), tree.rend(), expected.rbegin(),
+		                   expected.rend() ) );
+	}
+
+	template< class _Tree >
+	void checkLookups( _Tree const & tree, std::set< int > const & expected,
+	                   int key )
+	{
+		auto node = tree.find( key );
+		CHECK( ( node != nullptr ) == ( expected.count( key ) > 0 ) );
+		CHECK( tree.contains( key ) == ( node != nullptr ) );
+
+		auto lower = tree.lowerBound( key );
+		auto expectedLower = expected.lower_bound( key );
+		CHECK( expectedLower == expected.end() ? lower == nullptr :
+		       lower != nullptr && lower->getKey() == *expectedLower );
+
+		auto upper = tree.upperBound( key );
+		auto expectedUpper = expected.upper_bound( key );
+		CHECK( expectedUpper == expected.end() ? upper == nullptr :
+		       upper != nullptr && upper->getKey() == *expectedUpper );
+
+		auto range = tree.equalRange( key );
+		CHECK( SizeT( std::distance( range.first, range.second ) ) ==
+		       expected.count( key ) );
+		CHECK( ( range.second == tree.end() ) == ( upper == nullptr ) );
+
+		if constexpr( _Tree::ORDER_STATISTICS )
+		{
+			SizeT rank = SizeT( std::distance( expected.begin(),
+			                                   expectedLower ) );
+			CHECK( tree.rank( key ) == rank );
+
+			if( rank < expected.size() )
+			{
+				CHECK( tree.select( rank )->getKey() == *expectedLower );
+				CHECK( tree.getIndex( tree.select( rank ) ) == rank );
+			}
+			else
+			{
+				CHECK( tree.select( rank ) == nullptr );
+			}
+			CHECK( tree.countRange( key, key + 100 ) == SizeT( std::distance(
+				expectedLower, expected.lower_bound( key + 100 ) ) ) );
+		}
+	}
+
+	// Random adds and removals, checking lookups along the way.
+	template< class _Tree >
+	void testChanges( _Tree & tree, unsigned seed )
+	{
+		test::Random random( seed );
+		std::set< int > expected;
+
+		for( int step = 0; step < 20000; ++step )
+		{
+			int key = random.next( 2000 );
+			int operation = random.next( 10 );
+
+			if( operation < 5 )
+			{
+				typename _Tree::Node * node = nullptr;
+				CHECK( tree.add( key, node ) == expected.insert( key ).second );
+				CHECK( node != nullptr && node->getKey() == key );
+			}
+			else if( operation < 8 )
+			{
+				CHECK( tree.remove( key ) == ( expected.erase( key ) > 0 ) );
+			}
+			else
+			{
+				checkLookups( tree, expected, key );
+			}
+
+			if( step % 1000 == 0 )
+			{
+				checkSame( tree, expected );
+			}
+		}
+		checkSame( tree, expected );
+
+		// Copies are deep, and keep to their own changes.
+		_Tree copy( tree );
+		checkSame( copy, expected );
+		copy.add( -1 );
+		checkSame( tree, expected );
+		copy = tree;
+		checkSame( copy, expected );
+
+		_Tree moved( std::move( tree ) );
+		checkSame( moved, expected );
+		checkSame( tree, {} );
+		tree = std::move( moved );
+		checkSame( tree, expected );
+		checkSame( moved, {} );
+		tree.clear();
+		checkSame( tree, {} );
+	}
+
+	std::vector< int > getRandomKeys( test::Random & random, SizeT count,
+	                                  int bound )
+	{
+		std::vector< int > keys;
+
+		for( SizeT i = 0; i < count; ++i )
+		{
+			keys.push_back( random.next( bound ) );
+		}
+		return keys;
+	}
+
+	template< class _Tree >
+	void testBulk( unsigned seed )
+	{
+		test::Random random( seed );
+		std::vector< int > keys = getRandomKeys( random, 50000, 200000 );
+		std::set< int > expected( keys.begin(), keys.end() );
+		std::vector< int > sorted( expected.begin(), expected.end() );
+
+		_Tree built = _Tree::fromSorted( sorted.begin(), sorted.end() );
+		checkSame( built, expected );
+
+		if constexpr( _Tree::PARALLEL )
+		{
+			_Tree forked = _Tree::fromSorted( sorted.begin(), sorted.end(),
+				{}, {}, true );
+			checkSame( forked, expected );
+		}
+
+		// Batches merged with the nodes of the tree, or much smaller ones
+		// inserted key by key.
+		_Tree added;
+		CHECK( added.addMany( keys.begin(), keys.end() ) == expected.size() );
+		checkSame( added, expected );
+
+		for( SizeT count: { 300000, 100, 1 } )
+		{
+			std::vector< int > more = getRandomKeys( random, count, 400000 );
+			SizeT before = expected.size();
+			expected.insert( more.begin(), more.end() );
+			CHECK( added.addMany( more.begin(), more.end() ) ==
+			       expected.size() - before );
+			checkSame( added, expected );
+		}
+
+		// Every size up to a few levels, as the shape built depends on it.
+		for( SizeT size = 0; size < 300; ++size )
+		{
+			_Tree small( util::SORTED_UNIQUE, sorted.begin(),
+			             sorted.begin() + size );
+			std::set< int > expectedSmall( sorted.begin(),
+			                               sorted.begin() + size );
+			checkSame( small, expectedSmall );
+
+			// Built trees take changes like any other.
+			int key = random.next( 200000 );
+			small.add( key );
+			expectedSmall.insert( key );
+			CHECK( small.remove( sorted[ size / 2 ] ) ==
+			       ( expectedSmall.erase( sorted[ size / 2 ] ) > 0 ) );
+			checkSame( small, expectedSmall );
+		}
+	}
+
+	// Hinted adds of keys next to their hints and far from them, and
+	// erasures through iterators.
+	template< class _Tree >
+	void testHints( unsigned seed )
+	{
+		test::Random random( seed );
+		_Tree tree;
+		std::set< int > expected;
+
+		// Ascending keys at the end, descending ones before the previous.
+		for( int i = 0; i < 5000; ++i )
+		{
+			CHECK( *tree.add( tree.end(), 4 * i ) == 4 * i );
+			expected.insert( 4 * i );
+		}
+		auto position = tree.begin();
+
+		for( int i = 1; i <= 5000; ++i )
+		{
+			position = tree.add( position, -4 * i );
+			CHECK( position == tree.begin() && *position == -4 * i );
+			expected.insert( -4 * i );
+		}
+		checkSame( tree, expected );
+
+		// Keys just after and just before their hints, and keys present.
+		for( auto hint = tree.begin(); hint != tree.end(); )
+		{
+			int key = *hint;
+			auto next = std::next( hint );
+			CHECK( *tree.add( hint, key + 1 ) == key + 1 );
+			CHECK( *tree.emplaceHint( next, key + 2 ) == key + 2 );
+			CHECK( tree.add( hint, key ) == hint );
+			expected.insert( key + 1 );
+			expected.insert( key + 2 );
+			hint = next;
+		}
+		checkSame( tree, expected );
+
+		for( int step = 0; step < 5000; ++step )
+		{
+			int key = random.next( 60000 ) - 30000;
+			auto hint = ( random.chance( 50 ) ? tree.begin() : tree.end() );
+			CHECK( *tree.add( hint, key ) == key );
+			expected.insert( key );
+		}
+		checkSame( tree, expected );
+
+		// Erase every other key, each erasure returning the next position.
+		for( auto next = tree.begin(); next != tree.end(); )
+		{
+			auto expectedNext = expected.erase( expected.find( *next ) );
+			next = tree.erase( next );
+			CHECK( expectedNext == expected.end() ? next == tree.end() :
+			       next != tree.end() && *next == *expectedNext );
+
+			if( next != tree.end() )
+			{
+				++next;
+			}
+		}
+		checkSame( tree, expected );
+	}
+
+	template< class _Tree >
+	void testRemoveRange( unsigned seed )
+	{
+		test::Random random( seed );
+
+		for( int round = 0; round < 200; ++round )
+		{
+			std::vector< int > keys = getRandomKeys( random,
+				SizeT( random.next( 3000 ) ), 10000 );
+			std::set< int > expected( keys.begin(), keys.end() );
+			_Tree tree( keys.begin(), keys.end() );
+
+			// Ranges reaching past either end, or empty, now and then.
+			int low = random.next( 12000 ) - 1000;
+			int high = low + random.next( 4000 ) - 200;
+			SizeT removed = ( low < high ? SizeT( std::distance(
+				expected.lower_bound( low ),
+				expected.lower_bound( high ) ) ) : 0 );
+			CHECK( tree.removeRange( low, high ) == removed );
+
+			if( low < high )
+			{
+				expected.erase( expected.lower_bound( low ),
+				                expected.lower_bound( high ) );
+			}
+			checkSame( tree, expected );
+
+			// The tree is whole for the changes that follow.
+			for( int i = 0; i < 100; ++i )
+			{
+				int key = random.next( 10000 );
+				tree.add( key );
+				expected.insert( key );
+			}
+			checkSame( tree, expected );
+		}
+	}
+
+	template< class _Tree >
+	void testSplitJoin( unsigned seed )
+	{
+		test::Random random( seed );
+
+		for( int round = 0; round < 200; ++round )
+		{
+			std::vector< int > keys = getRandomKeys( random,
+				SizeT( random.next( 3000 ) ), 10000 );
+			std::set< int > expected( keys.begin(), keys.end() );
+			_Tree tree( keys.begin(), keys.end() );
+			int key = random.next( 10000 );
+
+			_Tree upper = tree.split( key );
+			std::set< int > expectedUpper( expected.lower_bound( key ),
+			                               expected.end() );
+			expected.erase( expected.lower_bound( key ), expected.end() );
+			checkSame( tree, expected );
+			checkSame( upper, expectedUpper );
+
+			tree.join( std::move( upper ) );
+			expected.insert( expectedUpper.begin(), expectedUpper.end() );
+			checkSame( tree, expected );
+			checkSame( upper, {} );
+		}
+	}
+
+	template< class _Tree >
+	void testSetOperations( unsigned seed )
+	{
+		test::Random random( seed );
+
+		// The last rounds are large enough for the parallel merges to fork.
+		for( int round = 0; round < 24; ++round )
+		{
+			bool forked = ( round % 2 == 1 );
+			int bound = ( round < 20 ? 5000 : 50000 );
+			std::vector< int > a = getRandomKeys( random,
+				SizeT( random.next( bound ) ), 4 * bound );
+			std::vector< int > b = getRandomKeys( random,
+				SizeT( random.next( bound ) ), 4 * bound );
+			std::set< int > expectedA( a.begin(), a.end() );
+			std::set< int > expectedB( b.begin(), b.end() );
+
+			std::set< int > unionSet = expectedA;
+			unionSet.insert( expectedB.begin(), expectedB.end() );
+			std::set< int > intersection;
+			std::set_intersection( expectedA.begin(), expectedA.end(),
+				expectedB.begin(), expectedB.end(),
+				std::inserter( intersection, intersection.end() ) );
+			std::set< int > difference;
+			std::set_difference( expectedA.begin(), expectedA.end(),
+				expectedB.begin(), expectedB.end(),
+				std::inserter( difference, difference.end() ) );
+
+			_Tree left( a.begin(), a.end() );
+			_Tree right( b.begin(), b.end() );
+			_Tree intersected( a.begin(), a.end() );
+			_Tree differed( a.begin(), a.end() );
+
+			if constexpr( _Tree::PARALLEL )
+			{
+				left.unionWith( _Tree( b.begin(), b.end() ), forked );
+				intersected.intersectWith( right, forked );
+				differed.differenceWith( right, forked );
+			}
+			else
+			{
+				left.unionWith( _Tree( b.begin(), b.end() ) );
+				intersected.intersectWith( right );
+				differed.differenceWith( right );
+			}
+			checkSame( left, unionSet );
+			checkSame( intersected, intersection );
+			checkSame( differed, difference );
+			checkSame( right, expectedB );
+		}
+	}
+
+	template< class _Tree >
+	void testParallelScans( unsigned seed )
+	{
+		test::Random random( seed );
+
+		for( SizeT size: { 0, 1, 1000, 200000 } )
+		{
+			std::vector< int > keys = getRandomKeys( random, size, 1 << 30 );
+			std::set< int > expected( keys.begin(), keys.end() );
+			_Tree tree( keys.begin(), keys.end() );
+
+			std::atomic< long long > sum{ 0 };
+			std::atomic< SizeT > count{ 0 };
+			tree.parallelForEach( [ & ]( int key )
+			{
+				sum += key;
+				++count;
+			} );
+			long long expectedSum = 0;
+
+			for( int key: expected )
+			{
+				expectedSum += key;
+			}
+			CHECK( count == expected.size() );
+			CHECK( sum == expectedSum );
+			CHECK( tree.parallelReduce( 0LL, std::plus< long long >{},
+				[]( int key )
+				{
+					return ( long long )key;
+				} ) == expectedSum );
+
+			// Runs are reduced in ascending order.
+			std::vector< int > ordered = tree.parallelReduce(
+				std::vector< int >{},
+				[]( std::vector< int > first, std::vector< int > const & second )
+				{
+					first.insert( first.end(), second.begin(), second.end() );
+					return first;
+				},
+				[]( int key )
+				{
+					return std::vector< int >{ key };
+				} );
+			CHECK( test::isEqual( ordered, expected ) );
+		}
+	}
+
+	// Trees read back from buffers, aligned or not, and streams hold the
+	// same keys. Damaged or foreign data leaves the tree empty.
+	template< class _Tree >
+	void testSerialize( unsigned seed )
+	{
+		test::Random random( seed );
+
+		for( SizeT size: { 0, 1, 1000, 50000 } )
+		{
+			std::vector< int > keys = getRandomKeys( random, size, 1 << 30 );
+			std::set< int > expected( keys.begin(), keys.end() );
+			_Tree tree( keys.begin(), keys.end() );
+
+			std::vector< char > buffer( tree.getSerializedSize() + 1 );
+			tree.serialize( buffer.data() + 1 );
+			std::stringstream stream;
+			CHECK( tree.serialize( stream ) );
+			std::string bytes = stream.str();
+			CHECK( bytes.size() == tree.getSerializedSize() );
+			CHECK( std::equal( buffer.begin() + 1, buffer.end(),
+			                   bytes.begin() ) );
+
+			_Tree loaded;
+			loaded.add( -1 );
+			CHECK( loaded.deserialize( buffer.data() + 1,
+			                           buffer.size() - 1 ) );
+			checkSame( loaded, expected );
+
+			std::vector< char > copy( bytes.begin(), bytes.end() );
+			CHECK( loaded.deserialize( copy.data(), copy.size() ) );
+			checkSame( loaded, expected );
+
+			_Tree streamed;
+			CHECK( streamed.deserialize( stream ) );
+			checkSame( streamed, expected );
+
+			// Cut short.
+			CHECK( !loaded.deserialize( buffer.data() + 1,
+			                            buffer.size() - 2 ) );
+			std::stringstream truncated( bytes.substr( 0, bytes.size() - 1 ) );
+			CHECK( !streamed.deserialize( truncated ) );
+			CHECK( loaded.getSize() == 0 && streamed.getSize() == 0 );
+		}
+
+		// Wrong magic, key size or order.
+		_Tree tree{ 1, 2, 3 };
+		std::vector< char > buffer( tree.getSerializedSize() );
+		_Tree loaded;
+
+		for( SizeT byte: { SizeT( 0 ), SizeT( 4 ) } )
+		{
+			tree.serialize( buffer.data() );
+			buffer[ byte ] ^= 1;
+			CHECK( !loaded.deserialize( buffer.data(), buffer.size() ) );
+		}
+		tree.serialize( buffer.data() );
+		std::swap_ranges( buffer.end() - 2 * sizeof( int ),
+		                  buffer.end() - sizeof( int ), buffer.end() -
+		                  sizeof( int ) );
+		CHECK( !loaded.deserialize( buffer.data(), buffer.size() ) );
+		CHECK( loaded.getSize() == 0 && loaded.validate() );
+	}
+
+	// Lookups in bulk match single lookups, also for an empty tree and for
+	// batches cut short.
+	template< class _Tree >
+	void testFindMany( unsigned seed )
+	{
+		test::Random random( seed );
+
+		for( SizeT size: { 0, 5000 } )
+		{
+			std::vector< int > keys = getRandomKeys( random, size, 20000 );
+			_Tree tree( keys.begin(), keys.end() );
+			_Tree const & constTree = tree;
+			std::vector< int > probes = getRandomKeys( random, 3001, 20000 );
+
+			std::vector< typename _Tree::Node * > found;
+			tree.findMany( probes.begin(), probes.end(),
+			               std::back_inserter( found ) );
+			std::vector< typename _Tree::Node const * > constFound;
+			constTree.findMany( probes.begin(), probes.end(),
+			                    std::back_inserter( constFound ) );
+			std::vector< bool > contained;
+			constTree.containsMany( probes.begin(), probes.end(),
+			                        std::back_inserter( contained ) );
+			CHECK( found.size() == probes.size() );
+			CHECK( constFound.size() == probes.size() );
+			CHECK( contained.size() == probes.size() );
+
+			for( SizeT i = 0; i < probes.size(); ++i )
+			{
+				CHECK( found[ i ] == tree.find( probes[ i ] ) );
+				CHECK( constFound[ i ] == found[ i ] );
+				CHECK( contained[ i ] == ( found[ i ] != nullptr ) );
+			}
+		}
+	}
+
+	// Lookups by types the transparent comparator takes, without making
+	// keys of them.
+	void testTransparent()
+	{
+		util::RedBlackTree< std::string, std::less<> > tree;
+		std::set< std::string, std::less<> > expected;
+
+		for( int i = 0; i < 1000; ++i )
+		{
+			std::string key = std::to_string( i * 7 % 1000 );
+			tree.add( key );
+			expected.insert( key );
+		}
+
+		for( int i = 0; i < 2000; ++i )
+		{
+			std::string key = std::to_string( i );
+			std::string_view view( key );
+			auto node = tree.find( view );
+			CHECK( ( node != nullptr ) == ( expected.count( view ) > 0 ) );
+			CHECK( node == nullptr || node->getKey() == view );
+			CHECK( tree.contains( key.c_str() ) == ( node != nullptr ) );
+		}
+		CHECK( tree.remove( std::string_view( "10" ) ) );
+		CHECK( !tree.remove( "10" ) );
+		CHECK( !tree.contains( "10" ) && tree.contains( "11" ) );
+		CHECK( tree.validate() && tree.getSize() == 999 );
+	}
+
+	// Comparator whose order is chosen per instance.
+	struct Direction
+	{
+		bool operator()( int first, int second ) const
+		{
+			return ( m_descending ? second < first : first < second );
+		}
+
+		bool m_descending;
+	};
+
+	// Orders by a flag outside the tree, so that the order of a tree can be
+	// broken behind its back.
+	struct SwitchedLess
+	{
+		bool const * m_reversed;
+
+		bool operator()( int k1, int k2 ) const
+		{
+			return ( *m_reversed ? k2 < k1 : k1 < k2 );
+		}
+	};
+
+	// check() names the first broken invariant and the node at fault.
+	void testCheck()
+	{
+		bool reversed = false;
+		util::RedBlackTree< int, SwitchedLess > tree( SwitchedLess{ &reversed } );
+		CHECK( !tree.check() );
+
+		for( int i = 0; i < 100; ++i )
+		{
+			tree.add( i );
+		}
+		CHECK( !tree.check() && tree.validate() );
+
+		reversed = true;
+		auto violation = tree.check();
+		CHECK( violation && !tree.validate() );
+		CHECK( std::string( violation.message ) == "keys out of order" );
+		CHECK( violation.node != nullptr && violation.node->getKey() == 1 );
+	}
+
+	// Trees of one type ordered by comparators in different states.
+	void testComparator()
+	{
+		using DirectedTree = util::RedBlackTree< int, Direction >;
+
+		for( bool descending: { false, true } )
+		{
+			Direction direction{ descending };
+			test::Random random( descending ? 200 : 201 );
+			DirectedTree tree( direction );
+			std::set< int, Direction > expected( direction );
+			CHECK( tree.getLess().m_descending == descending );
+
+			for( int step = 0; step < 5000; ++step )
+			{
+				int key = random.next( 1000 );
+
+				if( random.chance( 60 ) )
+				{
+					tree.add( key );
+					expected.insert( key );
+				}
+				else
+				{
+					CHECK( tree.remove( key ) == ( expected.erase( key ) > 0 ) );
+				}
+			}
+			CHECK( tree.validate() && tree.getSize() == expected.size() );
+			CHECK( test::isEqual( tree, expected ) );
+
+			DirectedTree built = DirectedTree::fromSorted( expected.begin(),
+				expected.end(), direction );
+			CHECK( built.validate() && test::isEqual( built, expected ) );
+		}
+	}
+
+	// Orders unique pointers by their pointees, which also serve to look
+	// them up.
+	struct PointeeLess
+	{
+		using is_transparent = void;
+
+		bool operator()( std::unique_ptr< int > const & first,
+		                 std::unique_ptr< int > const & second ) const
+		{
+			return ( *first < *second );
+		}
+
+		bool operator()( std::unique_ptr< int > const & first,
+		                 int second ) const
+		{
+			return ( *first < second );
+		}
+
+		bool operator()( int first,
+		                 std::unique_ptr< int > const & second ) const
+		{
+			return ( first < *second );
+		}
+	};
+
+	void testMoveOnly()
+	{
+		using PointerTree = util::RedBlackTree< std::unique_ptr< int >,
+			PointeeLess >;
+
+		test::Random random( 300 );
+		PointerTree tree;
+		std::set< int > expected;
+
+		for( int step = 0; step < 5000; ++step )
+		{
+			int key = random.next( 1000 );
+
+			if( random.chance( 40 ) )
+			{
+				PointerTree::Node * node = nullptr;
+				CHECK( tree.add( std::make_unique< int >( key ), node ) ==
+				       expected.insert( key ).second );
+				CHECK( *node->getKey() == key );
+			}
+			else if( random.chance( 50 ) )
+			{
+				auto result = tree.emplace( new int( key ) );
+				CHECK( result.second == expected.insert( key ).second );
+				CHECK( *result.first->getKey() == key );
+			}
+			else
+			{
+				CHECK( tree.remove( key ) == ( expected.erase( key ) > 0 ) );
+			}
+		}
+
+		auto isSame = []( PointerTree const & tree,
+		                  std::set< int > const & expected )
+		{
+			return ( tree.validate() && tree.getSize() == expected.size() &&
+			         std::equal( tree.begin(), tree.end(), expected.begin(),
+			                     expected.end(),
+			                     []( std::unique_ptr< int > const & key,
+			                         int value )
+			                     {
+			                         return ( *key == value );
+			                     } ) );
+		};
+		CHECK( isSame( tree, expected ) );
+
+		PointerTree moved( std::move( tree ) );
+		CHECK( isSame( moved, expected ) && isSame( tree, {} ) );
+	}
+
+	// Pool allocator that stays with its tree on move assignment.
+	template< class _T >
+	struct LocalAllocator: util::PoolAllocator< _T >
+	{
+		using propagate_on_container_move_assignment = std::false_type;
+
+		template< class _U >
+		struct rebind
+		{
+			using other = LocalAllocator< _U >;
+		};
+
+		LocalAllocator() = default;
+
+		template< class _U >
+		LocalAllocator( LocalAllocator< _U > const & other ):
+			util::PoolAllocator< _T >( other )
+		{}
+	};
+
+	// Moving between trees whose allocators differ moves the keys into
+	// nodes of the receiving tree.
+	void testMoveAcrossArenas()
+	{
+		using LocalTree = util::RedBlackTree< std::string,
+			std::less< std::string >, LocalAllocator< std::string > >;
+
+		LocalTree source;
+		LocalTree target;
+		std::set< std::string > expected;
+
+		for( int i = 0; i < 1000; ++i )
+		{
+			source.add( std::to_string( i ) );
+			expected.insert( std::to_string( i ) );
+		}
+		target.add( "old" );
+		CHECK( source.getAllocator() != target.getAllocator() );
+
+		target = std::move( source );
+		CHECK( target.validate() && test::isEqual( target, expected ) );
+		CHECK( source.getSize() == 0 && source.begin() == source.end() );
+		CHECK( source.getAllocator() != target.getAllocator() );
+	}
+
+	// Joining a tree whose allocator differs moves its keys.
+	void testJoinAcrossArenas()
+	{
+		using LocalTree = util::RedBlackTree< std::string,
+			std::less< std::string >, LocalAllocator< std::string > >;
+
+		LocalTree lower;
+		std::set< std::string > expected;
+
+		for( int i = 0; i < 1000; ++i )
+		{
+			lower.add( std::to_string( 1000 + i ) );
+			expected.insert( std::to_string( 1000 + i ) );
+		}
+		LocalTree upper = lower.split( "1500" );
+		CHECK( upper.getAllocator() == lower.getAllocator() );
+
+		LocalTree other;
+		other.add( "2000" );
+		expected.insert( "2000" );
+		upper.join( std::move( other ) );
+		CHECK( upper.validate() && upper.getSize() == 501 );
+		CHECK( other.getSize() == 0 && other.begin() == other.end() );
+
+		lower.join( std::move( upper ) );
+		CHECK( lower.validate() && test::isEqual( lower, expected ) );
+	}
+
+	// Copies throw once the countdown reaches zero.
+	int g_countdown = -1;
+
+	struct FailingKey
+	{
+		FailingKey( int value ):
+			m_value{ value }
+		{}
+
+		FailingKey( FailingKey const & other ):
+			m_value{ other.m_value }
+		{
+			if( g_countdown >= 0 && g_countdown-- == 0 )
+			{
+				throw std::runtime_error( "copy failed" );
+			}
+		}
+
+		FailingKey( FailingKey && other ) noexcept = default;
+		FailingKey & operator=( FailingKey const & other ) = default;
+		FailingKey & operator=( FailingKey && other ) noexcept = default;
+
+		bool operator<( FailingKey const & other ) const
+		{
+			return ( m_value < other.m_value );
+		}
+
+		int m_value;
+	};
+
+	// A copy failing part way frees the nodes it made. Copy assignment
+	// then leaves its target empty.
+	void testFailedCopy()
+	{
+		using FailingTree = util::RedBlackTree< FailingKey,
+			std::less< FailingKey >, CountingAllocator< FailingKey > >;
+
+		{
+			FailingTree tree;
+
+			for( int i = 0; i < 1000; ++i )
+			{
+				tree.add( FailingKey( i ) );
+			}
+			SizeT live = g_live;
+
+			for( int countdown: { 0, 10, 999 } )
+			{
+				bool failed = false;
+				g_countdown = countdown;
+
+				try
+				{
+					FailingTree copy( tree );
+				}
+				catch( std::runtime_error const & )
+				{
+					failed = true;
+				}
+				CHECK( failed && g_live == live );
+
+				FailingTree target;
+				target.add( FailingKey( -1 ) );
+				failed = false;
+				g_countdown = countdown;
+
+				try
+				{
+					target = tree;
+				}
+				catch( std::runtime_error const & )
+				{
+					failed = true;
+				}
+				g_countdown = -1;
+				CHECK( failed && g_live == live );
+				CHECK( target.validate() && target.getSize() == 0 );
+			}
+			CHECK( tree.validate() && tree.getSize() == 1000 );
+		}
+		CHECK( g_live == 0 );
+	}
+
+	// Clearing and destroying a tree free every node.
+	void testTeardown()
+	{
+		{
+			CountingTree tree;
+
+			for( int i = 0; i < 1000; ++i )
+			{
+				tree.add( i * 7 % 1000 );
+			}
+			CHECK( g_live == 1000 );
+			tree.clear();
+			CHECK( g_live == 0 );
+			checkSame( tree, {} );
+
+			for( int i = 0; i < 100; ++i )
+			{
+				tree.add( i );
+			}
+			CHECK( tree.validate() && g_live == 100 );
+		}
+		CHECK( g_live == 0 );
+	}
+
+	// Keys whose nodes the arena hands to the global heap, being aligned
+	// beyond its size classes or larger than them.
+	struct alignas( 16 ) AlignedKey
+	{
+		AlignedKey( int value ):
+			m_value{ value }
+		{}
+
+		int m_value;
+
+		bool operator<( AlignedKey const & other ) const
+		{
+			return m_value < other.m_value;
+		}
+	};
+
+	struct LargeKey
+	{
+		LargeKey( int value ):
+			m_value{ value },
+			m_padding{}
+		{}
+
+		int m_value;
+		char m_padding[ util::PoolArena::MAX_BLOCK ];
+
+		bool operator<( LargeKey const & other ) const
+		{
+			return m_value < other.m_value;
+		}
+	};
+
+	// Pooled trees of such keys free every node on clear() and when
+	// destroyed, which the sanitizer builds check for leaks.
+	template< class _KeyT >
+	void testPooledHeapNodes()
+	{
+		using Tree = util::RedBlackTree< _KeyT, std::less< _KeyT >,
+			util::PoolAllocator< _KeyT > >;
+
+		Tree tree;
+
+		for( int i = 0; i < 1000; ++i )
+		{
+			tree.add( _KeyT( i * 7 % 1000 ) );
+		}
+		CHECK( tree.validate() && tree.getSize() == 1000 );
+		tree.clear();
+		CHECK( tree.validate() && tree.getSize() == 0 );
+
+		for( int i = 0; i < 1000; ++i )
+		{
+			tree.add( _KeyT( i ) );
+		}
+		CHECK( tree.validate() && tree.getSize() == 1000 );
+	}
+
+	// Counts match the work done, and random changes reach every
+	// rebalancing case.
+	void testStats()
+	{
+		using StatsTree = IntTree< util::StatisticTraits >;
+		using Stats = util::TreeStats;
+
+		StatsTree tree;
+		test::Random random( 50 );
+		SizeT added = 0;
+		SizeT removed = 0;
+
+		for( int step = 0; step < 20000; ++step )
+		{
+			int key = random.next( 2000 );
+
+			if( random.chance( 50 ) )
+			{
+				StatsTree::Node * node = nullptr;
+				added += tree.add( key, node );
+			}
+			else
+			{
+				removed += tree.remove( key );
+			}
+		}
+		Stats stats = tree.getStats();
+		CHECK( stats[ Stats::ALLOCATIONS ] == added );
+		CHECK( stats[ Stats::FREES ] == removed );
+		CHECK( stats[ Stats::SEARCHES ] == 20000 );
+		CHECK( stats[ Stats::SWAPS ] > 0 && stats[ Stats::SWAPS ] < removed );
+
+		for( int counter = Stats::ADD_TWO_LEFT; counter < Stats::COUNTER_COUNT;
+		     ++counter )
+		{
+			CHECK( stats[ Stats::Counter( counter ) ] > 0 );
+		}
+
+		tree.resetStats();
+		CHECK( tree.getStats()[ Stats::SEARCHES ] == 0 );
+		tree.find( 1 );
+		tree.lowerBound( 1 );
+		stats = tree.getStats();
+		CHECK( stats[ Stats::SEARCHES ] == 2 );
+		CHECK( stats[ Stats::DEPTH ] >= 2 &&
+		       stats[ Stats::COMPARISONS ] >= stats[ Stats::DEPTH ] );
+		CHECK( std::string( Stats::getName( Stats::REM_THREE_RIGHT_X_TWO ) ) ==
+		       "remThreeRight_X_Two" );
+	}
+
+	// Trees sharing an arena recycle the blocks each other frees.
+	void testSharedArena()
+	{
+		util::PoolAllocator< int > allocator;
+		PoolTree first( allocator );
+		PoolTree second( allocator );
+		CHECK( first.getAllocator() == second.getAllocator() );
+
+		testChanges( first, 100 );
+		testChanges( second, 101 );
+	}
+
+	template< class _Tree >
+	void testTree( unsigned seed )
+	{
+		_Tree tree;
+		testChanges( tree, seed );
+		testBulk< _Tree >( seed + 1 );
+		testFindMany< _Tree >( seed + 2 );
+		testHints< _Tree >( seed + 3 );
+		testRemoveRange< _Tree >( seed + 4 );
+		testSplitJoin< _Tree >( seed + 5 );
+		testSetOperations< _Tree >( seed + 6 );
+		testParallelScans< _Tree >( seed + 7 );
+		testSerialize< _Tree >( seed + 8 );
+	}
+
+	template< class _Tree, class = void >
+	struct HasParallelUnion: std::false_type
+	{};
+
+	template< class _Tree >
+	struct HasParallelUnion< _Tree, std::void_t< decltype(
+		std::declval< _Tree & >().unionWith( std::declval< _Tree >(),
+		                                     true ) ) > >: std::true_type
+	{};
+
+	// A PoolArena is not thread-safe, so pooled trees offer no parallel
+	// builds or set operations; the read-only parallel scans remain.
+	static_assert( !PoolTree::PARALLEL && !HasParallelUnion< PoolTree >::value,
+	               "Pooled trees allocate on one thread" );
+	static_assert( HasParallelUnion< IntTree< util::TreeTraits > >::value,
+	               "Other trees merge in parallel" );
+}
+
+int main()
+{
+	testTree< IntTree< util::TreeTraits > >( 1 );
+	testTree< IntTree< util::OrderStatisticTraits > >( 10 );
+	testTree< IntTree< util::CompactTraits > >( 20 );
+	testTree< IntTree< CompactOrderTraits > >( 25 );
+	testTree< IntTree< util::StatisticTraits > >( 30 );
+
+	testTree< PoolTree >( 40 );
+	testSharedArena();
+	testStats();
+	testTeardown();
+	testPooledHeapNodes< AlignedKey >();
+	testPooledHeapNodes< LargeKey >();
+	testTransparent();
+	testComparator();
+	testCheck();
+	testMoveOnly();
+	testMoveAcrossArenas();
+	testJoinAcrossArenas();
+	testFailedCopy();
+
+	test::pass( "RedBlackTree" );
+	return 0;
+}
@@ -0,0 +1,126 @@
+// Differential test of util::ShardedRedBlackTree against std::set, with
+// writers on several threads and skewed keys that force rebalancing.
+
+#include "ShardedRedBlackTree.h"
+#include "TestUtil.h"
+
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	using TreeT = util::ShardedRedBlackTree< int >;
+
+	template< class _Tree >
+	void checkSame( _Tree const & tree, std::set< int > const & expected )
+	{
+		CHECK( tree.validate() );
+		CHECK( tree.getSize() == expected.size() );
+		CHECK( test::collect< int >( tree ) ==
+		       std::vector< int >( expected.begin(), expected.end() ) );
+	}
+
+	template< class _Tree >
+	void testSingleThread( unsigned seed )
+	{
+		test::Random random( seed );
+		_Tree tree( 4 );
+		std::set< int > expected;
+
+		for( int step = 0; step < 100000; ++step )
+		{
+			// Keys drift upwards, so the shards must follow them.
+			int key = step + random.next( 5000 );
+
+			if( random.chance( 70 ) )
+			{
+				CHECK( tree.add( key ) == expected.insert( key ).second );
+			}
+			else if( random.chance( 70 ) )
+			{
+				CHECK( tree.remove( key ) == ( expected.erase( key ) > 0 ) );
+			}
+			else
+			{
+				CHECK( tree.contains( key ) == ( expected.count( key ) > 0 ) );
+			}
+		}
+		checkSame( tree, expected );
+
+		for( bool parallel: { false, true } )
+		{
+			std::vector< int > batch;
+
+			for( int i = 0; i < 20000; ++i )
+			{
+				batch.push_back( random.next( 400000 ) );
+			}
+			std::size_t before = expected.size();
+			expected.insert( batch.begin(), batch.end() );
+			CHECK( tree.addMany( batch.begin(), batch.end(), parallel ) ==
+			       expected.size() - before );
+			checkSame( tree, expected );
+		}
+		tree.rebalance();
+		checkSame( tree, expected );
+		tree.clear();
+		checkSame( tree, {} );
+	}
+
+	// Writers own disjoint residue classes of the keys.
+	void testThreads()
+	{
+		int constexpr WRITERS = 4;
+		TreeT tree( 4 );
+		std::vector< std::set< int > > owned( WRITERS );
+		std::vector< std::thread > threads;
+
+		for( int w = 0; w < WRITERS; ++w )
+		{
+			threads.emplace_back( [ &, w ]()
+			{
+				test::Random random( unsigned( 10 + w ) );
+				std::set< int > & expected = owned[ w ];
+
+				for( int step = 0; step < 30000; ++step )
+				{
+					int key = ( step / 4 + random.next( 20000 ) ) * WRITERS + w;
+
+					if( random.chance( 65 ) )
+					{
+						CHECK( tree.add( key ) == expected.insert( key ).second );
+					}
+					else
+					{
+						CHECK( tree.remove( key ) ==
+						       ( expected.erase( key ) > 0 ) );
+					}
+				}
+			} );
+		}
+
+		for( auto & thread: threads )
+		{
+			thread.join();
+		}
+		std::set< int > expected;
+
+		for( auto & keys: owned )
+		{
+			expected.insert( keys.begin(), keys.end() );
+		}
+		checkSame( tree, expected );
+	}
+}
+
+int main()
+{
+	testSingleThread< TreeT >( 1 );
+	// Shards with order statistics select their split keys.
+	testSingleThread< util::ShardedRedBlackTree< int, std::less< int >,
+		util::OrderStatisticTraits > >( 2 );
+	testThreads();
+	test::pass( "ShardedRedBlackTree" );
+	return 0;
+}
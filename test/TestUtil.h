@@ -0,0 +1,155 @@
+#ifndef UTIL_TEST_TESTUTIL_H
+#define UTIL_TEST_TESTUTIL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <set>
+#include <vector>
+
+// Checks condition also when NDEBUG is defined, reporting the line of the
+// failure before aborting.
+#define CHECK( condition ) \
+	( ( condition ) ? ( void )0 : \
+	  test::fail( #condition, __FILE__, __LINE__ ) )
+
+namespace test
+{
+	using SizeT = std::size_t;
+
+	[[noreturn]] inline void fail( char const * condition, char const * file,
+	                               int line )
+	{
+		std::fprintf( stderr, "%s:%d: check failed: %s\n", file, line,
+		              condition );
+		std::abort();
+	}
+
+	// Random generator, seeded per test so that failures repeat.
+	class Random
+	{
+		public:
+
+		explicit Random( unsigned seed ):
+			m_engine{ seed }
+		{}
+
+		// Uniform in [0, bound).
+		int next( int bound )
+		{
+			return int( m_engine() % unsigned( bound ) );
+		}
+
+		bool chance( int percent )
+		{
+			return ( next( 100 ) < percent );
+		}
+
+		private:
+
+		std::mt19937 m_engine;
+	};
+
+	// Whether range holds exactly the elements of expected, in order.
+	template< class _Range, class _Expected >
+	bool isEqual( _Range const & range, _Expected const & expected )
+	{
+		return std::equal( range.begin(), range.end(), expected.begin(),
+		                   expected.end() );
+	}
+
+	// Keys of a container offering forEach() only, in the order visited.
+	template< class _KeyT, class _Tree >
+	std::vector< _KeyT > collect( _Tree const & tree )
+	{
+		std::vector< _KeyT > keys;
+		tree.forEach( [ & ]( _KeyT const & key )
+		{
+			keys.push_back( key );
+		} );
+		return keys;
+	}
+
+	// Pointer to the key at position in expected, or nullptr at its end,
+	// for comparing against lookups returning KeyT const *.
+	template< class _Expected, class _Iter >
+	bool isSameKey( typename _Expected::value_type const * key,
+	                _Expected const & expected, _Iter position )
+	{
+		if( position == expected.end() )
+		{
+			return ( key == nullptr );
+		}
+		return ( key != nullptr && *key == *position );
+	}
+
+	// Drives a set whose lookups return iterators, as BTree and
+	// TopDownRedBlackTree do, through random adds and removals of the keys
+	// makeKey( i ) for i below range, comparing it with std::set.
+	template< class _Tree, class _MakeKey >
+	void testIteratorSet( _Tree & tree, _MakeKey makeKey, int range,
+	                      int steps, unsigned seed )
+	{
+		using KeyT = typename _Tree::KeyT;
+
+		Random random( seed );
+		std::set< KeyT, typename _Tree::LessT > expected;
+
+		auto isSame = [ & ]( auto const & position, auto expectedPosition )
+		{
+			return ( expectedPosition == expected.end() ?
+			         position == tree.end() :
+			         position != tree.end() && *position == *expectedPosition );
+		};
+
+		for( int step = 0; step < steps; ++step )
+		{
+			KeyT key = makeKey( random.next( range ) );
+			int operation = random.next( 10 );
+
+			if( operation < 5 )
+			{
+				CHECK( tree.add( key ) == expected.insert( key ).second );
+			}
+			else if( operation < 8 )
+			{
+				CHECK( tree.remove( key ) == ( expected.erase( key ) > 0 ) );
+			}
+			else
+			{
+				CHECK( isSame( tree.find( key ), expected.find( key ) ) );
+				CHECK( tree.contains( key ) == ( expected.count( key ) > 0 ) );
+				CHECK( isSame( tree.lowerBound( key ),
+				               expected.lower_bound( key ) ) );
+				CHECK( isSame( tree.upperBound( key ),
+				               expected.upper_bound( key ) ) );
+
+				auto range = tree.equalRange( key );
+				CHECK( isSame( range.first, expected.lower_bound( key ) ) );
+				CHECK( isSame( range.second, expected.upper_bound( key ) ) );
+			}
+			CHECK( tree.getSize() == expected.size() );
+
+			if( step % 1000 == 0 )
+			{
+				CHECK( tree.validate() );
+				CHECK( isEqual( tree, expected ) );
+				CHECK( std::equal( tree.rbegin(), tree.rend(),
+				                   expected.rbegin(), expected.rend() ) );
+			}
+		}
+		CHECK( tree.validate() );
+		CHECK( isEqual( tree, expected ) );
+		tree.clear();
+		CHECK( tree.getSize() == 0 && tree.begin() == tree.end() );
+	}
+
+	inline void pass( char const * name )
+	{
+		std::printf( "%s: ok\n", name );
+	}
+}
+
+#endif
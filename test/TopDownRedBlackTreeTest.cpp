@@ -0,0 +1,136 @@
+// Differential test of util::TopDownRedBlackTree against std::set.
+
+#include "TopDownRedBlackTree.h"
+#include "PoolAllocator.h"
+#include "TestUtil.h"
+
+#include <iterator>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace
+{
+	// Allocator whose copies compare equal only with the same tag, and
+	// which does not propagate on move assignment.
+	template< class _T >
+	struct TaggedAllocator
+	{
+		using value_type = _T;
+
+		explicit TaggedAllocator( int tag = 0 ):
+			m_tag{ tag }
+		{}
+
+		template< class _U >
+		TaggedAllocator( TaggedAllocator< _U > const & other ):
+			m_tag{ other.m_tag }
+		{}
+
+		_T * allocate( std::size_t count )
+		{
+			return std::allocator< _T >{}.allocate( count );
+		}
+
+		void deallocate( _T * block, std::size_t count )
+		{
+			std::allocator< _T >{}.deallocate( block, count );
+		}
+
+		template< class _U >
+		bool operator==( TaggedAllocator< _U > const & other ) const
+		{
+			return m_tag == other.m_tag;
+		}
+
+		template< class _U >
+		bool operator!=( TaggedAllocator< _U > const & other ) const
+		{
+			return m_tag != other.m_tag;
+		}
+
+		int	m_tag;
+	};
+
+	// Sorted builds of every size up to a few full levels, and moves
+	// between trees whose allocators differ, which rebuild the keys.
+	void testSorted()
+	{
+		using TaggedTree = util::TopDownRedBlackTree< std::string,
+			std::less< std::string >, TaggedAllocator< std::string > >;
+
+		std::vector< std::string > keys;
+
+		for( int i = 0; i < 300; ++i )
+		{
+			TaggedTree built( util::SORTED_UNIQUE, keys.begin(), keys.end(),
+			                  TaggedAllocator< std::string >( 1 ) );
+			CHECK( built.validate() && test::isEqual( built, keys ) );
+
+			TaggedTree target( TaggedAllocator< std::string >( 2 ) );
+			target.add( "old" );
+			target = std::move( built );
+			CHECK( built.getSize() == 0 && built.validate() );
+			CHECK( target.validate() && test::isEqual( target, keys ) );
+			CHECK( target.getAllocator().m_tag == 2 );
+
+			keys.push_back( "key" + std::to_string( 1000 + i ) );
+		}
+	}
+}
+
+int main()
+{
+	util::TopDownRedBlackTree< int > ints;
+	test::testIteratorSet( ints, []( int i ) { return i; }, 3000, 100000, 1 );
+
+	util::TopDownRedBlackTree< int, std::less< int >,
+	                           util::PoolAllocator< int > > pooled;
+	test::testIteratorSet( pooled, []( int i ) { return i; }, 300, 50000, 2 );
+
+	util::TopDownRedBlackTree< std::string > strings;
+	test::testIteratorSet( strings,
+		[]( int i ) { return std::to_string( i ); }, 3000, 50000, 3 );
+
+	// Copies are deep and independent of the original.
+	util::TopDownRedBlackTree< int > original;
+
+	for( int i = 0; i < 1000; ++i )
+	{
+		original.add( i * 7 % 1000 );
+	}
+	util::TopDownRedBlackTree< int > copy( original );
+	original.remove( 5 );
+	CHECK( copy.validate() && copy.getSize() == 1000 && copy.contains( 5 ) );
+	CHECK( original.validate() && original.getSize() == 999 );
+
+	// Iterators from emplace() step like those from find(), whatever
+	// rotations the insertion made.
+	util::TopDownRedBlackTree< int > emplaced;
+	test::Random random( 4 );
+	std::set< int > expected;
+
+	for( int i = 0; i < 20000; ++i )
+	{
+		int key = random.next( 5000 );
+		auto result = emplaced.emplace( key );
+		CHECK( result.second == expected.insert( key ).second );
+		CHECK( result.first == emplaced.find( key ) && *result.first == key );
+
+		auto next = expected.upper_bound( key );
+		auto stepped = std::next( result.first );
+		CHECK( next == expected.end() ? stepped == emplaced.end() :
+		                                *stepped == *next );
+
+		if( key != *expected.begin() )
+		{
+			CHECK( *std::prev( result.first ) == *std::prev( next, 2 ) );
+		}
+	}
+	CHECK( emplaced.validate() && test::isEqual( emplaced, expected ) );
+
+	testSorted();
+	test::pass( "TopDownRedBlackTree" );
+	return 0;
+}
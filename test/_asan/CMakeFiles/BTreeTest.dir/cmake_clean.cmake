@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "BTreeTest"
+  "BTreeTest.pdb"
+  "CMakeFiles/BTreeTest.dir/BTreeTest.cpp.o"
+  "CMakeFiles/BTreeTest.dir/BTreeTest.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/BTreeTest.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
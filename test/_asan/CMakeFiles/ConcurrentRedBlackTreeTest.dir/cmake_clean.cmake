@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/ConcurrentRedBlackTreeTest.dir/ConcurrentRedBlackTreeTest.cpp.o"
+  "CMakeFiles/ConcurrentRedBlackTreeTest.dir/ConcurrentRedBlackTreeTest.cpp.o.d"
+  "ConcurrentRedBlackTreeTest"
+  "ConcurrentRedBlackTreeTest.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/ConcurrentRedBlackTreeTest.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
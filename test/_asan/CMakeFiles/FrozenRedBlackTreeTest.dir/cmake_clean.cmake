@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/FrozenRedBlackTreeTest.dir/FrozenRedBlackTreeTest.cpp.o"
+  "CMakeFiles/FrozenRedBlackTreeTest.dir/FrozenRedBlackTreeTest.cpp.o.d"
+  "FrozenRedBlackTreeTest"
+  "FrozenRedBlackTreeTest.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/FrozenRedBlackTreeTest.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/FrozenTreeViewTest.dir/FrozenTreeViewTest.cpp.o"
+  "CMakeFiles/FrozenTreeViewTest.dir/FrozenTreeViewTest.cpp.o.d"
+  "FrozenTreeViewTest"
+  "FrozenTreeViewTest.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/FrozenTreeViewTest.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
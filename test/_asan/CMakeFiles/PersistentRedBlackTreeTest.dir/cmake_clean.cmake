@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/PersistentRedBlackTreeTest.dir/PersistentRedBlackTreeTest.cpp.o"
+  "CMakeFiles/PersistentRedBlackTreeTest.dir/PersistentRedBlackTreeTest.cpp.o.d"
+  "PersistentRedBlackTreeTest"
+  "PersistentRedBlackTreeTest.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/PersistentRedBlackTreeTest.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
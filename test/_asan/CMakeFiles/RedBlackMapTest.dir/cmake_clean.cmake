@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/RedBlackMapTest.dir/RedBlackMapTest.cpp.o"
+  "CMakeFiles/RedBlackMapTest.dir/RedBlackMapTest.cpp.o.d"
+  "RedBlackMapTest"
+  "RedBlackMapTest.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/RedBlackMapTest.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/RedBlackMultisetTest.dir/RedBlackMultisetTest.cpp.o"
+  "CMakeFiles/RedBlackMultisetTest.dir/RedBlackMultisetTest.cpp.o.d"
+  "RedBlackMultisetTest"
+  "RedBlackMultisetTest.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/RedBlackMultisetTest.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/RedBlackTreeTest.dir/RedBlackTreeTest.cpp.o"
+  "CMakeFiles/RedBlackTreeTest.dir/RedBlackTreeTest.cpp.o.d"
+  "RedBlackTreeTest"
+  "RedBlackTreeTest.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/RedBlackTreeTest.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
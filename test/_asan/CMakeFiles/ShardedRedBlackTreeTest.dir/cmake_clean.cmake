@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/ShardedRedBlackTreeTest.dir/ShardedRedBlackTreeTest.cpp.o"
+  "CMakeFiles/ShardedRedBlackTreeTest.dir/ShardedRedBlackTreeTest.cpp.o.d"
+  "ShardedRedBlackTreeTest"
+  "ShardedRedBlackTreeTest.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/ShardedRedBlackTreeTest.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/TopDownRedBlackTreeTest.dir/TopDownRedBlackTreeTest.cpp.o"
+  "CMakeFiles/TopDownRedBlackTreeTest.dir/TopDownRedBlackTreeTest.cpp.o.d"
+  "TopDownRedBlackTreeTest"
+  "TopDownRedBlackTreeTest.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/TopDownRedBlackTreeTest.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,26 @@
+# CMake generated Testfile for 
+# Source directory: /root/repo/test
+# Build directory: /root/repo/test/_asan
+# 
+# This file includes the relevant testing commands required for 
+# testing this directory and lists subdirectories to be tested as well.
+add_test(BTreeTest "/root/repo/test/_asan/BTreeTest")
+set_tests_properties(BTreeTest PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/test/CMakeLists.txt;49;add_test;/root/repo/test/CMakeLists.txt;0;")
+add_test(ConcurrentRedBlackTreeTest "/root/repo/test/_asan/ConcurrentRedBlackTreeTest")
+set_tests_properties(ConcurrentRedBlackTreeTest PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/test/CMakeLists.txt;49;add_test;/root/repo/test/CMakeLists.txt;0;")
+add_test(FrozenRedBlackTreeTest "/root/repo/test/_asan/FrozenRedBlackTreeTest")
+set_tests_properties(FrozenRedBlackTreeTest PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/test/CMakeLists.txt;49;add_test;/root/repo/test/CMakeLists.txt;0;")
+add_test(FrozenTreeViewTest "/root/repo/test/_asan/FrozenTreeViewTest")
+set_tests_properties(FrozenTreeViewTest PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/test/CMakeLists.txt;49;add_test;/root/repo/test/CMakeLists.txt;0;")
+add_test(PersistentRedBlackTreeTest "/root/repo/test/_asan/PersistentRedBlackTreeTest")
+set_tests_properties(PersistentRedBlackTreeTest PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/test/CMakeLists.txt;49;add_test;/root/repo/test/CMakeLists.txt;0;")
+add_test(RedBlackMapTest "/root/repo/test/_asan/RedBlackMapTest")
+set_tests_properties(RedBlackMapTest PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/test/CMakeLists.txt;49;add_test;/root/repo/test/CMakeLists.txt;0;")
+add_test(RedBlackMultisetTest "/root/repo/test/_asan/RedBlackMultisetTest")
+set_tests_properties(RedBlackMultisetTest PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/test/CMakeLists.txt;49;add_test;/root/repo/test/CMakeLists.txt;0;")
+add_test(RedBlackTreeTest "/root/repo/test/_asan/RedBlackTreeTest")
+set_tests_properties(RedBlackTreeTest PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/test/CMakeLists.txt;49;add_test;/root/repo/test/CMakeLists.txt;0;")
+add_test(ShardedRedBlackTreeTest "/root/repo/test/_asan/ShardedRedBlackTreeTest")
+set_tests_properties(ShardedRedBlackTreeTest PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/test/CMakeLists.txt;49;add_test;/root/repo/test/CMakeLists.txt;0;")
+add_test(TopDownRedBlackTreeTest "/root/repo/test/_asan/TopDownRedBlackTreeTest")
+set_tests_properties(TopDownRedBlackTreeTest PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/test/CMakeLists.txt;49;add_test;/root/repo/test/CMakeLists.txt;0;")